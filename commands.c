@@ -584,6 +584,10 @@ execute_file_commands (file_t *file, target_stack_node_t *p_call_stack)
   if (file->loaded)
     unload_file (file->name);
 
+  /* Look up what it inherits from its parents in one place.  */
+  if (variable_view_flag)
+    make_variable_view (file->variables);
+
   /* Start the commands running.  */
   new_job (file, p_call_stack);
 }
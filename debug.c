@@ -72,6 +72,9 @@ decode_debug_flags (int b_debug_flag, stringlist_t *ppsz_db_flags)
             case 'b':
               db_level |= DB_BASIC;
               break;
+            case 'c':
+              db_level |= DB_CONDITIONALS;
+              break;
             case 'i':
               db_level |= DB_BASIC | DB_IMPLICIT;
               break;
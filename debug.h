@@ -42,6 +42,7 @@ typedef enum {
 			     */
   DB_TRACE          = 0x010, /**< tracing */
   DB_SHELL          = 0x020, /**< add +x to SHELL invocations */
+  DB_CONDITIONALS   = 0x040, /**< How often conditionals were reused */
   DB_MAKEFILES      = 0x100,
   DB_READ_MAKEFILES = 0x200, /**< Reading makefiles */
   DB_CALL           = 0x400, /**< GNU Make function call and returns */
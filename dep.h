@@ -85,19 +85,30 @@ struct nameseq *ar_glob (const char *arname, const char *member_pattern, unsigne
 
 #define dep_name(d)     ((d)->name == 0 ? (d)->file->name : (d)->name)
 
-#define alloc_dep()     (xcalloc (sizeof (struct dep)))
 #define free_ns(_n)     free (_n)
-#define free_dep(_d)    free_ns (_d)
+
+/* Elements of chains parse_file_seq builds are struct dep if they are that
+   big, and then must be freed with free_dep.  */
+#define alloc_seq_elt(_s) \
+            ((_s) == sizeof (struct dep) ? (void *) alloc_dep () : xcalloc (_s))
+
+struct dep *alloc_dep (void);
+void free_dep (struct dep *d);
 
 struct dep *copy_dep_chain (const struct dep *d);
 void free_dep_chain (struct dep *d);
 void free_ns_chain (struct nameseq *n);
 struct dep *read_all_makefiles (const char **makefiles);
 
+/*! Names tried, in order, when no makefile is given with -f.  */
+extern const char *default_makefiles[];
+
 /*! The chain of makefiles read by read_makefile.  */
 struct dep *read_makefiles;
 
 void eval_buffer (char *buffer, const gmk_floc *floc);
+void eval_cache_print_stats (const char *prefix);
+int reread_makefile (struct dep *d);
 enum update_status update_goal_chain (struct dep *goals);
 
 #endif /*REMAKE_DEP_H*/
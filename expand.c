@@ -23,6 +23,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "variable.h"
 #include "rule.h"
+#include "profile.h"
 
 /* Initially, any errors reported when expanding strings will be reported
    against the file where the error appears.  */
@@ -54,6 +55,18 @@ char *variable_buffer;
 
 char *
 variable_buffer_output (char *ptr, const char *string, unsigned int length)
+{
+  ptr = variable_buffer_reserve (ptr, length);
+  memcpy (ptr, string, length);
+  return ptr + length;
+}
+
+/* Make sure there is room for LENGTH chars at PTR in the variable_buffer,
+   and return PTR, which may have moved.  Callers that write several pieces
+   at once can then copy them in directly.  */
+
+char *
+variable_buffer_reserve (char *ptr, unsigned int length)
 {
   register unsigned int newlen = length + (ptr - variable_buffer);
 
@@ -67,8 +80,7 @@ variable_buffer_output (char *ptr, const char *string, unsigned int length)
       ptr = variable_buffer + offset;
     }
 
-  memcpy (ptr, string, length);
-  return ptr + length;
+  return ptr;
 }
 
 /* Return a pointer to the beginning of the variable buffer.  */
@@ -88,18 +100,81 @@ initialize_variable_output (void)
   return variable_buffer;
 }
 
-/* Recursively expand V.  The returned string is malloc'd.  */
+/* Compiled values.
+
+   Expanding the value of a recursive variable means scanning it for
+   references and function calls each time.  The second time a variable is
+   expanded its value is compiled by compile_expansion into a list of
+   operations that allocated_expansion can run instead.  This is kept in
+   the variable until its value changes.  */
+
+enum expansion_opcode
+  {
+    eo_text,                    /* Output TEXT.  */
+    eo_variable,                /* Reference the variable named by TEXT.  */
+    eo_substitution,            /* Substitution reference to TEXT.  */
+    eo_computed,                /* Reference the variable NAME expands to.  */
+    eo_function,                /* Call a function.  */
+    eo_expand                   /* Expand TEXT with variable_expand_string.  */
+  };
+
+struct expansion_op
+  {
+    enum expansion_opcode opcode;
+    unsigned int length;        /* Length of TEXT.  */
+    const char *text;           /* Points into the expansion's copy, or
+                                   the strcache for eo_variable.  */
+    union
+      {
+        unsigned long hash;             /* eo_variable */
+        struct expansion *name;         /* eo_computed */
+        struct function_call *call;     /* eo_function */
+        struct                          /* eo_substitution */
+          {
+            char *buf;
+            char *pattern, *replace, *ppercent, *rpercent;
+          } subst;
+      } u;
+  };
+
+struct expansion
+  {
+    unsigned int refs;          /* One for the owner and each running copy.  */
+    unsigned int count;         /* Operations in OPS.  */
+    unsigned int size;          /* Room in OPS.  */
+    unsigned long functions;    /* function_table_changes when compiled.  */
+    char *text;                 /* Copy of the text compiled.  */
+    struct expansion_op *ops;
+  };
 
 static char *allocated_variable_append (const struct variable *v);
+static struct expansion *literal_expansion (const char *text);
+static char *run_expansion (char *o, struct expansion *exp);
 
-char *
-recursively_expand_for_file (struct variable *v, struct file *file)
+/* Do the work of expand_recursive_variable.  */
+
+static char *
+expand_variable_value (char *o, struct variable *v, struct file *file)
 {
-  char *value;
+  char *value = 0;
+  unsigned long start = o ? o - variable_buffer : 0;
   const gmk_floc *this_var;
   const gmk_floc **saved_varp;
   struct variable_set_list *save = 0;
   int set_reading = 0;
+  struct variable_deps deps;
+  struct variable_deps *outer = variable_deps;
+  unsigned long calls = 0;
+  int trial = 0;
+
+  if (v->frozen)
+    {
+      if (variables_frozen ())
+        return (o ? variable_buffer_output (o, v->expansion->text,
+                                            v->expansion->ops[0].length)
+                : xstrdup (v->expansion->text));
+      forget_expansion (v);
+    }
 
   /* Don't install a new location if this location is empty.
      This can happen for command-line variables, builtin variables, etc.  */
@@ -133,13 +208,84 @@ recursively_expand_for_file (struct variable *v, struct file *file)
       current_variable_set_list = file->variables;
     }
 
+  /* See what the value depends on, to decide whether it can be frozen.  */
+  if (!v->unfreezable && !v->append && variables_frozen ())
+    {
+      trial = 1;
+      deps.count = 0;
+      deps.overflow = 0;
+      deps.local = 0;
+      deps.context = current_variable_set_list;
+      variable_deps = &deps;
+      calls = impure_function_calls;
+    }
+
   v->expanding = 1;
   if (v->append)
-    value = allocated_variable_append (v);
+    {
+      value = allocated_variable_append (v);
+      if (o)
+        {
+          o = variable_buffer_output (o, value, strlen (value));
+          free (value);
+          value = 0;
+        }
+    }
   else
-    value = allocated_variable_expand (v->value);
+    {
+      if (v->expansion && v->expansion->functions != function_table_changes)
+        {
+          /* A function has been defined since V was compiled.  */
+          release_expansion (v->expansion);
+          v->expansion = 0;
+        }
+
+      /* Compile the value the second time it is expanded: many variables
+         are only expanded once.  */
+      if (!v->expansion && v->expanded)
+        v->expansion = compile_expansion (v->value, strlen (v->value));
+      v->expanded = 1;
+
+      if (!o)
+        value = (v->expansion ? allocated_expansion (v->expansion)
+                 : allocated_variable_expand (v->value));
+      else if (v->expansion)
+        {
+          if (profiling_parse)
+            profile_parse_expand (1);
+          o = run_expansion (o, v->expansion);
+          if (profiling_parse)
+            profile_parse_expand (0);
+        }
+      else
+        {
+          o = variable_expand_string (o, v->value, -1);
+          o += strlen (o);
+        }
+    }
   v->expanding = 0;
 
+  if (trial)
+    {
+      variable_deps = outer;
+      if (o)
+        {
+          /* Terminate the value, without counting the nul as output.  */
+          o = variable_buffer_output (o, "", 1) - 1;
+          value = variable_buffer + start;
+        }
+      if (may_freeze_variable (v, &deps, calls != impure_function_calls))
+        {
+          forget_expansion (v);
+          v->expansion = literal_expansion (value);
+          v->frozen = 1;
+          ++frozen_variables;
+        }
+      if (outer)
+        merge_variable_deps (outer, &deps);
+      free_variable_deps (deps.deps, deps.count);
+    }
+
   if (set_reading)
     reading_file = 0;
 
@@ -148,21 +294,49 @@ recursively_expand_for_file (struct variable *v, struct file *file)
 
   expanding_var = saved_varp;
 
-  return value;
+  return o ? o : value;
 }
 
-/* Expand a simple reference to variable NAME, which is LENGTH chars long.  */
+/* Recursively expand V.  If O is null, return the value malloc'd.
+   Otherwise write it at O in 'variable_buffer', as the caller is
+   expanding there anyway, and return the end of it.  */
+
+static char *
+expand_recursive_variable (char *o, struct variable *v, struct file *file)
+{
+  unsigned long start;
+  char *result;
+
+  if (!profile_variables_flag)
+    return expand_variable_value (o, v, file);
+
+  start = o ? o - variable_buffer : 0;
+  profile_variable_enter (v->name);
+  result = expand_variable_value (o, v, file);
+  profile_variable_leave (o ? (result - variable_buffer) - start
+                          : strlen (result));
+  return result;
+}
+
+char *
+recursively_expand_for_file (struct variable *v, struct file *file)
+{
+  return expand_recursive_variable (0, v, file);
+}
+
+/* Expand a simple reference to variable NAME, which is LENGTH chars long
+   and has variable_name_hash HASH.  */
 
 #ifdef __GNUC__
 __inline
 #endif
 static char *
-reference_variable (char *o, const char *name, unsigned int length)
+reference_variable (char *o, const char *name, unsigned int length,
+                    unsigned long hash)
 {
   struct variable *v;
-  char *value;
 
-  v = lookup_variable (name, length);
+  v = lookup_hashed_variable (name, length, hash);
 
   if (v == 0)
     warn_undefined (name, length);
@@ -171,15 +345,120 @@ reference_variable (char *o, const char *name, unsigned int length)
   if (v == 0 || (*v->value == '\0' && !v->append))
     return o;
 
-  value = (v->recursive ? recursively_expand (v) : v->value);
+  if (v->recursive)
+    return expand_recursive_variable (o, v, 0);
 
-  o = variable_buffer_output (o, value, strlen (value));
+  return variable_buffer_output (o, v->value, strlen (v->value));
+}
 
-  if (v->recursive)
-    free (value);
+/* Copy the pattern and the replacement of a substitution reference
+   $(FOO:A=B), where A runs from BEG to SUBST_END and B from after the = to
+   END, into BUF, which must have room for END - BEG + 3 bytes.  Set the
+   pointers as patsubst_expand_pat wants them.  */
+
+static void
+split_substitution (char *buf, const char *beg, const char *subst_end,
+                    const char *end, char **patternp, char **replacep,
+                    char **ppercentp, char **rpercentp)
+{
+  const char *replace_beg = subst_end + 1;
+  char *pattern, *replace, *ppercent, *rpercent;
+
+  /* Add in an extra % at the beginning of each to use in case there isn't
+     one in the pattern.  */
+  pattern = buf;
+  *(pattern++) = '%';
+  memcpy (pattern, beg, subst_end - beg);
+  pattern[subst_end - beg] = '\0';
+
+  replace = pattern + (subst_end - beg) + 1;
+  *(replace++) = '%';
+  memcpy (replace, replace_beg, end - replace_beg);
+  replace[end - replace_beg] = '\0';
+
+  /* Look for %.  Set the percent pointers properly
+     based on whether we find one or not.  */
+  ppercent = find_percent (pattern);
+  if (ppercent)
+    {
+      ++ppercent;
+      rpercent = find_percent (replace);
+      if (rpercent)
+        ++rpercent;
+    }
+  else
+    {
+      ppercent = pattern;
+      rpercent = replace;
+      --pattern;
+      --replace;
+    }
+
+  *patternp = pattern;
+  *replacep = replace;
+  *ppercentp = ppercent;
+  *rpercentp = rpercent;
+}
+
+/* Expand a substitution reference to variable NAME, which is LENGTH chars
+   long, with the pattern and replacement that split_substitution found.  */
+
+static char *
+substitution_reference (char *o, const char *name, unsigned int length,
+                        const char *pattern, const char *replace,
+                        const char *ppercent, const char *rpercent)
+{
+  struct variable *v;
+
+  v = lookup_variable (name, length);
+  if (v == 0)
+    warn_undefined (name, length);
+
+  /* If the variable is not empty, perform the substitution.  */
+  if (v != 0 && *v->value != '\0')
+    {
+      char *value = (v->recursive ? recursively_expand (v) : v->value);
+
+      o = patsubst_expand_pat (o, value, pattern, replace,
+                               ppercent, rpercent);
+
+      if (v->recursive)
+        free (value);
+    }
 
   return o;
 }
+
+/* Expand the reference whose text, with any variable references inside
+   it already expanded, runs from BEG to END.  */
+
+static char *
+reference_text (char *o, const char *beg, const char *end)
+{
+  /* Is the text a substitution reference?  */
+  const char *colon = lindex (beg, end, ':');
+  if (colon)
+    {
+      /* This looks like a substitution reference: $(FOO:A=B).  */
+      const char *subst_end = lindex (colon + 1, end, '=');
+      if (subst_end != 0)
+        {
+          char *pattern, *replace, *ppercent, *rpercent;
+
+          split_substitution (alloca (end - colon + 2), colon + 1, subst_end,
+                              end, &pattern, &replace, &ppercent, &rpercent);
+          return substitution_reference (o, beg, colon - beg, pattern,
+                                         replace, ppercent, rpercent);
+        }
+
+      /* There is no = in sight.  Punt on the substitution reference and
+         treat this as a variable name containing a colon.  */
+    }
+
+  /* This is an ordinary variable reference.  */
+  return reference_variable (o, beg, end - beg,
+                             variable_name_hash (beg, end - beg));
+}
 
 /* Scan STRING for variable references and expansion-function calls.  Only
    LENGTH bytes of STRING are actually scanned.  If LENGTH is -1, scan until
@@ -193,9 +472,8 @@ reference_variable (char *o, const char *name, unsigned int length)
 char *
 variable_expand_string (char *line, const char *string, long length)
 {
-  struct variable *v;
   const char *p, *p1;
-  char *save;
+  char *save, *alloc = 0;
   char *o;
   unsigned int line_offset;
 
@@ -212,8 +490,18 @@ variable_expand_string (char *line, const char *string, long length)
 
   /* We need a copy of STRING: due to eval, it's possible that it will get
      freed as we process it (it might be the value of a variable that's reset
-     for example).  Also having a nil-terminated string is handy.  */
-  save = length < 0 ? xstrdup (string) : xstrndup (string, length);
+     for example).  Also having a nil-terminated string is handy.  Most
+     strings are short enough to copy onto the stack.  */
+  if (profiling_parse)
+    profile_parse_expand (1);
+  if (length < 0)
+    length = strlen (string);
+  if (length + 1 > 1000)
+    save = alloc = xmalloc (length + 1);
+  else
+    save = alloca (length + 1);
+  memcpy (save, string, length);
+  save[length] = '\0';
   p = save;
 
   while (1)
@@ -249,7 +537,7 @@ variable_expand_string (char *line, const char *string, long length)
             const char *beg = p + 1;
             char *op;
             char *abeg = NULL;
-            const char *end, *colon;
+            const char *end;
 
             op = o;
             begp = p;
@@ -297,85 +585,8 @@ variable_expand_string (char *line, const char *string, long length)
               p = end;
 
             /* This is not a reference to a built-in function and
-               any variable references inside are now expanded.
-               Is the resultant text a substitution reference?  */
-
-            colon = lindex (beg, end, ':');
-            if (colon)
-              {
-                /* This looks like a substitution reference: $(FOO:A=B).  */
-                const char *subst_beg = colon + 1;
-                const char *subst_end = lindex (subst_beg, end, '=');
-                if (subst_end == 0)
-                  /* There is no = in sight.  Punt on the substitution
-                     reference and treat this as a variable name containing
-                     a colon, in the code below.  */
-                  colon = 0;
-                else
-                  {
-                    const char *replace_beg = subst_end + 1;
-                    const char *replace_end = end;
-
-                    /* Extract the variable name before the colon
-                       and look up that variable.  */
-                    v = lookup_variable (beg, colon - beg);
-                    if (v == 0)
-                      warn_undefined (beg, colon - beg);
-
-                    /* If the variable is not empty, perform the
-                       substitution.  */
-                    if (v != 0 && *v->value != '\0')
-                      {
-                        char *pattern, *replace, *ppercent, *rpercent;
-                        char *value = (v->recursive
-                                       ? recursively_expand (v)
-                                       : v->value);
-
-                        /* Copy the pattern and the replacement.  Add in an
-                           extra % at the beginning to use in case there
-                           isn't one in the pattern.  */
-                        pattern = alloca (subst_end - subst_beg + 2);
-                        *(pattern++) = '%';
-                        memcpy (pattern, subst_beg, subst_end - subst_beg);
-                        pattern[subst_end - subst_beg] = '\0';
-
-                        replace = alloca (replace_end - replace_beg + 2);
-                        *(replace++) = '%';
-                        memcpy (replace, replace_beg,
-                               replace_end - replace_beg);
-                        replace[replace_end - replace_beg] = '\0';
-
-                        /* Look for %.  Set the percent pointers properly
-                           based on whether we find one or not.  */
-                        ppercent = find_percent (pattern);
-                        if (ppercent)
-                          {
-                            ++ppercent;
-                            rpercent = find_percent (replace);
-                            if (rpercent)
-                              ++rpercent;
-                          }
-                        else
-                          {
-                            ppercent = pattern;
-                            rpercent = replace;
-                            --pattern;
-                            --replace;
-                          }
-
-                        o = patsubst_expand_pat (o, value, pattern, replace,
-                                                 ppercent, rpercent);
-
-                        if (v->recursive)
-                          free (value);
-                      }
-                  }
-              }
-
-            if (colon == 0)
-              /* This is an ordinary variable reference.
-                 Look up the value of the variable.  */
-                o = reference_variable (o, beg, end - beg);
+               any variable references inside are now expanded.  */
+            o = reference_text (o, beg, end);
 
             free (abeg);
           }
@@ -390,7 +601,7 @@ variable_expand_string (char *line, const char *string, long length)
 
           /* A $ followed by a random char is a variable reference:
              $a is equivalent to $(a).  */
-          o = reference_variable (o, p, 1);
+          o = reference_variable (o, p, 1, variable_name_hash (p, 1));
 
           break;
         }
@@ -401,9 +612,11 @@ variable_expand_string (char *line, const char *string, long length)
       ++p;
     }
 
-  free (save);
+  free (alloc);
 
   variable_buffer_output (o, "", 1);
+  if (profiling_parse)
+    profile_parse_expand (0);
   return (variable_buffer + line_offset);
 }
 
@@ -610,3 +823,383 @@ restore_variable_buffer (char *buf, unsigned int len)
   variable_buffer = buf;
   variable_buffer_length = len;
 }
+
+static struct expansion_op *
+add_expansion_op (struct expansion *exp, enum expansion_opcode opcode,
+                  const char *text, unsigned int length)
+{
+  struct expansion_op *op;
+
+  if (exp->count == exp->size)
+    {
+      exp->size = exp->size ? exp->size * 2 : 4;
+      exp->ops = xrealloc (exp->ops, exp->size * sizeof (struct expansion_op));
+    }
+
+  op = &exp->ops[exp->count++];
+  op->opcode = opcode;
+  op->text = text;
+  op->length = length;
+  return op;
+}
+
+/* Add a reference to the variable named by the LENGTH chars at NAME.  The
+   name is interned and hashed now, so running the reference finds the
+   variable without looking at the name again.  */
+
+static void
+add_variable_op (struct expansion *exp, const char *name, unsigned int length)
+{
+  struct expansion_op *op;
+
+  op = add_expansion_op (exp, eo_variable, strcache_add_len (name, length),
+                         length);
+  op->u.hash = variable_name_hash (name, length);
+}
+
+/* Make an expansion that just gives TEXT, for a frozen variable.  */
+
+static struct expansion *
+literal_expansion (const char *text)
+{
+  struct expansion *exp = xcalloc (sizeof (struct expansion));
+
+  exp->refs = 1;
+  exp->functions = function_table_changes;
+  exp->text = xstrdup (text);
+  add_expansion_op (exp, eo_text, exp->text, strlen (text));
+  return exp;
+}
+
+/* Compile the LENGTH chars at STRING.  The text is scanned just as
+   variable_expand_string scans it; anything it would report an error for
+   is left for it to expand when the result is run.  */
+
+struct expansion *
+compile_expansion (const char *string, unsigned int length)
+{
+  struct expansion *exp = xcalloc (sizeof (struct expansion));
+  struct expansion_op *op;
+  const char *p, *p1;
+
+  exp->refs = 1;
+  exp->functions = function_table_changes;
+  exp->text = xstrndup (string, length);
+  p = exp->text;
+
+  while (1)
+    {
+      p1 = strchr (p, '$');
+      if (p1 == 0)
+        {
+          if (*p != '\0')
+            add_expansion_op (exp, eo_text, p, strlen (p));
+          break;
+        }
+      if (p1 > p)
+        add_expansion_op (exp, eo_text, p, p1 - p);
+      p = p1 + 1;
+
+      switch (*p)
+        {
+        case '$':
+          add_expansion_op (exp, eo_text, p, 1);
+          break;
+
+        case '(':
+        case '{':
+          {
+            char openparen = *p;
+            char closeparen = (openparen == '(') ? ')' : '}';
+            const char *beg = p + 1;
+            const char *end, *colon, *subst_end;
+            struct function_call *call;
+            int r;
+
+            r = compile_function_call (&p, &call);
+            if (r > 0)
+              {
+                op = add_expansion_op (exp, eo_function, 0, 0);
+                op->u.call = call;
+                break;
+              }
+
+            end = strchr (beg, closeparen);
+            if (r < 0 || end == 0)
+              {
+                /* Unterminated: let variable_expand_string say so.  */
+                add_expansion_op (exp, eo_expand, p1, strlen (p1));
+                return exp;
+              }
+
+            if (lindex (beg, end, '$') != 0)
+              {
+                int count = 0;
+                for (p = beg; *p != '\0'; ++p)
+                  {
+                    if (*p == openparen)
+                      ++count;
+                    else if (*p == closeparen && --count < 0)
+                      break;
+                  }
+                if (count < 0)
+                  {
+                    op = add_expansion_op (exp, eo_computed, 0, 0);
+                    op->u.name = compile_expansion (beg, p - beg);
+                    break;
+                  }
+                /* Otherwise P is at the end, and the name is taken to end
+                   at the first close paren or brace, as in '$($(a)'.  */
+              }
+            else
+              p = end;
+
+            colon = lindex (beg, end, ':');
+            subst_end = colon ? lindex (colon + 1, end, '=') : 0;
+            if (subst_end)
+              {
+                op = add_expansion_op (exp, eo_substitution, beg, colon - beg);
+                op->u.subst.buf = xmalloc (end - colon + 2);
+                split_substitution (op->u.subst.buf, colon + 1, subst_end, end,
+                                    &op->u.subst.pattern, &op->u.subst.replace,
+                                    &op->u.subst.ppercent,
+                                    &op->u.subst.rpercent);
+              }
+            else
+              add_variable_op (exp, beg, end - beg);
+          }
+          break;
+
+        case '\0':
+          break;
+
+        default:
+          add_variable_op (exp, p, 1);
+          break;
+        }
+
+      if (*p == '\0')
+        break;
+
+      ++p;
+    }
+
+  return exp;
+}
+
+/* Run EXP, writing the result to O in 'variable_buffer'.  Return the
+   updated O.  */
+
+static char *
+run_expansion (char *o, struct expansion *exp)
+{
+  unsigned int i;
+
+  /* Expanding may redefine the variable EXP came from.  */
+  ++exp->refs;
+
+  for (i = 0; i < exp->count; ++i)
+    {
+      const struct expansion_op *op = &exp->ops[i];
+
+      switch (op->opcode)
+        {
+        case eo_text:
+          o = variable_buffer_output (o, op->text, op->length);
+          break;
+
+        case eo_variable:
+          o = reference_variable (o, op->text, op->length, op->u.hash);
+          break;
+
+        case eo_substitution:
+          o = substitution_reference (o, op->text, op->length,
+                                      op->u.subst.pattern,
+                                      op->u.subst.replace,
+                                      op->u.subst.ppercent,
+                                      op->u.subst.rpercent);
+          break;
+
+        case eo_computed:
+          {
+            unsigned int depth = stacked_values ();
+            char *name = stacked_expansion (op->u.name);
+            o = reference_text (o, name, name + strlen (name));
+            release_stacked_values (depth);
+          }
+          break;
+
+        case eo_function:
+          o = expand_function_call (o, op->u.call);
+          break;
+
+        case eo_expand:
+          o = variable_expand_string (o, op->text, op->length);
+          o += strlen (o);
+          break;
+        }
+    }
+
+  release_expansion (exp);
+
+  return o;
+}
+
+/* Like allocated_variable_expand, but run the compiled EXP.  */
+
+char *
+allocated_expansion (struct expansion *exp)
+{
+  char *value;
+
+  char *obuf = variable_buffer;
+  unsigned int olen = variable_buffer_length;
+
+  variable_buffer = 0;
+
+  if (profiling_parse)
+    profile_parse_expand (1);
+  /* End with a second nul: func_sort steps over the character after each
+     word, the nul after the last one too, and then reads the next.  */
+  variable_buffer_output (run_expansion (initialize_variable_output (), exp),
+                          "\0", 2);
+  if (profiling_parse)
+    profile_parse_expand (0);
+  value = variable_buffer;
+
+  variable_buffer = obuf;
+  variable_buffer_length = olen;
+
+  return value;
+}
+
+/* Values that are used for a while and given back in the reverse order,
+   such as the arguments of a function call, are expanded into a stack of
+   buffers.  A buffer is kept when its value is given back, so that the
+   next value expanded at that depth reuses it instead of asking for a new
+   one.  */
+
+struct stacked_buffer
+  {
+    char *buffer;
+    unsigned int length;
+  };
+
+static struct stacked_buffer *stacked_buffers;
+static unsigned int stacked_buffers_size;
+static unsigned int stacked_depth;
+
+/* Buffers bigger than this are freed rather than kept.  */
+#define STACKED_BUFFER_MAX 65536
+
+/* Like allocated_expansion, but the value lives in the stack of buffers,
+   until release_stacked_values gives it back.  */
+
+char *
+stacked_expansion (struct expansion *exp)
+{
+  struct stacked_buffer *sb;
+  char *obuf = variable_buffer;
+  unsigned int olen = variable_buffer_length;
+
+  if (stacked_depth == stacked_buffers_size)
+    {
+      unsigned int i = stacked_buffers_size;
+
+      stacked_buffers_size = i ? 2 * i : 16;
+      stacked_buffers = xrealloc (stacked_buffers, stacked_buffers_size
+                                                   * sizeof (*stacked_buffers));
+      for (; i < stacked_buffers_size; ++i)
+        stacked_buffers[i].buffer = 0;
+    }
+
+  /* Take the buffer at this depth before expanding: EXP may need the
+     depths above it.  */
+  sb = &stacked_buffers[stacked_depth++];
+  variable_buffer = sb->buffer;
+  variable_buffer_length = sb->length;
+  sb->buffer = 0;
+
+  variable_buffer_output (run_expansion (initialize_variable_output (), exp),
+                          "\0", 2);
+
+  /* The stack may have moved.  */
+  sb = &stacked_buffers[stacked_depth - 1];
+  sb->buffer = variable_buffer;
+  sb->length = variable_buffer_length;
+
+  variable_buffer = obuf;
+  variable_buffer_length = olen;
+
+  return sb->buffer;
+}
+
+/* Return how many values are in the stack of buffers.  */
+
+unsigned int
+stacked_values (void)
+{
+  return stacked_depth;
+}
+
+/* Give back the values in the stack of buffers above the first COUNT.  */
+
+void
+release_stacked_values (unsigned int count)
+{
+  while (stacked_depth > count)
+    {
+      struct stacked_buffer *sb = &stacked_buffers[--stacked_depth];
+
+      if (sb->length > STACKED_BUFFER_MAX)
+        {
+          free (sb->buffer);
+          sb->buffer = 0;
+        }
+    }
+}
+
+/* Give up a reference to EXP, freeing it if that was the last.  */
+
+void
+release_expansion (struct expansion *exp)
+{
+  unsigned int i;
+
+  if (--exp->refs > 0)
+    return;
+
+  for (i = 0; i < exp->count; ++i)
+    switch (exp->ops[i].opcode)
+      {
+      case eo_substitution:
+        free (exp->ops[i].u.subst.buf);
+        break;
+      case eo_computed:
+        release_expansion (exp->ops[i].u.name);
+        break;
+      case eo_function:
+        free_function_call (exp->ops[i].u.call);
+        break;
+      default:
+        break;
+      }
+
+  free (exp->ops);
+  free (exp->text);
+  free (exp);
+}
+
+/* Forget the compiled value of V, which is about to change.  */
+
+void
+forget_expansion (struct variable *v)
+{
+  if (v->expansion)
+    {
+      release_expansion (v->expansion);
+      v->expansion = 0;
+    }
+  v->expanded = 0;
+  v->frozen = 0;
+}
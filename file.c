@@ -202,6 +202,51 @@ enter_file (const char *name)
 
   return new;
 }
+
+/* Return the file record for prerequisite NAME, creating it if there is
+   none.  This is lookup_file followed by enter_file when that fails, but
+   names parse_file_seq cleaned up take only one hash table lookup.  */
+
+static struct file *
+enter_prereq_file (const char *name)
+{
+  struct file *f;
+
+#ifndef VMS
+  if (name[0] != '.'
+# ifdef HAVE_DOS_PATHS
+      || (name[1] != '/' && name[1] != '\\')
+# else
+      || name[1] != '/'
+# endif
+     )
+    {
+      struct file **file_slot;
+      struct file file_key;
+
+      assert (*name != '\0');
+      assert (! verify_flag || strcache_iscached (name));
+
+      file_key.hname = name;
+      file_slot = (struct file **) hash_find_slot (&files, &file_key);
+      f = *file_slot;
+      if (! HASH_VACANT (f))
+        return f;
+
+      f = xcalloc (sizeof (struct file));
+      f->name = f->hname = name;
+      f->update_status = us_none;
+      f->last = f;
+      hash_insert_at (&files, f, file_slot);
+      return f;
+    }
+#endif
+
+  f = lookup_file (name);
+  if (f == 0)
+    f = enter_file (name);
+  return f;
+}
 
 /* Rehash FILE to NAME.  This is not as simple as resetting
    the 'hname' member, since it must be put in a new hash bucket,
@@ -534,9 +579,7 @@ enter_prereqs (struct dep *deps, const char *stem)
       if (d1->need_2nd_expansion)
         continue;
 
-      d1->file = lookup_file (d1->name);
-      if (d1->file == 0)
-        d1->file = enter_file (d1->name);
+      d1->file = enter_prereq_file (d1->name);
       d1->staticpattern = 0;
       d1->name = 0;
     }
@@ -1285,4 +1328,12 @@ init_hash_files (void)
   hash_init (&files, 1000, file_hash_1, file_hash_2, file_hash_cmp);
 }
 
+/* Call MAP with ARG for each file in the data base.  */
+
+void
+map_files (hash_map_arg_func_t map, void *arg)
+{
+  hash_map_arg (&files, map, arg);
+}
+
 /* EOF */
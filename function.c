@@ -23,6 +23,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "debug.h"
 #include "debugger/cmd.h"
+#include "shellcache.h"
 
 #ifdef _AMIGA
 #include "amiga.h"
@@ -41,6 +42,7 @@ struct function_table_entry
     unsigned char maximum_args;
     unsigned char expand_args:1;
     unsigned char alloc_fn:1;
+    unsigned char pure:1;       /* Result depends only on args and variables.  */
   };
 
 static unsigned long
@@ -93,6 +95,26 @@ subst_expand (char *o, const char *text, const char *subst, const char *replace,
       return o;
     }
 
+  if (!by_word && slen >= rlen)
+    {
+      /* The result is no longer than TEXT, so make room for all of it at
+         once and copy the pieces straight in.  The C library's searches
+         are already vectorized, and strchr is the faster of the two.  */
+      const char *end = t + strlen (t);
+
+      o = variable_buffer_reserve (o, end - t);
+      while ((p = (slen == 1 ? strchr (t, *subst) : strstr (t, subst))) != 0)
+        {
+          memcpy (o, t, p - t);
+          o += p - t;
+          memcpy (o, replace, rlen);
+          o += rlen;
+          t = p + slen;
+        }
+      memcpy (o, t, end - t);
+      return o + (end - t);
+    }
+
   do
     {
       if (by_word && slen == 0)
@@ -134,6 +156,93 @@ subst_expand (char *o, const char *text, const char *subst, const char *replace,
 }
 
 
+/* Return nonzero if the words of TEXT are separated by single spaces, with
+   none before or after them, so they are already as patsubst would write
+   them out.  */
+
+static int
+single_spaced (const char *text, unsigned int len)
+{
+  return (len > 0 && !isblank ((unsigned char) text[0])
+          && !isblank ((unsigned char) text[len - 1])
+          && memchr (text, '\t', len) == 0 && strstr (text, "  ") == 0);
+}
+
+/* Subroutine of patsubst_expand_pat for a pattern with a suffix and
+   single_spaced TEXT.  Rather than split TEXT into words, look for the
+   suffix of the pattern, which is no less than the rest of the pattern
+   since it has no blanks, and find the word around the places it ends
+   one.  Everything between the words that are replaced is copied as it
+   is.  The replacement must not be empty, as a word replaced by nothing
+   takes its space with it.  */
+
+static char *
+patsubst_by_suffix (char *o, const char *text, unsigned int len,
+                    const char *pattern, const char *pattern_percent,
+                    unsigned int pattern_prepercent_len,
+                    unsigned int pattern_postpercent_len,
+                    const char *replace, const char *replace_percent,
+                    unsigned int replace_prepercent_len,
+                    unsigned int replace_postpercent_len)
+{
+  const char *end = text + len;
+  const char *t = text;
+  const char *s = text;
+  const char *p;
+
+  while ((p = strstr (s, pattern_percent)) != 0)
+    {
+      const char *w;
+      unsigned int stemlen;
+
+      /* Only a suffix at the end of a word counts.  */
+      s = p + 1;
+      if (p[pattern_postpercent_len] != ' '
+          && p[pattern_postpercent_len] != '\0')
+        continue;
+      s = p + pattern_postpercent_len;
+
+      /* With nothing before the % in either, the stem runs on from what
+         is copied, and there is no need to look for the word's start.  */
+      if (pattern_prepercent_len == 0 && replace_prepercent_len == 0
+          && replace_percent != 0)
+        {
+          o = variable_buffer_reserve (o, (p - t) + replace_postpercent_len);
+          memcpy (o, t, p - t);
+          o += p - t;
+          memcpy (o, replace_percent, replace_postpercent_len);
+          o += replace_postpercent_len;
+          t = s;
+          continue;
+        }
+
+      w = p;
+      while (w > t && w[-1] != ' ')
+        --w;
+      if (p - w < pattern_prepercent_len
+          || !strneq (w, pattern, pattern_prepercent_len))
+        continue;
+      stemlen = p - w - pattern_prepercent_len;
+
+      o = variable_buffer_reserve (o, (w - t) + replace_prepercent_len
+                                   + stemlen + replace_postpercent_len);
+      memcpy (o, t, w - t);
+      o += w - t;
+      memcpy (o, replace, replace_prepercent_len);
+      o += replace_prepercent_len;
+      if (replace_percent != 0)
+        {
+          memcpy (o, w + pattern_prepercent_len, stemlen);
+          o += stemlen;
+          memcpy (o, replace_percent, replace_postpercent_len);
+          o += replace_postpercent_len;
+        }
+      t = s;
+    }
+
+  return variable_buffer_output (o, t, end - t);
+}
+
 /* Store into VARIABLE_BUFFER at O the result of scanning TEXT
    and replacing strings matching PATTERN with REPLACE.
    If PATTERN_PERCENT is not nil, PATTERN has already been
@@ -178,6 +287,21 @@ patsubst_expand_pat (char *o, const char *text,
   pattern_prepercent_len = pattern_percent - pattern - 1;
   pattern_postpercent_len = strlen (pattern_percent);
 
+  /* Lists like $(SRCS:.c=.o) are usually single spaced already.  */
+  if (pattern_postpercent_len > 0
+      && (replace_percent != 0 || replace_prepercent_len > 0)
+      && strpbrk (pattern, " \t") == 0)
+    {
+      len = strlen (text);
+      if (single_spaced (text, len))
+        return patsubst_by_suffix (o, text, len, pattern, pattern_percent,
+                                   pattern_prepercent_len,
+                                   pattern_postpercent_len,
+                                   replace, replace_percent,
+                                   replace_prepercent_len,
+                                   replace_postpercent_len);
+    }
+
   while ((t = find_next_token (&text, &len)) != 0)
     {
       int fail = 0;
@@ -894,60 +1018,125 @@ func_foreach (char *o, char **argv, const char *funcname UNUSED)
 
 struct a_word
 {
-  struct a_word *next;
-  struct a_word *chain;
   char *str;
   int length;
   int matched;
 };
 
+struct a_pattern
+{
+  struct a_pattern *next;
+  struct a_pattern *chain;      /* Next pattern with the same key.  */
+  char *str;
+  char *percent;
+  int length;
+  const char *key;              /* What the pattern is looked up by.  */
+  int keylen;
+};
+
+/* The patterns of a filter, grouped so that a word is looked up rather
+   than matched against each pattern in turn.  A literal pattern is found
+   by the whole word.  A pattern with a suffix is found by the last bytes
+   of the word, among the patterns whose suffixes are that long, and one
+   with only a prefix by the first bytes of the word.  */
+
+struct a_pattern_group
+{
+  struct a_pattern_group *next;
+  int suffix;                   /* Nonzero if keyed on the suffix.  */
+  int length;                   /* How many bytes the keys are.  */
+  struct hash_table table;
+};
+
 static unsigned long
-a_word_hash_1 (const void *key)
+a_pattern_hash_1 (const void *key)
 {
-  return_STRING_HASH_1 (((struct a_word const *) key)->str);
+  struct a_pattern const *pat = key;
+  return_STRING_N_HASH_1 (pat->key, pat->keylen);
 }
 
 static unsigned long
-a_word_hash_2 (const void *key)
+a_pattern_hash_2 (const void *key)
 {
-  return_STRING_HASH_2 (((struct a_word const *) key)->str);
+  struct a_pattern const *pat = key;
+  return_STRING_N_HASH_2 (pat->key, pat->keylen);
 }
 
 static int
-a_word_hash_cmp (const void *x, const void *y)
+a_pattern_hash_cmp (const void *x, const void *y)
 {
-  int result = ((struct a_word const *) x)->length - ((struct a_word const *) y)->length;
+  struct a_pattern const *px = x;
+  struct a_pattern const *py = y;
+  int result = px->keylen - py->keylen;
   if (result)
     return result;
-  return_STRING_COMPARE (((struct a_word const *) x)->str,
-                         ((struct a_word const *) y)->str);
+  return memcmp (px->key, py->key, px->keylen);
 }
 
-struct a_pattern
+/* Add PAT to TABLE, after any pattern already there with the same key.  */
+
+static void
+a_pattern_insert (struct hash_table *table, struct a_pattern *pat)
 {
-  struct a_pattern *next;
-  char *str;
-  char *percent;
-  int length;
-};
+  struct a_pattern **slot = (struct a_pattern **) hash_find_slot (table, pat);
+
+  if (HASH_VACANT (*slot))
+    hash_insert_at (table, pat, slot);
+  else
+    {
+      struct a_pattern *pp = *slot;
+      while (pp->chain)
+        pp = pp->chain;
+      pp->chain = pat;
+    }
+}
+
+/* Return nonzero if WORD, of LENGTH bytes, matches one of the patterns in
+   GROUP.  */
+
+static int
+a_pattern_group_matches (struct a_pattern_group *group,
+                         const char *word, int length)
+{
+  struct a_pattern key;
+  struct a_pattern *pp;
+
+  key.key = group->suffix ? word + length - group->length : word;
+  key.keylen = group->length;
+  for (pp = hash_find_item (&group->table, &key); pp != 0; pp = pp->chain)
+    {
+      int pfxlen = pp->percent - pp->str;
+
+      if (!group->suffix)
+        return 1;
+      if (pfxlen + group->length <= length && strneq (pp->str, word, pfxlen))
+        return 1;
+    }
+
+  return 0;
+}
 
 static char *
 func_filter_filterout (char *o, char **argv, const char *funcname)
 {
-  struct a_word *wordhead;
-  struct a_word **wordtail;
+  struct a_word *words;
   struct a_word *wp;
   struct a_pattern *pathead;
   struct a_pattern **pattail;
   struct a_pattern *pp;
+  struct a_pattern_group *groups = 0;
+  struct a_pattern_group *gp;
 
-  struct hash_table a_word_table;
+  struct hash_table a_literal_table;
   int is_filter = funcname[CSTRLEN ("filter")] == '\0';
   const char *pat_iterator = argv[0];
   const char *word_iterator = argv[1];
+  int patterns = 0;
   int literals = 0;
-  int words = 0;
-  int hashing = 0;
+  int match_all = 0;
+  int wordi = 0;
+  int size;
+  int compiled;
   char *p;
   unsigned int len;
 
@@ -969,8 +1158,10 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
       pat->str = p;
       p[len] = '\0';
       pat->percent = find_percent (p);
+      pat->chain = 0;
       if (pat->percent == 0)
         literals++;
+      patterns++;
 
       /* find_percent() might shorten the string so LEN is wrong.  */
       pat->length = strlen (pat->str);
@@ -979,73 +1170,122 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
 
   /* Chop ARGV[1] up into words to match against the patterns.  */
 
-  wordtail = &wordhead;
+  size = 64;
+  words = xmalloc (size * sizeof (struct a_word));
   while ((p = find_next_token (&word_iterator, &len)) != 0)
     {
-      struct a_word *word = alloca (sizeof (struct a_word));
-
-      *wordtail = word;
-      wordtail = &word->next;
+      if (wordi == size)
+        {
+          size *= 2;
+          words = xrealloc (words, size * sizeof (struct a_word));
+        }
 
       if (*word_iterator != '\0')
         ++word_iterator;
 
       p[len] = '\0';
-      word->str = p;
-      word->length = len;
-      word->matched = 0;
-      word->chain = 0;
-      words++;
+      words[wordi].str = p;
+      words[wordi].length = len;
+      words[wordi].matched = 0;
+      wordi++;
     }
-  *wordtail = 0;
 
-  /* Only use a hash table if arg list lengths justifies the cost.  */
-  hashing = (literals >= 2 && (literals * words) >= 10);
-  if (hashing)
+  /* Only compile the patterns if arg list lengths justifies the cost.  */
+  compiled = (patterns >= 2 && (patterns * wordi) >= 10);
+  if (compiled)
     {
-      hash_init (&a_word_table, words, a_word_hash_1, a_word_hash_2,
-                 a_word_hash_cmp);
-      for (wp = wordhead; wp != 0; wp = wp->next)
-        {
-          struct a_word *owp = hash_insert (&a_word_table, wp);
-          if (owp)
-            wp->chain = owp;
-        }
-    }
-
-  if (words)
-    {
-      int doneany = 0;
+      if (literals)
+        hash_init (&a_literal_table, literals, a_pattern_hash_1,
+                   a_pattern_hash_2, a_pattern_hash_cmp);
 
-      /* Run each pattern through the words, killing words.  */
       for (pp = pathead; pp != 0; pp = pp->next)
         {
-          if (pp->percent)
-            for (wp = wordhead; wp != 0; wp = wp->next)
-              wp->matched |= pattern_matches (pp->str, pp->percent, wp->str);
-          else if (hashing)
+          int suffix;
+
+          if (pp->percent == 0)
             {
-              struct a_word a_word_key;
-              a_word_key.str = pp->str;
-              a_word_key.length = pp->length;
-              wp = hash_find_item (&a_word_table, &a_word_key);
-              while (wp)
-                {
-                  wp->matched |= 1;
-                  wp = wp->chain;
-                }
+              pp->key = pp->str;
+              pp->keylen = pp->length;
+              a_pattern_insert (&a_literal_table, pp);
+              continue;
+            }
+
+          suffix = pp->percent[1] != '\0';
+          if (suffix)
+            {
+              pp->key = pp->percent + 1;
+              pp->keylen = strlen (pp->key);
             }
           else
-            for (wp = wordhead; wp != 0; wp = wp->next)
-              wp->matched |= (wp->length == pp->length
-                              && strneq (pp->str, wp->str, wp->length));
+            {
+              pp->key = pp->str;
+              pp->keylen = pp->percent - pp->str;
+            }
+
+          /* A lone % matches every word.  */
+          if (pp->keylen == 0)
+            {
+              match_all = 1;
+              continue;
+            }
+
+          for (gp = groups; gp != 0; gp = gp->next)
+            if (gp->suffix == suffix && gp->length == pp->keylen)
+              break;
+          if (gp == 0)
+            {
+              gp = xmalloc (sizeof (struct a_pattern_group));
+              gp->next = groups;
+              gp->suffix = suffix;
+              gp->length = pp->keylen;
+              hash_init (&gp->table, 16, a_pattern_hash_1, a_pattern_hash_2,
+                         a_pattern_hash_cmp);
+              groups = gp;
+            }
+          a_pattern_insert (&gp->table, pp);
         }
+    }
+
+  if (wordi)
+    {
+      int doneany = 0;
+
+      if (compiled)
+        /* Look each word up in the patterns.  */
+        for (wp = words; wp < words + wordi; ++wp)
+          {
+            if (match_all)
+              wp->matched = 1;
+            else if (literals)
+              {
+                struct a_pattern key;
+                key.key = wp->str;
+                key.keylen = wp->length;
+                wp->matched = hash_find_item (&a_literal_table, &key) != 0;
+              }
+            for (gp = groups; gp != 0 && !wp->matched; gp = gp->next)
+              if (gp->length <= wp->length)
+                wp->matched = a_pattern_group_matches (gp, wp->str,
+                                                       wp->length);
+          }
+      else
+        /* Run each pattern through the words, killing words.  */
+        for (pp = pathead; pp != 0; pp = pp->next)
+          {
+            if (pp->percent)
+              for (wp = words; wp < words + wordi; ++wp)
+                wp->matched |= pattern_matches (pp->str, pp->percent, wp->str);
+            else
+              for (wp = words; wp < words + wordi; ++wp)
+                wp->matched |= (wp->length == pp->length
+                                && strneq (pp->str, wp->str, wp->length));
+          }
 
       /* Output the words that matched (or didn't, for filter-out).  */
-      for (wp = wordhead; wp != 0; wp = wp->next)
+      for (wp = words; wp < words + wordi; ++wp)
         if (is_filter ? wp->matched : !wp->matched)
           {
-            o = variable_buffer_output (o, wp->str, strlen (wp->str));
+            o = variable_buffer_output (o, wp->str, wp->length);
             o = variable_buffer_output (o, " ", 1);
             doneany = 1;
           }
@@ -1055,8 +1295,20 @@ func_filter_filterout (char *o, char **argv, const char *funcname)
         --o;
     }
 
-  if (hashing)
-    hash_free (&a_word_table, 0);
+  if (compiled)
+    {
+      if (literals)
+        hash_free (&a_literal_table, 0);
+      while (groups)
+        {
+          gp = groups->next;
+          hash_free (&groups->table, 0);
+          free (groups);
+          groups = gp;
+        }
+    }
+
+  free (words);
 
   return o;
 }
@@ -1142,6 +1394,157 @@ func_error (char *o, char **argv, const char *funcname)
 }
 
 
+/* A word being sorted by func_sort.  */
+
+struct sort_word
+  {
+    const char *text;           /* Ends in a nul.  */
+    unsigned int length;
+    uintmax_t key;              /* The bytes being sorted on; see below.  */
+  };
+
+/* Below this many words, sort_words does an insertion sort.  */
+#define SORT_INSERTION_MAX      12
+
+/* How many bytes of a word are sorted on at a time.  */
+#define SORT_CHUNK              sizeof (uintmax_t)
+
+/* Set the key of W to the SORT_CHUNK bytes at DEPTH, first byte highest
+   and padded with zeros, which no word contains, so that keys order words
+   as alpha_compare does.  That compares the first byte of each word as a
+   char, so the first byte is mapped to keep that order.  */
+
+static void
+set_sort_key (struct sort_word *w, unsigned int depth)
+{
+  const unsigned char *s = (const unsigned char *) w->text + depth;
+  unsigned int n = w->length > depth ? w->length - depth : 0;
+  uintmax_t key = 0;
+  unsigned int i;
+
+  if (n > SORT_CHUNK)
+    n = SORT_CHUNK;
+  for (i = 0; i < n; ++i)
+    key = key << CHAR_BIT | s[i];
+  if (n < SORT_CHUNK)
+    key <<= CHAR_BIT * (SORT_CHUNK - n);
+  if (depth == 0 && n > 0)
+    {
+      uintmax_t top = (uintmax_t) ((char) s[0] - CHAR_MIN);
+      unsigned int shift = CHAR_BIT * (SORT_CHUNK - 1);
+      key = (key & ~((uintmax_t) UCHAR_MAX << shift)) | top << shift;
+    }
+  w->key = key;
+}
+
+/* Compare the words A and B, whose first DEPTH bytes are the same and
+   whose keys are for DEPTH.  */
+
+static int
+sort_word_compare (const struct sort_word *a, const struct sort_word *b,
+                   unsigned int depth)
+{
+  if (a->key != b->key)
+    return a->key < b->key ? -1 : 1;
+  /* Words with the same key end within it together, or not at all.  */
+  if (a->length < depth + SORT_CHUNK)
+    return 0;
+  return strcmp (a->text + depth + SORT_CHUNK, b->text + depth + SORT_CHUNK);
+}
+
+/* Sort the N words at W, whose first DEPTH bytes are all the same and
+   whose keys are set for DEPTH, into the order qsort with alpha_compare
+   gives.  This is a multikey quicksort: it partitions on SORT_CHUNK bytes
+   at a time, kept next to the word, so it doesn't go back to compare the
+   long prefixes that words like file names share again and again.  The
+   two smaller of the three partitions are sorted by recursion, so it goes
+   no deeper than the log of N.  */
+
+static void
+sort_words (struct sort_word *w, unsigned int n, unsigned int depth)
+{
+  unsigned int i;
+
+  while (n > SORT_INSERTION_MAX)
+    {
+      struct sort_word t;
+      unsigned int lt, gt, nl, ne, ng;
+      uintmax_t a, b, c, pivot;
+
+      a = w[0].key;
+      b = w[n / 2].key;
+      c = w[n - 1].key;
+      pivot = (a < b ? (b < c ? b : a < c ? c : a)
+               : (a < c ? a : b < c ? c : b));
+
+      /* Put the words below the pivot in [0,LT), those equal to it in
+         [LT,GT) and those above it in [GT,N).  */
+      lt = i = 0;
+      gt = n;
+      while (i < gt)
+        {
+          if (w[i].key < pivot)
+            {
+              t = w[lt];
+              w[lt++] = w[i];
+              w[i++] = t;
+            }
+          else if (w[i].key > pivot)
+            {
+              t = w[--gt];
+              w[gt] = w[i];
+              w[i] = t;
+            }
+          else
+            ++i;
+        }
+
+      nl = lt;
+      ng = n - gt;
+      ne = gt - lt;
+
+      /* Words that end within the pivot are all the same.  Move the
+         others on to their next bytes; a word that ends just after the
+         pivot gets a key of zero there, ahead of the longer ones.  */
+      if (w[lt].length < depth + SORT_CHUNK)
+        ne = 0;
+      for (i = lt; i < lt + ne; ++i)
+        set_sort_key (&w[i], depth + SORT_CHUNK);
+
+      if (nl >= ne && nl >= ng)
+        {
+          sort_words (w + lt, ne, depth + SORT_CHUNK);
+          sort_words (w + gt, ng, depth);
+          n = nl;
+        }
+      else if (ng >= ne)
+        {
+          sort_words (w, nl, depth);
+          sort_words (w + lt, ne, depth + SORT_CHUNK);
+          w += gt;
+          n = ng;
+        }
+      else
+        {
+          sort_words (w, nl, depth);
+          sort_words (w + gt, ng, depth);
+          w += lt;
+          n = ne;
+          depth += SORT_CHUNK;
+        }
+    }
+
+  for (i = 1; i < n; ++i)
+    {
+      struct sort_word t = w[i];
+      unsigned int j;
+
+      for (j = i; j > 0 && sort_word_compare (&w[j - 1], &t, depth) > 0; --j)
+        w[j] = w[j - 1];
+      w[j] = t;
+    }
+}
+
 /*
   chop argv[0] into words, and sort them.
  */
@@ -1149,50 +1552,48 @@ static char *
 func_sort (char *o, char **argv, const char *funcname UNUSED)
 {
   const char *t;
-  char **words;
-  int wordi;
+  struct sort_word *words;
+  unsigned int wordi;
+  unsigned int size;
   char *p;
   unsigned int len;
 
-  /* Find the maximum number of words we'll have.  */
-  t = argv[0];
-  wordi = 0;
-  while ((p = find_next_token (&t, NULL)) != 0)
-    {
-      ++t;
-      ++wordi;
-    }
-
-  words = xmalloc ((wordi == 0 ? 1 : wordi) * sizeof (char *));
+  size = 64;
+  words = xmalloc (size * sizeof (struct sort_word));
 
-  /* Now assign pointers to each string in the array.  */
+  /* Find each word and terminate it.  */
   t = argv[0];
   wordi = 0;
   while ((p = find_next_token (&t, &len)) != 0)
     {
+      if (wordi == size)
+        {
+          size *= 2;
+          words = xrealloc (words, size * sizeof (struct sort_word));
+        }
       ++t;
       p[len] = '\0';
-      words[wordi++] = p;
+      words[wordi].text = p;
+      words[wordi].length = len;
+      set_sort_key (&words[wordi], 0);
+      ++wordi;
     }
 
   if (wordi)
     {
-      int i;
+      unsigned int i;
 
       /* Now sort the list of words.  */
-      qsort (words, wordi, sizeof (char *), alpha_compare);
+      sort_words (words, wordi, 0);
 
       /* Now write the sorted list, uniquified.  */
       for (i = 0; i < wordi; ++i)
-        {
-          len = strlen (words[i]);
-          if (i == wordi - 1 || strlen (words[i + 1]) != len
-              || strcmp (words[i], words[i + 1]))
-            {
-              o = variable_buffer_output (o, words[i], len);
-              o = variable_buffer_output (o, " ", 1);
-            }
-        }
+        if (i == wordi - 1 || words[i + 1].length != words[i].length
+            || memcmp (words[i].text, words[i + 1].text, words[i].length))
+          {
+            o = variable_buffer_output (o, words[i].text, words[i].length);
+            o = variable_buffer_output (o, " ", 1);
+          }
 
       /* Kill the last space.  */
       --o;
@@ -1465,6 +1866,10 @@ fold_newlines (char *buffer, unsigned int *length, int trim_newlines)
 
 int shell_function_pid = 0, shell_function_completed;
 
+/* Nonzero if the child of the last 'shell' function exited with a
+   nonzero status or was killed.  */
+int shell_function_failed;
+
 
 #ifdef WINDOWS32
 /*untested*/
@@ -1657,6 +2062,368 @@ msdos_openpipe (int* pipedes, int *pidp, char *text)
 }
 #endif
 
+#if !defined(VMS) && !defined(_AMIGA) && !defined(__MSDOS__) \
+    && !defined(WINDOWS32) && !defined(__EMX__) && defined(HAVE_WAITPID)
+# define SHELL_COPROCESS 1
+# include <sys/wait.h>
+#endif
+
+#ifdef SHELL_COPROCESS
+
+/* With --persistent-shell, $(shell ...) commands run in a shell that make
+   starts once and keeps, rather than in a new one each time.  Each command
+   is sent to it on a pipe to run in a subshell, with make's stdin, and is
+   followed by a line that prints a marker and its exit status on the same
+   pipe as its output; make reads up to the marker.  This is only done when
+   the new shell would have been the default one with the default flags,
+   in make's environment, and its errors would have gone to make's own
+   stderr; otherwise, or if the shell can't be started, the command runs
+   as usual.  */
+
+extern const char *default_shell;
+
+static pid_t shell_coprocess_pid = 0;
+static int shell_coprocess_in = -1;     /* Commands are written to this.  */
+static int shell_coprocess_out = -1;    /* Their output is read from this.  */
+static char **shell_coprocess_environ;  /* Copy of the environment it got.  */
+static unsigned long shell_coprocess_commands;
+
+/* Stop the shell coprocess, if there is one.  */
+
+static void
+stop_shell_coprocess (void)
+{
+  char **ep;
+  pid_t pid;
+  int status;
+
+  if (shell_coprocess_pid == 0)
+    return;
+
+  close (shell_coprocess_in);
+  close (shell_coprocess_out);
+  EINTRLOOP (pid, waitpid (shell_coprocess_pid, &status, 0));
+  shell_coprocess_pid = 0;
+
+  for (ep = shell_coprocess_environ; *ep != 0; ++ep)
+    free (*ep);
+  free (shell_coprocess_environ);
+  shell_coprocess_environ = 0;
+}
+
+/* Return nonzero if make's environment is still the one the shell
+   coprocess was started with.  */
+
+static int
+shell_coprocess_environ_current (void)
+{
+  char **ep, **cp;
+
+  for (ep = environ, cp = shell_coprocess_environ; *ep != 0; ++ep, ++cp)
+    if (*cp == 0 || !streq (*ep, *cp))
+      return 0;
+
+  return *cp == 0;
+}
+
+/* Start the shell coprocess.  Return nonzero if it is running.  */
+
+static int
+start_shell_coprocess (void)
+{
+  int in[2], out[2];
+  pid_t pid;
+  unsigned int i;
+
+  /* Commands get make's stdin, so it has to be open.  */
+  if (fcntl (FD_STDIN, F_GETFD) < 0)
+    return 0;
+
+  if (pipe (in) < 0)
+    return 0;
+  if (pipe (out) < 0)
+    {
+      close (in[0]);
+      close (in[1]);
+      return 0;
+    }
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Move everything out of the way before putting the pipes at 0 and
+         1 and a copy of make's stdin at 3, where the commands find it.  */
+      char *argv[2];
+      int cmd = fcntl (in[0], F_DUPFD, 10);
+      int res = fcntl (out[1], F_DUPFD, 10);
+      int std = fcntl (FD_STDIN, F_DUPFD, 10);
+
+#ifdef SET_STACK_SIZE
+      if (stack_limit.rlim_cur)
+        setrlimit (RLIMIT_STACK, &stack_limit);
+#endif
+      close (in[0]);
+      close (in[1]);
+      close (out[0]);
+      close (out[1]);
+
+      /* Don't keep the jobserver pipe open for as long as make runs, or
+         make can't tell when all its tokens have come back.  */
+      if (job_fds[0] >= 0)
+        {
+          close (job_fds[0]);
+          close (job_fds[1]);
+        }
+      if (job_rfd >= 0)
+        close (job_rfd);
+
+      if (cmd < 0 || res < 0 || std < 0
+          || dup2 (cmd, FD_STDIN) < 0 || dup2 (res, FD_STDOUT) < 0
+          || dup2 (std, 3) < 0)
+        _exit (127);
+      close (cmd);
+      close (res);
+      close (std);
+
+      argv[0] = (char *) default_shell;
+      argv[1] = 0;
+      execv (default_shell, argv);
+      _exit (127);
+    }
+
+  close (in[0]);
+  close (out[1]);
+  if (pid < 0)
+    {
+      close (in[1]);
+      close (out[0]);
+      return 0;
+    }
+
+  CLOSE_ON_EXEC (in[1]);
+  CLOSE_ON_EXEC (out[0]);
+  shell_coprocess_pid = pid;
+  shell_coprocess_in = in[1];
+  shell_coprocess_out = out[0];
+  for (i = 0; environ[i] != 0; ++i)
+    ;
+  shell_coprocess_environ = xmalloc ((i + 1) * sizeof (char *));
+  for (i = 0; environ[i] != 0; ++i)
+    shell_coprocess_environ[i] = xstrdup (environ[i]);
+  shell_coprocess_environ[i] = 0;
+  DB (DB_JOBS, (_("Started shell coprocess %s (pid %ld)\n"),
+                default_shell, (long) pid));
+  return 1;
+}
+
+/* Return nonzero if COMMAND may start a process in the background.  Make
+   reads the output of a new shell until every process that has it open
+   is gone, but only reads the coprocess up to its marker, so leave such
+   commands to a new shell.  The '&' of '&&' or of '>&' and '<&' is fine.  */
+
+static int
+shell_command_backgrounds (const char *command)
+{
+  const char *p;
+
+  for (p = strchr (command, '&'); p != 0; p = strchr (p + 1, '&'))
+    {
+      if (p[1] == '&')
+        ++p;
+      else if (p == command || (p[-1] != '>' && p[-1] != '<'))
+        return 1;
+    }
+
+  return 0;
+}
+
+/* Return nonzero if COMMAND may use the process ID of its shell, or of
+   the parent of that, which would be the same for every command run in
+   the coprocess.  */
+
+static int
+shell_command_uses_pid (const char *command)
+{
+  return strstr (command, "$$") != 0 || strstr (command, "PPID") != 0;
+}
+
+/* Return nonzero if COMMAND can be run in the coprocess.  */
+
+static int
+shell_coprocess_usable (const char *command)
+{
+  struct variable *v;
+  int save;
+  char *shell;
+  char *shellflags;
+  int usable;
+
+  if (output_context && output_context->err >= 0
+      && output_context->err != FD_STDERR)
+    return 0;
+
+  if (shell_command_backgrounds (command) || shell_command_uses_pid (command))
+    return 0;
+
+  /* The environment of $(shell ...) commands is make's own, which the
+     shell was started with.  */
+  if (shell_coprocess_pid != 0 && !shell_coprocess_environ_current ())
+    stop_shell_coprocess ();
+
+  /* Most makefiles don't set these, so don't expand them if they are
+     what make starts with.  */
+  v = lookup_variable (STRING_SIZE_TUPLE ("SHELL"));
+  if (v != 0 && v->recursive == 0 && streq (v->value, default_shell))
+    {
+      v = lookup_variable (STRING_SIZE_TUPLE (".SHELLFLAGS"));
+      if (v != 0 && v->recursive == 0 && streq (v->value, "-c"))
+        return 1;
+    }
+
+  save = warn_undefined_variables_flag;
+  warn_undefined_variables_flag = 0;
+  shell = allocated_variable_expand ("$(SHELL)");
+  shellflags = allocated_variable_expand ("$(.SHELLFLAGS)");
+  warn_undefined_variables_flag = save;
+  usable = streq (shell, default_shell) && streq (shellflags, "-c");
+  free (shell);
+  free (shellflags);
+  return usable;
+}
+
+/* Write the LENGTH bytes at BUF to the shell coprocess.  Return nonzero if
+   they were all written.  */
+
+static int
+write_shell_coprocess (const char *buf, unsigned int length)
+{
+  while (length > 0)
+    {
+      int cc;
+      EINTRLOOP (cc, write (shell_coprocess_in, buf, length));
+      if (cc <= 0)
+        return 0;
+      buf += cc;
+      length -= cc;
+    }
+  return 1;
+}
+
+/* Run COMMAND in the shell coprocess, starting it if need be, and put its
+   output, with newlines folded as TRIM_NEWLINES says, at O.  Set *DONE to
+   zero if the command couldn't be sent and has to be run as usual.  */
+
+static char *
+shell_coprocess_run (char *o, const char *command, int trim_newlines,
+                     int *done)
+{
+  char marker[64];
+  unsigned int mlen;
+  char *script;
+  char *p;
+  const char *c;
+  char *buffer;
+  unsigned int maxlen, i;
+  int status = 0;
+  int sent;
+#ifdef SIGPIPE
+  RETSIGTYPE (*sigpipe) (int);
+#endif
+
+  *done = 0;
+  if (shell_coprocess_pid == 0 && !start_shell_coprocess ())
+    return o;
+
+  mlen = sprintf (marker, "\n%c make-shell-%ld-%lu ", '\001',
+                  (long) shell_coprocess_pid, ++shell_coprocess_commands);
+
+  /* Quote the command for eval: each ' becomes '\''.  */
+  script = p = xmalloc (4 * strlen (command) + mlen + 64);
+  memcpy (p, STRING_SIZE_TUPLE ("( eval '"));
+  p += CSTRLEN ("( eval '");
+  for (c = command; *c != '\0'; ++c)
+    if (*c == '\'')
+      {
+        memcpy (p, STRING_SIZE_TUPLE ("'\\''"));
+        p += CSTRLEN ("'\\''");
+      }
+    else
+      *p++ = *c;
+  p += sprintf (p, "' ) 0<&3 3<&-\nprintf '%%s%%d\\n' '%s' $?\n", marker);
+
+#ifdef SIGPIPE
+  sigpipe = signal (SIGPIPE, SIG_IGN);
+#endif
+  sent = write_shell_coprocess (script, p - script);
+#ifdef SIGPIPE
+  signal (SIGPIPE, sigpipe);
+#endif
+  free (script);
+  if (!sent)
+    {
+      stop_shell_coprocess ();
+      return o;
+    }
+  *done = 1;
+
+  /* Read up to the marker, which ends what the shell writes.  */
+  maxlen = 200;
+  buffer = xmalloc (maxlen + 1);
+  for (i = 0; ; )
+    {
+      int cc;
+      char *m;
+
+      if (i == maxlen)
+        {
+          maxlen += maxlen / 2 + 512;
+          buffer = xrealloc (buffer, maxlen + 1);
+        }
+
+      EINTRLOOP (cc, read (shell_coprocess_out, &buffer[i], maxlen - i));
+      if (cc <= 0)
+        {
+          /* The shell went away.  */
+          stop_shell_coprocess ();
+          break;
+        }
+      i += cc;
+
+      /* The marker is the start of the last line.  */
+      if (buffer[i - 1] != '\n' || i <= mlen)
+        continue;
+      for (m = &buffer[i - 2]; m > buffer && *m != '\n'; --m)
+        ;
+      if ((unsigned int) (&buffer[i] - m) > mlen
+          && memcmp (m, marker, mlen) == 0)
+        {
+          status = atoi (m + mlen);
+          i = m - buffer;
+          break;
+        }
+    }
+  buffer[i] = '\0';
+
+  if (status == 127)
+    {
+      /* As with a new shell, this most likely means the command wasn't
+         found, and what it wrote is the message saying so.  */
+      fputs (buffer, stderr);
+      fflush (stderr);
+    }
+  else
+    {
+      shell_cache_store (buffer, i, status);
+      fold_newlines (buffer, &i, trim_newlines);
+      o = variable_buffer_output (o, buffer, i);
+    }
+
+  free (buffer);
+  return o;
+}
+
+#endif /* SHELL_COPROCESS */
+
 /*
   Do shell spawning, with the naughty bits for different OSes.
  */
@@ -1690,13 +2457,43 @@ func_shell_base (char *o, char **argv, int trim_newlines)
   char **envp;
   int pipedes[2];
   pid_t pid;
+  const char *cached;
+  unsigned int length;
+#ifdef WINDOWS32
+  int j_p_f;
+#endif
+
+  /* Use the output of an earlier run if .CACHE_SHELL allows it.  */
+  if (shell_cache_lookup (argv[0], &cached, &length))
+    {
+      char *buffer = xmalloc (length + 1);
+      memcpy (buffer, cached, length);
+      buffer[length] = '\0';
+      fold_newlines (buffer, &length, trim_newlines);
+      o = variable_buffer_output (o, buffer, length);
+      free (buffer);
+      return o;
+    }
+
+#ifdef SHELL_COPROCESS
+  if (persistent_shell_flag)
+    output_start ();
+  if (persistent_shell_flag && shell_coprocess_usable (argv[0]))
+    {
+      int done;
+
+      o = shell_coprocess_run (o, argv[0], trim_newlines, &done);
+      if (done)
+        return o;
+    }
+#endif
 
 #ifndef __MSDOS__
 #ifdef WINDOWS32
   /* Reset just_print_flag.  This is needed on Windows when batch files
      are used to run the commands, because we normally refrain from
      creating batch files under -n.  */
-  int j_p_f = just_print_flag;
+  j_p_f = just_print_flag;
   just_print_flag = 0;
 #endif
 
@@ -1803,6 +2600,7 @@ func_shell_base (char *o, char **argv, int trim_newlines)
       shell_function_pid = pid;
 #ifndef  __MSDOS__
       shell_function_completed = 0;
+      shell_function_failed = 0;
 
       /* Free the storage only the child needed.  */
       free (command_argv[0]);
@@ -1872,6 +2670,7 @@ func_shell_base (char *o, char **argv, int trim_newlines)
         {
           /* The child finished normally.  Replace all newlines in its output
              with spaces, and put that in the variable output buffer.  */
+          shell_cache_store (buffer, i, shell_function_failed);
           fold_newlines (buffer, &i, trim_newlines);
           o = variable_buffer_output (o, buffer, i);
         }
@@ -2100,8 +2899,7 @@ abspath (const char *name, char *apath)
         ++start;
 
       /* Find end of path component.  */
-      for (end = start; ! STOP_SET (*end, MAP_DIRSEP|MAP_NUL); ++end)
-        ;
+      end = scan_stopchar (start, MAP_DIRSEP|MAP_NUL);
 
       len = end - start;
 
@@ -2281,52 +3079,60 @@ func_abspath (char *o, char **argv, const char *funcname UNUSED)
 
 static char *func_call (char *o, char **argv, const char *funcname);
 
-#define FT_ENTRY(_name, _min, _max, _exp, _func) \
-  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), 0 }
+/* The number of calls to functions that aren't pure: they have some effect,
+   or look at something other than their arguments and variables.  */
+unsigned long impure_function_calls = 0;
+
+/* Bumped whenever a function is defined, so that calls compiled by
+   compile_function_call before then are compiled again.  */
+unsigned long function_table_changes = 0;
+
+#define FT_ENTRY(_name, _min, _max, _exp, _pure, _func) \
+  { { (_func) }, STRING_SIZE_TUPLE(_name), (_min), (_max), (_exp), 0, (_pure) }
 
 static struct function_table_entry function_table_init[] =
 {
- /*         Name            MIN MAX EXP? Function */
-  FT_ENTRY ("abspath",       0,  1,  1,  func_abspath),
-  FT_ENTRY ("addprefix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("addsuffix",     2,  2,  1,  func_addsuffix_addprefix),
-  FT_ENTRY ("basename",      0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("dir",           0,  1,  1,  func_basename_dir),
-  FT_ENTRY ("notdir",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("subst",         3,  3,  1,  func_subst),
-  FT_ENTRY ("suffix",        0,  1,  1,  func_notdir_suffix),
-  FT_ENTRY ("filter",        2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("filter-out",    2,  2,  1,  func_filter_filterout),
-  FT_ENTRY ("findstring",    2,  2,  1,  func_findstring),
-  FT_ENTRY ("firstword",     0,  1,  1,  func_firstword),
-  FT_ENTRY ("flavor",        0,  1,  1,  func_flavor),
-  FT_ENTRY ("join",          2,  2,  1,  func_join),
-  FT_ENTRY ("lastword",      0,  1,  1,  func_lastword),
-  FT_ENTRY ("patsubst",      3,  3,  1,  func_patsubst),
-  FT_ENTRY ("realpath",      0,  1,  1,  func_realpath),
-  FT_ENTRY ("shell",         0,  1,  1,  func_shell),
-  FT_ENTRY ("sort",          0,  1,  1,  func_sort),
-  FT_ENTRY ("strip",         0,  1,  1,  func_strip),
-  FT_ENTRY ("wildcard",      0,  1,  1,  func_wildcard),
-  FT_ENTRY ("word",          2,  2,  1,  func_word),
-  FT_ENTRY ("wordlist",      3,  3,  1,  func_wordlist),
-  FT_ENTRY ("words",         0,  1,  1,  func_words),
-  FT_ENTRY ("origin",        0,  1,  1,  func_origin),
-  FT_ENTRY ("foreach",       3,  3,  0,  func_foreach),
-  FT_ENTRY ("call",          1,  0,  1,  func_call),
-  FT_ENTRY ("info",          0,  1,  1,  func_error),
-  FT_ENTRY ("error",         0,  1,  1,  func_error),
-  FT_ENTRY ("warning",       0,  1,  1,  func_error),
-  FT_ENTRY ("if",            2,  3,  0,  func_if),
-  FT_ENTRY ("or",            1,  0,  0,  func_or),
-  FT_ENTRY ("and",           1,  0,  0,  func_and),
-  FT_ENTRY ("value",         0,  1,  1,  func_value),
-  FT_ENTRY ("eval",          0,  1,  1,  func_eval),
-  FT_ENTRY ("file",          1,  2,  1,  func_file),
-  FT_ENTRY ("debugger",      0,  1,  1,  func_debugger),
+ /*         Name            MIN MAX EXP? PURE? Function */
+  FT_ENTRY ("abspath",       0,  1,  1,  1,  func_abspath),
+  FT_ENTRY ("addprefix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("addsuffix",     2,  2,  1,  1,  func_addsuffix_addprefix),
+  FT_ENTRY ("basename",      0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("dir",           0,  1,  1,  1,  func_basename_dir),
+  FT_ENTRY ("notdir",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("subst",         3,  3,  1,  1,  func_subst),
+  FT_ENTRY ("suffix",        0,  1,  1,  1,  func_notdir_suffix),
+  FT_ENTRY ("filter",        2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("filter-out",    2,  2,  1,  1,  func_filter_filterout),
+  FT_ENTRY ("findstring",    2,  2,  1,  1,  func_findstring),
+  FT_ENTRY ("firstword",     0,  1,  1,  1,  func_firstword),
+  FT_ENTRY ("flavor",        0,  1,  1,  1,  func_flavor),
+  FT_ENTRY ("join",          2,  2,  1,  1,  func_join),
+  FT_ENTRY ("lastword",      0,  1,  1,  1,  func_lastword),
+  FT_ENTRY ("patsubst",      3,  3,  1,  1,  func_patsubst),
+  FT_ENTRY ("realpath",      0,  1,  1,  0,  func_realpath),
+  FT_ENTRY ("shell",         0,  1,  1,  0,  func_shell),
+  FT_ENTRY ("sort",          0,  1,  1,  1,  func_sort),
+  FT_ENTRY ("strip",         0,  1,  1,  1,  func_strip),
+  FT_ENTRY ("wildcard",      0,  1,  1,  0,  func_wildcard),
+  FT_ENTRY ("word",          2,  2,  1,  1,  func_word),
+  FT_ENTRY ("wordlist",      3,  3,  1,  1,  func_wordlist),
+  FT_ENTRY ("words",         0,  1,  1,  1,  func_words),
+  FT_ENTRY ("origin",        0,  1,  1,  1,  func_origin),
+  FT_ENTRY ("foreach",       3,  3,  0,  1,  func_foreach),
+  FT_ENTRY ("call",          1,  0,  1,  1,  func_call),
+  FT_ENTRY ("info",          0,  1,  1,  0,  func_error),
+  FT_ENTRY ("error",         0,  1,  1,  0,  func_error),
+  FT_ENTRY ("warning",       0,  1,  1,  0,  func_error),
+  FT_ENTRY ("if",            2,  3,  0,  1,  func_if),
+  FT_ENTRY ("or",            1,  0,  0,  1,  func_or),
+  FT_ENTRY ("and",           1,  0,  0,  1,  func_and),
+  FT_ENTRY ("value",         0,  1,  1,  1,  func_value),
+  FT_ENTRY ("eval",          0,  1,  1,  0,  func_eval),
+  FT_ENTRY ("file",          1,  2,  1,  0,  func_file),
+  FT_ENTRY ("debugger",      0,  1,  1,  0,  func_debugger),
 #ifdef EXPERIMENTAL
-  FT_ENTRY ("eq",            2,  2,  1,  func_eq),
-  FT_ENTRY ("not",           0,  1,  1,  func_not),
+  FT_ENTRY ("eq",            2,  2,  1,  1,  func_eq),
+  FT_ENTRY ("not",           0,  1,  1,  1,  func_not),
 #endif
 };
 
@@ -2357,6 +3163,9 @@ expand_builtin_function (char *o, int argc, char **argv,
     OS (fatal, *expanding_var,
         _("unimplemented on this platform: function '%s'"), entry_p->name);
 
+  if (!entry_p->pure)
+    ++impure_function_calls;
+
   if (!entry_p->alloc_fn)
     return entry_p->fptr.func_ptr (o, argv, entry_p->name);
 
@@ -2492,6 +3301,161 @@ handle_function (char **op, const char **stringp)
 }
 
 
+/* A function call found by compile_function_call, with its arguments split
+   up ahead of time.  */
+
+struct function_call
+  {
+    const struct function_table_entry *entry;
+    int nargs;
+    char *args;                 /* If the function does not expand its
+                                   arguments, them, each one nul-terminated.  */
+    unsigned int argslen;       /* Bytes in ARGS.  */
+    unsigned int *argoffs;      /* Where each argument starts in ARGS.  */
+    struct expansion **argexps; /* If it does, each argument compiled.  */
+  };
+
+/* Like handle_function, but rather than expanding a function invocation at
+   *STRINGP, split its arguments up into a new function_call and return it
+   in *CALLP, incrementing *STRINGP past the reference.  Return 1 if that was
+   done, 0 if there is no function invocation at *STRINGP and -1 if there is
+   one but it is not terminated (handle_function will report that).  */
+
+int
+compile_function_call (const char **stringp, struct function_call **callp)
+{
+  const struct function_table_entry *entry_p;
+  char openparen = (*stringp)[0];
+  char closeparen = openparen == '(' ? ')' : '}';
+  struct function_call *call;
+  const char *beg;
+  const char *end;
+  int count = 0;
+  int nargs;
+
+  entry_p = lookup_function (*stringp + 1);
+  if (!entry_p)
+    return 0;
+
+  beg = next_token (*stringp + 1 + entry_p->len);
+
+  for (nargs=1, end=beg; *end != '\0'; ++end)
+    if (*end == ',')
+      ++nargs;
+    else if (*end == openparen)
+      ++count;
+    else if (*end == closeparen && --count < 0)
+      break;
+
+  if (count >= 0)
+    return -1;
+
+  *stringp = end;
+
+  call = xcalloc (sizeof (struct function_call));
+  call->entry = entry_p;
+
+  /* Split the arguments just as handle_function does.  */
+
+  if (entry_p->expand_args)
+    {
+      const char *p;
+
+      call->argexps = xmalloc (sizeof (struct expansion *) * nargs);
+      for (p=beg, nargs=0; p <= end; ++nargs)
+        {
+          const char *next;
+
+          if (nargs + 1 == (int) entry_p->maximum_args
+              || (! (next = find_next_argument (openparen, closeparen,
+                                                p, end))))
+            next = end;
+
+          call->argexps[nargs] = compile_expansion (p, next - p);
+          p = next + 1;
+        }
+    }
+  else
+    {
+      char *p, *aend;
+
+      call->argslen = end - beg;
+      call->args = xmalloc (call->argslen + 1);
+      memcpy (call->args, beg, call->argslen);
+      call->args[call->argslen] = '\0';
+      aend = call->args + call->argslen;
+
+      call->argoffs = xmalloc (sizeof (unsigned int) * nargs);
+      for (p=call->args, nargs=0; p <= aend; ++nargs)
+        {
+          char *next;
+
+          if (nargs + 1 == (int) entry_p->maximum_args
+              || (! (next = find_next_argument (openparen, closeparen,
+                                                p, aend))))
+            next = aend;
+
+          call->argoffs[nargs] = p - call->args;
+          *next = '\0';
+          p = next + 1;
+        }
+    }
+
+  call->nargs = nargs;
+  *callp = call;
+  return 1;
+}
+
+/* Expand the function call CALL into the buffer at O, like handle_function.
+   Return the updated O.  */
+
+char *
+expand_function_call (char *o, const struct function_call *call)
+{
+  char **argv = alloca (sizeof (char *) * (call->nargs + 1));
+  unsigned int depth = stacked_values ();
+  char *abeg = 0;
+  int i;
+
+  if (call->entry->expand_args)
+    for (i = 0; i < call->nargs; ++i)
+      argv[i] = stacked_expansion (call->argexps[i]);
+  else
+    {
+      /* The function may write into its arguments.  */
+      abeg = xmalloc (call->argslen + 1);
+      memcpy (abeg, call->args, call->argslen + 1);
+      for (i = 0; i < call->nargs; ++i)
+        argv[i] = abeg + call->argoffs[i];
+    }
+  argv[call->nargs] = NULL;
+
+  o = expand_builtin_function (o, call->nargs, argv, call->entry);
+
+  if (call->entry->expand_args)
+    release_stacked_values (depth);
+  else
+    free (abeg);
+
+  return o;
+}
+
+/* Free CALL, which compile_function_call made.  */
+
+void
+free_function_call (struct function_call *call)
+{
+  int i;
+
+  if (call->argexps)
+    for (i = 0; i < call->nargs; ++i)
+      release_expansion (call->argexps[i]);
+  free (call->argexps);
+  free (call->argoffs);
+  free (call->args);
+  free (call);
+}
+
 /* User-defined functions.  Expand the first argument as either a builtin
    function or a make variable, in the context of the rest of the arguments
    assigned to $1, $2, ... $N.  $0 is the name of the function.  */
@@ -2629,9 +3593,15 @@ define_new_function (const gmk_floc *flocp, const char *name,
   ent->maximum_args = max;
   ent->expand_args = ANY_SET(flags, GMK_FUNC_NOEXPAND) ? 0 : 1;
   ent->alloc_fn = 1;
+  ent->pure = 0;
   ent->fptr.alloc_func_ptr = func;
 
   hash_insert (&function_table, ent);
+  ++function_table_changes;
+
+  /* Frozen variables may refer to a variable of this name.  */
+  if (freezing_variables)
+    thaw_variables ();
 }
 
 void
@@ -579,6 +579,7 @@ child_handler (int sig UNUSED)
 }
 
 extern int shell_function_pid, shell_function_completed;
+extern int shell_function_failed;
 
 /* Reap all dead children, storing the returned status and the new command
    state ('cs_finished') in the 'file' member of the 'struct child' for the
@@ -828,6 +829,7 @@ reap_children (int block, int err, target_stack_node_t *p_call_stack)
       if (!remote && pid == shell_function_pid)
         {
           /* It is.  Leave an indicator for the 'shell' function.  */
+          shell_function_failed = exit_sig != 0 || exit_code != 0;
           if (exit_sig == 0 && exit_code == 127)
             shell_function_completed = -1;
           else
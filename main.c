@@ -23,6 +23,9 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "rule.h"
 #include "debug.h"
 #include "getopt.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "shellcache.h"
 
 #include <assert.h>
 #ifdef _AMIGA
@@ -288,6 +291,37 @@ struct rlimit stack_limit;
 
 unsigned int job_slots = 1;
 unsigned int default_job_slots = 1;
+
+/* Number of threads that read included makefiles ahead of time.  */
+
+unsigned int parallel_include = 1;
+static unsigned int default_parallel_include = 1;
+
+/* Nonzero means read remade dependency files again in place instead of
+   re-executing, where that gives the same result.  */
+
+int in_process_restart = 0;
+
+/* Nonzero means keep the values of recursive variables that can't change
+   once the makefiles have been read (--freeze-variables).  */
+
+int freeze_variables_flag = 0;
+
+/* Nonzero means run $(shell ...) commands in one long-lived shell rather
+   than a new shell each (--persistent-shell).  */
+
+int persistent_shell_flag = 0;
+
+/* Nonzero means remember how the text given to $(eval) splits into lines,
+   and reuse that when the same text comes again (--eval-cache).  */
+
+int eval_cache_flag = 0;
+
+/* Nonzero means look up the variables a target inherits from its parents
+   in one table per parent (--variable-views).  */
+
+int variable_view_flag = 0;
+
 static unsigned int master_job_slots = 0;
 
 /* Value of job_slots that means no limit.  */
@@ -394,6 +428,9 @@ static const char *const usage[] =
   -C DIRECTORY, --directory=DIRECTORY\n\
                               Change to DIRECTORY before doing anything.\n"),
     N_("\
+  --clear-shell-cache         Run $(shell ...) commands again rather than\n\
+                              use the results cached by .CACHE_SHELL.\n"),
+    N_("\
   -d                          Print lots of debugging information.\n"),
     N_("\
   --debug[=FLAGS]             Print various types of debugging information.\n"),
@@ -403,9 +440,16 @@ static const char *const usage[] =
     N_("\
   --eval=STRING               Evaluate STRING as a makefile statement.\n"),
     N_("\
+  --eval-cache                Reuse the parsing of text that $(eval) has\n\
+                              seen before.\n"),
+    N_("\
   -f FILE, --file=FILE, --makefile=FILE\n\
                               Read FILE as a makefile.\n"),
     N_("\
+  --freeze-variables          Keep the value of recursive variables that\n\
+                              can't change once the makefiles are read,\n\
+                              until the first global variable changes.\n"),
+    N_("\
   -h, --help                  Print this message and exit.\n"),
     N_("\
   -i, --ignore-errors         Ignore errors from recipes.\n"),
@@ -413,6 +457,9 @@ static const char *const usage[] =
   -I DIRECTORY, --include-dir=DIRECTORY\n\
                               Search DIRECTORY for included makefiles.\n"),
     N_("\
+  --in-process-restart        Read remade dependency files again without\n\
+                              re-executing make, where possible.\n"),
+    N_("\
   -j [N], --jobs[=N]          Allow N jobs at once; infinite jobs with no arg.\n"),
     N_("\
   -k, --keep-going            Keep going when some targets can't be made.\n"),
@@ -433,8 +480,19 @@ static const char *const usage[] =
   -O[TYPE], --output-sync[=TYPE]\n\
                               Synchronize output of parallel jobs by TYPE.\n"),
     N_("\
+  --parallel-include=N        Read up to N included makefiles at once.\n"),
+    N_("\
+  --persistent-shell          Run $(shell ...) commands in one long-lived\n\
+                              shell.\n"),
+    N_("\
   -p, --print-data-base       Print make's internal database.\n"),
     N_("\
+  --profile-parse[=FILE]      Print where reading the makefiles takes time\n\
+                              and write the details to FILE.\n"),
+    N_("\
+  --profile-variables         Print which recursive variables take the most\n\
+                              time to expand.\n"),
+    N_("\
   -q, --question              Run no recipe; exit status says if up to date.\n"),
     N_("\
   -r, --no-builtin-rules      Disable the built-in implicit rules.\n"),
@@ -446,6 +504,9 @@ static const char *const usage[] =
   -S, --no-keep-going, --stop\n\
                               Turns off -k.\n"),
     N_("\
+  --snapshot=FILE             Cache the parsed makefiles in FILE and reuse\n\
+                              them while nothing they depend on changes.\n"),
+    N_("\
   --targets                   Give list of explicitly-named targets.\n"),
     N_("\
   --tasks                     Give list of explicitly-named targets which\n"
@@ -457,6 +518,9 @@ static const char *const usage[] =
     N_("\
   -v, --version               Print the version number of make and exit.\n"),
     N_("\
+  --variable-views            Look up variables inherited from parent\n\
+                              targets in one table.\n"),
+    N_("\
   --verbosity[=LEVEL]         Set verbosity level. LEVEL may be \"terse\" \"no-header\" or\n"
                               "\full\"\n. The default is \"full\".\n"),
     N_("\
@@ -555,6 +619,24 @@ static const struct command_switch switches[] =
         "no-readline", },
     { CHAR_MAX+11, flag,  &show_targets_flag, 0, 0, 0, 0, 0,
       "targets" },
+    { CHAR_MAX+12, string, &snapshot_file, 1, 0, 0, 0, 0, "snapshot" },
+    { CHAR_MAX+13, positive_int, &parallel_include, 1, 1, 0, 0,
+      &default_parallel_include, "parallel-include" },
+    { CHAR_MAX+14, flag, &in_process_restart, 1, 1, 0, 0, 0,
+      "in-process-restart" },
+    { CHAR_MAX+15, string, &profile_parse_file, 0, 0, 0,
+      "make-parse-profile.json", 0, "profile-parse" },
+    { CHAR_MAX+16, flag, &freeze_variables_flag, 1, 1, 0, 0, 0,
+      "freeze-variables" },
+    { CHAR_MAX+17, flag, &profile_variables_flag, 0, 0, 0, 0, 0,
+      "profile-variables" },
+    { CHAR_MAX+18, flag, &persistent_shell_flag, 1, 1, 0, 0, 0,
+      "persistent-shell" },
+    { CHAR_MAX+19, flag, &clear_shell_cache_flag, 1, 1, 0, 0, 0,
+      "clear-shell-cache" },
+    { CHAR_MAX+20, flag, &eval_cache_flag, 1, 1, 0, 0, 0, "eval-cache" },
+    { CHAR_MAX+21, flag, &variable_view_flag, 1, 1, 0, 0, 0,
+      "variable-views" },
     { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
   };
 
@@ -784,6 +866,10 @@ initialize_stopchar_map ()
   stopchar_map[(int)'\\'] = MAP_DIRSEP;
 #endif
 
+  stopchar_map[(int)'?'] |= MAP_MWORD;
+  stopchar_map[(int)'+'] |= MAP_MWORD;
+  stopchar_map[(int)'\\'] |= MAP_MWORD;
+
   for (i = 1; i <= UCHAR_MAX; ++i)
     {
       if (isblank(i))
@@ -868,6 +954,9 @@ decode_debug_flags (void)
               case 'b':
                 db_level |= DB_BASIC;
                 break;
+              case 'c':
+                db_level |= DB_CONDITIONALS;
+                break;
               case 'i':
                 db_level |= DB_BASIC | DB_IMPLICIT;
                 break;
@@ -1480,6 +1569,7 @@ main (int argc, char **argv, char **envp)
 #endif
             shell_var.name = xstrdup ("SHELL");
             shell_var.length = 5;
+            shell_var.hash = v->hash;
             shell_var.value = xstrdup (ep);
           }
 
@@ -2071,39 +2161,57 @@ main (int argc, char **argv, char **envp)
 
   default_goal_var = define_variable_cname (".DEFAULT_GOAL", "", o_file, 0);
 
-  /* Evaluate all strings provided with --eval.
-     Also set up the $(-*-eval-flags-*-) variable.  */
+  /* If a snapshot of an earlier reading of the same makefiles is usable,
+     take everything from it, including the effect of any --eval strings.
+     The debugger wants to watch the makefiles being read.  */
 
-  if (eval_strings)
+  if (snapshot_file == 0 || b_debugger_preread
+      || !snapshot_load (snapshot_file, argc, argv, environ))
     {
-      char *p, *value;
-      unsigned int i;
-      unsigned int len = (CSTRLEN ("--eval=") + 1) * eval_strings->idx;
+      if (profile_parse_file != 0)
+        profile_parse_start ();
 
-      for (i = 0; i < eval_strings->idx; ++i)
-        {
-          p = xstrdup (eval_strings->list[i]);
-          len += 2 * strlen (p);
-          eval_buffer (p, NULL);
-          free (p);
-        }
+      /* Evaluate all strings provided with --eval.
+         Also set up the $(-*-eval-flags-*-) variable.  */
 
-      p = value = alloca (len);
-      for (i = 0; i < eval_strings->idx; ++i)
+      if (eval_strings)
         {
-          strcpy (p, "--eval=");
-          p += CSTRLEN ("--eval=");
-          p = quote_for_env (p, eval_strings->list[i]);
-          *(p++) = ' ';
+          char *p, *value;
+          unsigned int i;
+          unsigned int len = (CSTRLEN ("--eval=") + 1) * eval_strings->idx;
+
+          for (i = 0; i < eval_strings->idx; ++i)
+            {
+              p = xstrdup (eval_strings->list[i]);
+              len += 2 * strlen (p);
+              eval_buffer (p, NULL);
+              free (p);
+            }
+
+          p = value = alloca (len);
+          for (i = 0; i < eval_strings->idx; ++i)
+            {
+              strcpy (p, "--eval=");
+              p += CSTRLEN ("--eval=");
+              p = quote_for_env (p, eval_strings->list[i]);
+              *(p++) = ' ';
+            }
+          p[-1] = '\0';
+
+          define_variable_cname ("-*-eval-flags-*-", value, o_automatic, 0);
         }
-      p[-1] = '\0';
 
-      define_variable_cname ("-*-eval-flags-*-", value, o_automatic, 0);
-    }
+      /* Read all the makefiles.  */
 
-  /* Read all the makefiles.  */
+      read_makefiles = read_all_makefiles (makefiles == 0
+                                           ? 0 : makefiles->list);
 
-  read_makefiles = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
+      if (profile_parse_file != 0)
+        profile_parse_finish ();
+
+      if (snapshot_file != 0)
+        snapshot_save (snapshot_file, argc, argv, environ);
+    }
 
 #ifdef WINDOWS32
   /* look one last time after reading all Makefiles */
@@ -2486,6 +2594,32 @@ main (int argc, char **argv, char **envp)
           }
 
         case us_success:
+          /* If all the makefiles that changed can be read again in place,
+             there is no need to start over.  */
+          if (in_process_restart)
+            {
+              unsigned int i;
+              struct dep *d;
+              int ok = 1;
+
+              for (i = 0, d = read_makefiles; ok && d != 0; ++i, d = d->next)
+                if (d->file->updated && d->file->update_status == us_success
+                    && file_mtime_no_search (d->file) != makefile_mtimes[i])
+                  ok = reread_makefile (d);
+
+              if (ok)
+                {
+                  char buf[30];
+                  struct variable *v;
+
+                  ++restarts;
+                  sprintf (buf, "%u", restarts);
+                  v = define_variable_cname ("MAKE_RESTARTS", buf, o_env, 1);
+                  v->export = v_noexport;
+                  break;
+                }
+            }
+
         re_exec:
           /* Updated successfully.  Re-exec ourselves.  */
 
@@ -2598,6 +2732,8 @@ main (int argc, char **argv, char **envp)
               putenv (b);
             }
 
+          shell_cache_save ();
+
           fflush (stdout);
           fflush (stderr);
 
@@ -2732,6 +2868,9 @@ main (int argc, char **argv, char **envp)
       die(0);
   }
 
+  if (freeze_variables_flag)
+    freeze_variables ();
+
   /* Update the goals.  */
 
   DB (DB_BASIC, (_("Updating goal targets....\n")));
@@ -2756,6 +2895,13 @@ main (int argc, char **argv, char **envp)
         break;
     }
 
+    if (freeze_variables_flag)
+      DB (DB_BASIC, (_("Froze %u variables.\n"), frozen_variables));
+
+    if (environment_values_reused || environment_values_expanded)
+      DB (DB_JOBS, (_("Job environments: %lu values reused, %lu worked out.\n"),
+                    environment_values_reused, environment_values_expanded));
+
     /* If we detected some clock skew, generate one last warning */
     if (clock_skew_detected)
       O (error, NILF,
@@ -3530,6 +3676,8 @@ print_data_base ()
   print_file_data_base ();
   print_vpath_data_base ();
   strcache_print_stats ("#");
+  if (eval_cache_flag)
+    eval_cache_print_stats ("#");
 
   when = time ((time_t *) 0);
   printf (_("\n# Finished Make data base on %s\n"), ctime (&when));
@@ -3638,6 +3786,11 @@ die (int status)
       /* Remove the intermediate files.  */
       remove_intermediates (0);
 
+      shell_cache_save ();
+
+      if (profile_variables_flag)
+        profile_variables_finish ();
+
       if (print_data_base_flag)
         print_data_base ();
 
@@ -396,6 +396,9 @@ extern int unixy_shell;
 #define MAP_PIPE        0x0100
 #define MAP_DOT         0x0200
 #define MAP_COMMA       0x0400
+/* Characters that may end a makefile word or change its meaning, beyond
+   the ones with classes of their own: see get_next_mword.  */
+#define MAP_MWORD       0x0800
 
 /* These are the valid characters for a user-defined function.  */
 #define MAP_USERFUNC    0x2000
@@ -471,6 +474,8 @@ char *xstrndup (const char *, unsigned int);
 char *find_next_token (const char **, unsigned int *);
 char *next_token (const char *);
 char *end_of_token (const char *);
+char *scan_stopchar (const char *s, int map);
+char *scan_blanks (const char *s);
 void collapse_continuations (char *);
 char *lindex (const char *, const char *, int);
 int alpha_compare (const void *, const void *);
@@ -511,6 +516,8 @@ void install_default_implicit_rules (void);
 
 void build_vpath_lists (void);
 void construct_vpath_list (char *pattern, char *dirpath);
+void map_vpath_lists (void (*fn) (const char *pattern,
+                                  const char **searchpath));
 const char *vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr,
                           unsigned int* vpath_index, unsigned int* path_index);
 int gpath_search (const char *file, unsigned int len);
@@ -611,6 +618,12 @@ extern int batch_mode_shell;
 extern char cmd_prefix;
 
 extern unsigned int job_slots;
+extern unsigned int parallel_include;
+extern int in_process_restart;
+extern int freeze_variables_flag;
+extern int persistent_shell_flag;
+extern int eval_cache_flag;
+extern int variable_view_flag;
 extern int job_fds[2];
 extern int job_rfd;
 #ifndef NO_FLOAT
@@ -18,6 +18,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "filedef.h"
 #include "dep.h"
 #include "debug.h"
+#include "profile.h"
 
 /* GNU make no longer supports pre-ANSI89 environments.  */
 
@@ -220,6 +221,7 @@ xmalloc (unsigned int size)
   void *result = malloc (size ? size : 1);
   if (result == 0)
     OUT_OF_MEM();
+  PROFILE_ALLOC (size);
   return result;
 }
 
@@ -231,6 +233,7 @@ xcalloc (unsigned int size)
   void *result = calloc (size ? size : 1, 1);
   if (result == 0)
     OUT_OF_MEM();
+  PROFILE_ALLOC (size);
   return result;
 }
 
@@ -246,6 +249,7 @@ xrealloc (void *ptr, unsigned int size)
   result = ptr ? realloc (ptr, size) : malloc (size);
   if (result == 0)
     OUT_OF_MEM();
+  PROFILE_ALLOC (size);
   return result;
 }
 
@@ -263,6 +267,7 @@ xstrdup (const char *ptr)
 
   if (result == 0)
     OUT_OF_MEM();
+  PROFILE_ALLOC (strlen (ptr) + 1);
 
 #ifdef HAVE_STRDUP
   return result;
@@ -282,6 +287,7 @@ xstrndup (const char *str, unsigned int length)
   result = strndup (str, length);
   if (result == 0)
     OUT_OF_MEM();
+  PROFILE_ALLOC (length + 1);
 #else
   result = xmalloc (length + 1);
   if (length > 0)
@@ -314,9 +320,7 @@ lindex (const char *s, const char *limit, int c)
 char *
 end_of_token (const char *s)
 {
-  while (! STOP_SET (*s, MAP_BLANK|MAP_NUL))
-    ++s;
-  return (char *)s;
+  return scan_stopchar (s, MAP_BLANK|MAP_NUL);
 }
 
 /* Return the address of the first nonwhitespace or null in the string S.  */
@@ -324,9 +328,7 @@ end_of_token (const char *s)
 char *
 next_token (const char *s)
 {
-  while (isblank ((unsigned char)*s))
-    ++s;
-  return (char *)s;
+  return scan_blanks (s);
 }
 
 /* Find the next token in PTR; return the address of it, and store the length
@@ -349,6 +351,53 @@ find_next_token (const char **ptr, unsigned int *lengthptr)
 }
 
 
+/* There is a 'struct dep' for every prerequisite of every target, and long
+   prerequisite lists make millions of them.  They are carved out of large
+   blocks instead of being allocated one by one, and those that are freed
+   are kept for reuse.  */
+
+#define DEP_BLOCK_SIZE  1024
+
+static struct dep *dep_block = 0;
+static unsigned int dep_block_left = 0;
+static struct dep *free_deps = 0;
+
+/* Return a new 'struct dep', all zeros.  */
+
+struct dep *
+alloc_dep (void)
+{
+  struct dep *d;
+
+  if (free_deps != 0)
+    {
+      d = free_deps;
+      free_deps = d->next;
+    }
+  else
+    {
+      if (dep_block_left == 0)
+        {
+          dep_block = xmalloc (DEP_BLOCK_SIZE * sizeof (struct dep));
+          dep_block_left = DEP_BLOCK_SIZE;
+        }
+      d = dep_block++;
+      --dep_block_left;
+    }
+
+  memset (d, '\0', sizeof (struct dep));
+  return d;
+}
+
+/* Free a 'struct dep' returned by alloc_dep.  */
+
+void
+free_dep (struct dep *d)
+{
+  d->next = free_deps;
+  free_deps = d;
+}
+
 /* Copy a chain of 'struct dep'.  For 2nd expansion deps, dup the name.  */
 
 struct dep *
@@ -359,7 +408,7 @@ copy_dep_chain (const struct dep *d)
 
   while (d != 0)
     {
-      struct dep *c = xmalloc (sizeof (struct dep));
+      struct dep *c = alloc_dep ();
       memcpy (c, d, sizeof (struct dep));
 
       if (c->need_2nd_expansion)
@@ -0,0 +1,582 @@
+/* Profiling the reading of makefiles and the expansion of variables for
+GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* While the makefiles are read, all the time that passes and all the bytes
+   that are allocated are charged to the line being evaluated.  A line that
+   includes a makefile or calls $(eval) is only charged for what happens
+   outside the makefile or buffer; what happens inside is charged to its own
+   lines.  The part of a line's time spent expanding strings is also kept
+   apart, as is the time from the start to the end of each makefile.
+
+   Lines of an $(eval) buffer have the location that make gives them in
+   error messages: the line of the makefile the buffer was evaluated from,
+   plus the line within the buffer.  */
+
+#include "makeint.h"
+
+#include "hash.h"
+#include "profile.h"
+
+#if HAVE_CLOCK_GETTIME
+# include <time.h>
+#endif
+#if HAVE_GETTIMEOFDAY
+# include <sys/time.h>
+#endif
+
+/* How many makefiles and lines the table printed at the end shows.  */
+#define PROFILE_SHOWN 20
+
+/* What was measured for one makefile.  Its self time, expansion time and
+   bytes are the sums of those of its lines.  */
+
+struct makefile_profile
+  {
+    const char *filenm;         /* The makefile, or 0 for --eval.  */
+    unsigned int reads;         /* How many times it was read.  */
+    unsigned long lines;        /* How many lines were evaluated.  */
+    double total;               /* Seconds from start to end of reading.  */
+    double self;
+    double expand;
+    unsigned long bytes;
+  };
+
+/* What was measured for one line.  */
+
+struct line_profile
+  {
+    const char *filenm;         /* As in the gmk_floc, which need not be
+                                   in the strcache.  */
+    unsigned long lineno;
+    unsigned long count;        /* How many times it was evaluated.  */
+    double self;                /* Seconds charged to it.  */
+    double expand;              /* How many of those went to expansion.  */
+    unsigned long bytes;        /* Bytes allocated meanwhile.  */
+    struct makefile_profile *makefile;
+  };
+
+/* What to go back to when a makefile or buffer has been read.  */
+
+struct profile_frame
+  {
+    struct line_profile *line;
+    struct makefile_profile *makefile;
+    unsigned int expand_depth;
+    double start;
+  };
+
+char *profile_parse_file = NULL;
+int profiling_parse = 0;
+unsigned long profile_bytes = 0;
+
+static struct hash_table makefile_profiles;
+static struct hash_table line_profiles;
+
+static struct profile_frame *frames;
+static unsigned int nframes;
+static unsigned int max_frames;
+
+static struct line_profile *current;
+static unsigned int expand_depth;
+static double last_time;
+static unsigned long last_bytes;
+static double start_time;
+
+static double
+profile_now (void)
+{
+#if HAVE_CLOCK_GETTIME && defined CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+#if HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+    if (gettimeofday (&tv, 0) == 0)
+      return tv.tv_sec + tv.tv_usec / 1e6;
+  }
+#endif
+  return time ((time_t *) 0);
+}
+
+static unsigned long
+makefile_profile_hash_1 (const void *key)
+{
+  return (unsigned long) ((const struct makefile_profile *) key)->filenm;
+}
+
+static unsigned long
+makefile_profile_hash_2 (const void *key)
+{
+  return (unsigned long) ((const struct makefile_profile *) key)->filenm >> 4;
+}
+
+static int
+makefile_profile_hash_cmp (const void *x, const void *y)
+{
+  const char *fx = ((const struct makefile_profile *) x)->filenm;
+  const char *fy = ((const struct makefile_profile *) y)->filenm;
+  return fx == fy ? 0 : fx < fy ? -1 : 1;
+}
+
+static unsigned long
+line_profile_hash_1 (const void *key)
+{
+  const struct line_profile *lp = key;
+  return (unsigned long) lp->filenm ^ lp->lineno * 2654435761UL;
+}
+
+static unsigned long
+line_profile_hash_2 (const void *key)
+{
+  return line_profile_hash_1 (key) >> 7;
+}
+
+static int
+line_profile_hash_cmp (const void *x, const void *y)
+{
+  const struct line_profile *lx = x;
+  const struct line_profile *ly = y;
+
+  if (lx->filenm != ly->filenm)
+    return lx->filenm < ly->filenm ? -1 : 1;
+  if (lx->lineno != ly->lineno)
+    return lx->lineno < ly->lineno ? -1 : 1;
+  return 0;
+}
+
+static struct makefile_profile *
+find_makefile_profile (const char *filenm)
+{
+  struct makefile_profile key;
+  struct makefile_profile *mp;
+  void **slot;
+
+  key.filenm = filenm;
+  slot = hash_find_slot (&makefile_profiles, &key);
+  if (! HASH_VACANT (*slot))
+    return *slot;
+
+  mp = xcalloc (sizeof (struct makefile_profile));
+  mp->filenm = filenm;
+  hash_insert_at (&makefile_profiles, mp, slot);
+  return mp;
+}
+
+static struct line_profile *
+find_line_profile (const gmk_floc *floc)
+{
+  struct line_profile key;
+  struct line_profile *lp;
+  void **slot;
+
+  key.filenm = floc ? floc->filenm : 0;
+  key.lineno = floc ? floc->lineno : 0;
+  slot = hash_find_slot (&line_profiles, &key);
+  if (! HASH_VACANT (*slot))
+    return *slot;
+
+  lp = xcalloc (sizeof (struct line_profile));
+  lp->filenm = key.filenm;
+  lp->lineno = key.lineno;
+  lp->makefile = find_makefile_profile (key.filenm
+                                        ? strcache_add (key.filenm) : 0);
+  hash_insert_at (&line_profiles, lp, slot);
+
+  /* What the profile allocates itself is nobody's doing.  */
+  last_bytes = profile_bytes;
+  return lp;
+}
+
+/* Charge the time and bytes since the last call to the current line.  */
+
+static void
+charge (void)
+{
+  double now = profile_now ();
+
+  if (current != 0)
+    {
+      current->self += now - last_time;
+      if (expand_depth)
+        current->expand += now - last_time;
+      current->bytes += profile_bytes - last_bytes;
+    }
+  last_time = now;
+  last_bytes = profile_bytes;
+}
+
+void
+profile_parse_start (void)
+{
+  hash_init (&makefile_profiles, 256, makefile_profile_hash_1,
+             makefile_profile_hash_2, makefile_profile_hash_cmp);
+  hash_init (&line_profiles, 4096, line_profile_hash_1, line_profile_hash_2,
+             line_profile_hash_cmp);
+  current = 0;
+  expand_depth = 0;
+  profiling_parse = 1;
+  profile_bytes = 0;
+  last_bytes = 0;
+  start_time = last_time = profile_now ();
+}
+
+void
+profile_parse_enter (const gmk_floc *floc, int makefile)
+{
+  struct profile_frame *f;
+
+  charge ();
+  if (nframes == max_frames)
+    {
+      max_frames = max_frames ? max_frames * 2 : 16;
+      frames = xrealloc (frames, max_frames * sizeof (struct profile_frame));
+    }
+  f = &frames[nframes++];
+  f->line = current;
+  f->expand_depth = expand_depth;
+  f->start = last_time;
+  f->makefile = 0;
+
+  current = find_line_profile (floc);
+  last_bytes = profile_bytes;
+  expand_depth = 0;
+  if (makefile)
+    {
+      f->makefile = current->makefile;
+      ++f->makefile->reads;
+    }
+}
+
+void
+profile_parse_leave (void)
+{
+  struct profile_frame *f = &frames[--nframes];
+
+  charge ();
+  if (f->makefile != 0)
+    f->makefile->total += last_time - f->start;
+  current = f->line;
+  expand_depth = f->expand_depth;
+}
+
+void
+profile_parse_line (const gmk_floc *floc)
+{
+  charge ();
+  current = find_line_profile (floc);
+  ++current->count;
+}
+
+void
+profile_parse_expand (int begin)
+{
+  if (begin)
+    {
+      if (expand_depth++ == 0)
+        charge ();
+    }
+  else if (--expand_depth == 0)
+    charge ();
+}
+
+
+/* Reporting.  */
+
+static int
+makefile_profile_self_cmp (const void *x, const void *y)
+{
+  const struct makefile_profile *mx = *(const struct makefile_profile **) x;
+  const struct makefile_profile *my = *(const struct makefile_profile **) y;
+  return mx->self < my->self ? 1 : mx->self > my->self ? -1 : 0;
+}
+
+static int
+line_profile_self_cmp (const void *x, const void *y)
+{
+  const struct line_profile *lx = *(const struct line_profile **) x;
+  const struct line_profile *ly = *(const struct line_profile **) y;
+  return lx->self < ly->self ? 1 : lx->self > ly->self ? -1 : 0;
+}
+
+static const char *
+profile_name (const char *filenm)
+{
+  return filenm ? filenm : "--eval";
+}
+
+static void
+put_json_string (FILE *fp, const char *s)
+{
+  putc ('"', fp);
+  for (; *s != '\0'; ++s)
+    if (*s == '"' || *s == '\\')
+      fprintf (fp, "\\%c", *s);
+    else if ((unsigned char) *s < ' ')
+      fprintf (fp, "\\u%04x", (unsigned char) *s);
+    else
+      putc (*s, fp);
+  putc ('"', fp);
+}
+
+static int
+write_profile (const char *fname, double elapsed,
+               struct makefile_profile **mps, unsigned long nmps,
+               struct line_profile **lps, unsigned long nlps)
+{
+  unsigned long i;
+  FILE *fp;
+
+  ENULLLOOP (fp, fopen (fname, "w"));
+  if (fp == 0)
+    return 0;
+
+  fprintf (fp, "{\n  \"elapsed\": %.6f,\n  \"bytes\": %lu,\n",
+           elapsed, profile_bytes);
+  fputs ("  \"makefiles\": [", fp);
+  for (i = 0; i < nmps; ++i)
+    {
+      const struct makefile_profile *mp = mps[i];
+      fputs (i ? ",\n    {\"name\": " : "\n    {\"name\": ", fp);
+      put_json_string (fp, profile_name (mp->filenm));
+      fprintf (fp, ", \"reads\": %u, \"lines\": %lu, \"total\": %.6f, "
+               "\"self\": %.6f, \"expand\": %.6f, \"bytes\": %lu}",
+               mp->reads, mp->lines, mp->total, mp->self, mp->expand,
+               mp->bytes);
+    }
+  fputs ("\n  ],\n  \"lines\": [", fp);
+  for (i = 0; i < nlps; ++i)
+    {
+      const struct line_profile *lp = lps[i];
+      fputs (i ? ",\n    {\"file\": " : "\n    {\"file\": ", fp);
+      put_json_string (fp, profile_name (lp->makefile->filenm));
+      fprintf (fp, ", \"line\": %lu, \"count\": %lu, \"self\": %.6f, "
+               "\"expand\": %.6f, \"bytes\": %lu}",
+               lp->lineno, lp->count, lp->self, lp->expand, lp->bytes);
+    }
+  fputs ("\n  ]\n}\n", fp);
+
+  return fclose (fp) == 0;
+}
+
+void
+profile_parse_finish (void)
+{
+  struct makefile_profile **mps;
+  struct line_profile **lps;
+  unsigned long nmps, nlps;
+  unsigned long i;
+  double elapsed;
+
+  charge ();
+  current = 0;
+  profiling_parse = 0;
+  elapsed = last_time - start_time;
+
+  /* Sum up the lines of each makefile.  */
+  nlps = line_profiles.ht_fill;
+  lps = (struct line_profile **) hash_dump (&line_profiles, 0, 0);
+  for (i = 0; i < nlps; ++i)
+    {
+      struct makefile_profile *mp = lps[i]->makefile;
+      mp->lines += lps[i]->count;
+      mp->self += lps[i]->self;
+      mp->expand += lps[i]->expand;
+      mp->bytes += lps[i]->bytes;
+    }
+  qsort (lps, nlps, sizeof (struct line_profile *), line_profile_self_cmp);
+
+  nmps = makefile_profiles.ht_fill;
+  mps = (struct makefile_profile **) hash_dump (&makefile_profiles, 0, 0);
+  qsort (mps, nmps, sizeof (struct makefile_profile *),
+         makefile_profile_self_cmp);
+
+  printf (_("# Reading makefiles took %.6f seconds and %lu bytes.\n"),
+          elapsed, profile_bytes);
+  printf (_("#%11s %11s %11s %11s %6s %8s  %s\n"), _("self"), _("total"),
+          _("expand"), _("bytes"), _("reads"), _("lines"), _("makefile"));
+  for (i = 0; i < nmps && i < PROFILE_SHOWN; ++i)
+    printf ("#%11.6f %11.6f %11.6f %11lu %6u %8lu  %s\n", mps[i]->self,
+            mps[i]->total, mps[i]->expand, mps[i]->bytes, mps[i]->reads,
+            mps[i]->lines, profile_name (mps[i]->filenm));
+  printf (_("#%11s %11s %11s %11s %6s %8s  %s\n"), _("self"), "",
+          _("expand"), _("bytes"), "", _("count"), _("line"));
+  for (i = 0; i < nlps && i < PROFILE_SHOWN; ++i)
+    printf ("#%11.6f %11s %11.6f %11lu %6s %8lu  %s:%lu\n", lps[i]->self,
+            "", lps[i]->expand, lps[i]->bytes, "", lps[i]->count,
+            profile_name (lps[i]->makefile->filenm), lps[i]->lineno);
+
+  if (!write_profile (profile_parse_file, elapsed, mps, nmps, lps, nlps))
+    OSS (error, NILF, _("warning: cannot write parse profile '%s': %s"),
+         profile_parse_file, strerror (errno));
+  else
+    printf (_("# Wrote %lu makefiles and %lu lines to '%s'.\n"),
+            nmps, nlps, profile_parse_file);
+
+  free (mps);
+  free (lps);
+  hash_free (&line_profiles, 1);
+  hash_free (&makefile_profiles, 1);
+  free (frames);
+  frames = 0;
+  nframes = max_frames = 0;
+}
+
+
+/* With --profile-variables, each expansion of a recursive variable is
+   counted and timed under the variable's name, along with the bytes it
+   produced.  As in a function profiler, a variable's total time includes
+   the variables expanded for it, and its self time does not; when a
+   variable is expanded within its own expansion, only the outermost one
+   adds to its total.  */
+
+struct variable_profile
+  {
+    const char *name;           /* In the strcache.  */
+    unsigned long count;        /* How many times it was expanded.  */
+    unsigned long bytes;        /* Bytes its expansions produced.  */
+    double self;
+    double total;
+    unsigned int active;        /* Expansions of it under way.  */
+  };
+
+/* An expansion under way.  */
+
+struct variable_frame
+  {
+    struct variable_profile *profile;
+    double start;
+    double children;            /* Total time of the expansions within it.  */
+  };
+
+int profile_variables_flag = 0;
+
+static struct hash_table variable_profiles;
+
+static struct variable_frame *variable_frames;
+static unsigned int nvariable_frames;
+static unsigned int max_variable_frames;
+
+static unsigned long
+variable_profile_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct variable_profile *) key)->name);
+}
+
+static unsigned long
+variable_profile_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct variable_profile *) key)->name);
+}
+
+static int
+variable_profile_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct variable_profile *) x)->name,
+                         ((const struct variable_profile *) y)->name);
+}
+
+void
+profile_variable_enter (const char *name)
+{
+  struct variable_profile key;
+  struct variable_profile **slot;
+  struct variable_profile *vp;
+  struct variable_frame *f;
+
+  if (variable_profiles.ht_vec == 0)
+    hash_init (&variable_profiles, 1024, variable_profile_hash_1,
+               variable_profile_hash_2, variable_profile_hash_cmp);
+
+  key.name = name;
+  slot = (struct variable_profile **) hash_find_slot (&variable_profiles,
+                                                      &key);
+  vp = *slot;
+  if (HASH_VACANT (vp))
+    {
+      vp = xcalloc (sizeof (struct variable_profile));
+      vp->name = strcache_add (name);
+      hash_insert_at (&variable_profiles, vp, slot);
+    }
+  ++vp->count;
+  ++vp->active;
+
+  if (nvariable_frames == max_variable_frames)
+    {
+      max_variable_frames = max_variable_frames ? max_variable_frames * 2 : 16;
+      variable_frames = xrealloc (variable_frames, max_variable_frames
+                                  * sizeof (struct variable_frame));
+    }
+  f = &variable_frames[nvariable_frames++];
+  f->profile = vp;
+  f->children = 0;
+  f->start = profile_now ();
+}
+
+void
+profile_variable_leave (unsigned long bytes)
+{
+  struct variable_frame *f = &variable_frames[--nvariable_frames];
+  struct variable_profile *vp = f->profile;
+  double total = profile_now () - f->start;
+
+  vp->self += total - f->children;
+  if (--vp->active == 0)
+    vp->total += total;
+  vp->bytes += bytes;
+
+  if (nvariable_frames != 0)
+    variable_frames[nvariable_frames - 1].children += total;
+}
+
+static int
+variable_profile_self_cmp (const void *x, const void *y)
+{
+  const struct variable_profile *vx = *(const struct variable_profile **) x;
+  const struct variable_profile *vy = *(const struct variable_profile **) y;
+  return vx->self < vy->self ? 1 : vx->self > vy->self ? -1 : 0;
+}
+
+void
+profile_variables_finish (void)
+{
+  struct variable_profile **vps;
+  unsigned long nvps;
+  unsigned long i;
+  double self = 0;
+
+  nvps = variable_profiles.ht_fill;
+  if (nvps == 0)
+    return;
+
+  vps = (struct variable_profile **) hash_dump (&variable_profiles, 0, 0);
+  for (i = 0; i < nvps; ++i)
+    self += vps[i]->self;
+  qsort (vps, nvps, sizeof (struct variable_profile *),
+         variable_profile_self_cmp);
+
+  printf (_("# Expanding %lu recursive variables took %.6f seconds.\n"),
+          nvps, self);
+  printf (_("#%11s %11s %9s %11s  %s\n"), _("self"), _("total"),
+          _("count"), _("bytes"), _("variable"));
+  for (i = 0; i < nvps && i < PROFILE_SHOWN; ++i)
+    printf ("#%11.6f %11.6f %9lu %11lu  %s\n", vps[i]->self, vps[i]->total,
+            vps[i]->count, vps[i]->bytes, vps[i]->name);
+
+  free (vps);
+}
@@ -0,0 +1,72 @@
+/* Profiling the reading of makefiles and the expansion of variables for
+GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/** \file profile.h
+ *
+ *  \brief Header for the --profile-parse makefile reading profiler and
+ *  the --profile-variables variable expansion profiler.
+ */
+
+#ifndef REMAKE_PROFILE_H
+#define REMAKE_PROFILE_H
+
+/*! Name of the file given with --profile-parse, or NULL.  */
+extern char *profile_parse_file;
+
+/*! Nonzero while the makefiles are read with --profile-parse.  */
+extern int profiling_parse;
+
+/*! Bytes asked of xmalloc and friends while profiling_parse is set.  */
+extern unsigned long profile_bytes;
+
+#define PROFILE_ALLOC(_n)                                               \
+  do { if (profiling_parse) profile_bytes += (_n); } while (0)
+
+/*! Start charging time and allocations to makefile lines.  */
+extern void profile_parse_start (void);
+
+/*! Stop profiling, print the makefiles and lines that took longest and
+    write everything that was measured to profile_parse_file as JSON.  */
+extern void profile_parse_finish (void);
+
+/*! Charge what follows to a makefile or $(eval) buffer read from FLOC,
+    until profile_parse_leave.  MAKEFILE is nonzero if FLOC names a
+    makefile that is read from its start.  */
+extern void profile_parse_enter (const gmk_floc *floc, int makefile);
+extern void profile_parse_leave (void);
+
+/*! Charge what follows to the line at FLOC.  */
+extern void profile_parse_line (const gmk_floc *floc);
+
+/*! Note that expanding a string begins (BEGIN nonzero) or ends.  */
+extern void profile_parse_expand (int begin);
+
+/*! Nonzero if the expansions of recursive variables are measured
+    (--profile-variables).  */
+extern int profile_variables_flag;
+
+/*! Start measuring an expansion of the variable named NAME, until the
+    matching profile_variable_leave.  */
+extern void profile_variable_enter (const char *name);
+
+/*! Stop measuring the expansion begun last, which produced BYTES bytes.  */
+extern void profile_variable_leave (unsigned long bytes);
+
+/*! Print the variables whose expansions took longest.  */
+extern void profile_variables_finish (void);
+
+#endif /*REMAKE_PROFILE_H*/
@@ -30,7 +30,21 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "rule.h"
 #include "debug.h"
 #include "hash.h"
-
+#include "profile.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+# include <sys/mman.h>
+# define MAP_MAKEFILES
+/* Recognizing dependency files needs the whole file in memory.  */
+# if !defined(HAVE_DOS_PATHS) && !defined(_AMIGA) && !defined(VMS)
+#  define SIMPLE_DEPS
+/* Included makefiles can be opened and mapped ahead on other threads.  */
+#  if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#   include <pthread.h>
+#   define PARALLEL_INCLUDE
+#  endif
+# endif
+#endif
 
 #ifdef WINDOWS32
 #include <windows.h>
@@ -57,8 +71,73 @@ struct ebuffer
     unsigned int size;  /* Malloc'd size of buffer. */
     FILE *fp;           /* File, or NULL if this is an internal buffer.  */
     gmk_floc floc;   /* Info on the file in fp (if any).  */
+    int mapped;         /* Nonzero if the buffer is fp mapped into memory.  */
+    struct eval_cache *cache;   /* How the buffer splits into lines, if known.  */
+    struct eval_line *line;     /* The cached line just read, or NULL.  */
+    unsigned int iline;         /* The index of the next cached line.  */
+  };
+
+#ifdef PARALLEL_INCLUDE
+/* An included makefile that preload_makefiles opened and mapped ahead of the
+   time eval_makefile reads it.  */
+
+struct preload
+  {
+    const char *name;   /* The name given in the include line.  */
+    int fd;             /* The open file, or -1 if it couldn't be opened.  */
+    struct stat st;     /* The file as it was when opened.  */
+    char *map;          /* The file mapped as by map_makefile, or NULL.  */
+    char prefix;        /* The value of cmd_prefix SIMPLE is good for.  */
+    int simple;         /* What simple_deps_p said about it.  */
+  };
+
+/* Each thread reads this many files of a long include list in one go.  */
+#define PRELOAD_PER_THREAD 8
+
+/* The preloaded file eval_makefile is about to read, if any.  */
+static struct preload *next_preload = 0;
+#endif
+
+#ifdef SIMPLE_DEPS
+/* With --in-process-restart, what reading each makefile added to the data
+   base is remembered, so that a dependency file that gets remade can be read
+   again in place by reread_makefile.  */
+
+struct deps_target
+  {
+    struct file *file;          /* A target named in the makefile.  */
+    struct dep *deps;           /* The first prerequisite it was given.  */
+    unsigned int count;         /* How many were added after that one.  */
+    unsigned long lineno;       /* The last line FILE was a target on.  */
+    unsigned int was_target:1;  /* Nonzero if FILE was a target before.  */
+  };
+
+struct makefile_read
+  {
+    const char *name;           /* The name it was read under.  */
+    const char *path;           /* Its file, as in the read_makefiles chain.  */
+    struct deps_target *targets;
+    unsigned int ntargets;
+    unsigned int maxtargets;
+    unsigned int list_offset;   /* Where it goes in MAKEFILE_LIST.  */
+    unsigned int found:1;       /* Nonzero if there was a file to read.  */
+    unsigned int simple:1;      /* Nonzero if eval_simple_deps read it.  */
+    unsigned int unsafe:1;      /* Nonzero if it can't be read in place.  */
   };
 
+static struct makefile_read *makefiles_read = 0;
+static unsigned int nmakefiles_read = 0;
+static unsigned int maxmakefiles_read = 0;
+
+/* The entry for the makefile being read, or NULL.  */
+static struct makefile_read *current_read = 0;
+
+/* The length of MAKEFILE_LIST as reading makefiles left it, and whether
+   anything else has changed it.  */
+static unsigned int makefile_list_length = 0;
+static int makefile_list_changed = 0;
+#endif
+
 /* Track the modifiers we can have on variable assignments */
 
 struct vmodifiers
@@ -71,6 +150,42 @@ struct vmodifiers
     unsigned int private_v:1;
   };
 
+/* eval_buffer remembers the text of each buffer it evaluates.  When the same
+   text comes back, as it does when a template is instantiated many times
+   with the same arguments, the work that depends on nothing but the text is
+   not done again: finding where each logical line ends, collapsing
+   continuations, removing comments and looking for a variable assignment.
+   The lines are still evaluated one at a time, as their meaning can depend
+   on variables and conditionals.  */
+
+struct eval_line
+  {
+    unsigned int start;         /* Offset of the line in the buffer.  */
+    unsigned int len;           /* Its length, without the newline.  */
+    char *text;                 /* The line made ready for eval, or NULL if
+                                   eval hasn't needed it yet.  */
+    unsigned int assign;        /* Where parse_var_assignment left TEXT.  */
+    struct vmodifiers vmod;     /* What parse_var_assignment found.  */
+  };
+
+struct eval_cache
+  {
+    char *text;                 /* The buffer, or NULL if seen only once.  */
+    unsigned int size;          /* Its length.  */
+    unsigned long hash;         /* The hash of TEXT.  */
+    int posix;                  /* posix_pedantic when it was split.  */
+    unsigned int nlines;
+    struct eval_line *lines;
+  };
+
+/* Don't remember any more buffers once this much memory is used.  */
+#define EVAL_CACHE_MAX  (64 * 1024 * 1024)
+
+static struct hash_table eval_cache_table;
+static unsigned long eval_cache_bytes = 0;
+static unsigned long eval_cache_hits = 0;
+static unsigned long eval_cache_misses = 0;
+
 /* Types of "words" that can be read in a makefile.  */
 enum make_word_type
   {
@@ -100,6 +215,30 @@ struct conditionals
 static struct conditionals toplevel_conditionals;
 static struct conditionals *conditionals = &toplevel_conditionals;
 
+/* The value of each ifdef, ifndef, ifeq and ifneq line evaluated, so that a
+   fragment included again and again need not expand the same operands each
+   time.  A value is kept if working it out called no function with side
+   effects, and is good for as long as the global variables it looked up
+   are what they were.  */
+
+struct cond_cache
+  {
+    const char *filenm;         /* Where the conditional is.  */
+    unsigned long lineno;
+    unsigned long hash;         /* Mixes text_hash of TEXT and the place.  */
+    char *text;                 /* The conditional, from its keyword on.  */
+    unsigned long generation;   /* variable_generation when it was known.  */
+    struct variable_dep *deps;  /* The variables it was worked out from.  */
+    unsigned int ndeps;
+    unsigned int known:1;       /* Nonzero if IGNORING is its value.  */
+    unsigned int ignoring:1;
+  };
+
+static struct hash_table cond_cache_table;
+static unsigned long cond_cache_hits = 0;
+static unsigned long cond_cache_misses = 0;
+static unsigned long cond_cache_uncacheable = 0;
+
 
 /* Default directories to search for include files in  */
 
@@ -119,6 +258,24 @@ static const char *default_include_directories[] =
     0
   };
 
+/* Names tried, in order, when no makefile is given with -f.  */
+
+const char *default_makefiles[] =
+#ifdef VMS
+  /* all lower case since readdir() (the vms version) 'lowercasifies' */
+  { "makefile.vms", "gnumakefile.", "makefile.", 0 };
+#else
+#ifdef _AMIGA
+  { "GNUmakefile", "Makefile", "SMakefile", 0 };
+#else /* !Amiga && !VMS */
+#ifdef WINDOWS32
+  { "GNUmakefile", "makefile", "Makefile", "makefile.mak", 0 };
+#else /* !Amiga && !VMS && !WINDOWS32 */
+  { "GNUmakefile", "makefile", "Makefile", 0 };
+#endif /* !Amiga && !VMS && !WINDOWS32 */
+#endif /* AMIGA */
+#endif /* VMS */
+
 /* List of directories to search for include files in  */
 
 static const char **include_directories;
@@ -140,11 +297,36 @@ static int eval_makefile (const char *filename, int flags);
 static void eval (struct ebuffer *buffer, int flags);
 
 static long readline (struct ebuffer *ebuf);
+#ifdef MAP_MAKEFILES
+static char *map_fd (int fd, const struct stat *st);
+static int map_makefile (struct ebuffer *ebuf);
+#endif
+#ifdef SIMPLE_DEPS
+static void init_simple_deps (void);
+static int simple_deps_p (const char *buf, unsigned int size);
+static void eval_simple_deps (struct ebuffer *ebuf, int set_default);
+static struct nameseq *read_simple_dep (struct ebuffer *ebuf, long *nlinesp,
+                                        char **depstrp);
+static struct makefile_read *note_makefile_read (const char *name,
+                                                 const char *path, int flags);
+static void note_deps_targets (struct makefile_read *rec,
+                               const struct nameseq *filenames,
+                               unsigned long lineno);
+static void count_deps_targets (struct makefile_read *rec,
+                                unsigned long lineno, unsigned int ndeps);
+#endif
+#ifdef PARALLEL_INCLUDE
+static struct preload *preload_makefiles (struct nameseq *files,
+                                          unsigned int *countp);
+static void free_preloads (struct preload *pre, unsigned int count);
+#endif
 static void do_undefine (char *name, enum variable_origin origin,
                          struct ebuffer *ebuf);
 static struct variable *do_define (char *name, enum variable_origin origin,
                                    struct ebuffer *ebuf);
 static int conditional_line (char *line, int len, const gmk_floc *flocp);
+static unsigned long text_hash (const char *s);
+static void check_default_goal (const struct nameseq *filenames);
 static void record_files (struct nameseq *filenames, const char *pattern,
                           const char *pattern_percent, char *depstr,
                           unsigned int cmds_started, char *commands,
@@ -245,21 +427,6 @@ read_all_makefiles (const char **makefiles)
 
   if (num_makefiles == 0)
     {
-      static const char *default_makefiles[] =
-#ifdef VMS
-        /* all lower case since readdir() (the vms version) 'lowercasifies' */
-        { "makefile.vms", "gnumakefile.", "makefile.", 0 };
-#else
-#ifdef _AMIGA
-        { "GNUmakefile", "Makefile", "SMakefile", 0 };
-#else /* !Amiga && !VMS */
-#ifdef WINDOWS32
-        { "GNUmakefile", "makefile", "Makefile", "makefile.mak", 0 };
-#else /* !Amiga && !VMS && !WINDOWS32 */
-        { "GNUmakefile", "makefile", "Makefile", 0 };
-#endif /* !Amiga && !VMS && !WINDOWS32 */
-#endif /* AMIGA */
-#endif /* VMS */
       const char **p = default_makefiles;
       while (*p != 0 && !file_exists_p (*p))
         ++p;
@@ -296,6 +463,10 @@ read_all_makefiles (const char **makefiles)
         }
     }
 
+  DB (DB_CONDITIONALS,
+      (_("Conditional cache: %lu hits, %lu misses, %lu not cacheable.\n"),
+       cond_cache_hits, cond_cache_misses, cond_cache_uncacheable));
+
   return read_makefiles;
 }
 
@@ -333,6 +504,15 @@ eval_makefile (const char *filename, int flags)
   const gmk_floc *curfile;
   char *expanded = 0;
   int makefile_errno;
+  int simple = -1;
+#ifdef SIMPLE_DEPS
+  struct makefile_read *rec = 0;
+#endif
+#ifdef PARALLEL_INCLUDE
+  struct preload *pre = next_preload;
+
+  next_preload = 0;
+#endif
 
   ebuf.floc.filenm = filename; /* Use the original file name.  */
   ebuf.floc.lineno = 1;
@@ -362,7 +542,41 @@ eval_makefile (const char *filename, int flags)
         filename = expanded;
     }
 
-  ENULLLOOP (ebuf.fp, fopen (filename, "r"));
+  ebuf.fp = 0;
+  ebuf.mapped = 0;
+  ebuf.cache = 0;
+  ebuf.line = 0;
+#ifdef PARALLEL_INCLUDE
+  /* Use the file preload_makefiles opened if it is still the same one: a
+     makefile read before this one might have changed it.  */
+  if (pre != 0 && pre->fd >= 0 && streq (pre->name, filename))
+    {
+      struct stat st;
+      int r;
+
+      EINTRLOOP (r, stat (filename, &st));
+      if (r == 0 && st.st_dev == pre->st.st_dev
+          && st.st_ino == pre->st.st_ino && st.st_size == pre->st.st_size
+          && (FILE_TIMESTAMP_STAT_MODTIME (filename, st)
+              == FILE_TIMESTAMP_STAT_MODTIME (filename, pre->st)))
+        ebuf.fp = fdopen (pre->fd, "r");
+      if (ebuf.fp != 0)
+        {
+          pre->fd = -1;
+          if (pre->map != 0)
+            {
+              ebuf.buffer = ebuf.bufnext = ebuf.bufstart = pre->map;
+              ebuf.size = pre->st.st_size;
+              ebuf.mapped = 1;
+              pre->map = 0;
+              if (pre->prefix == cmd_prefix)
+                simple = pre->simple;
+            }
+        }
+    }
+  if (ebuf.fp == 0)
+#endif
+    ENULLLOOP (ebuf.fp, fopen (filename, "r"));
 
   /* Save the error code so we print the right message later.  */
   makefile_errno = errno;
@@ -418,6 +632,11 @@ eval_makefile (const char *filename, int flags)
   if (flags & RM_DONTCARE)
     deps->dontcare = 1;
 
+#ifdef SIMPLE_DEPS
+  if (in_process_restart)
+    rec = note_makefile_read (ebuf.floc.filenm, filename, flags);
+#endif
+
   free (expanded);
 
   /* If the makefile can't be found at all, give up entirely.  */
@@ -441,31 +660,239 @@ eval_makefile (const char *filename, int flags)
   do_variable_definition (&ebuf.floc, "MAKEFILE_LIST", filename, o_file,
                           f_append, 0);
 
+#ifdef SIMPLE_DEPS
+  if (rec != 0)
+    {
+      unsigned int len = strlen (lookup_variable ("MAKEFILE_LIST",
+                                                  CSTRLEN ("MAKEFILE_LIST"))
+                                 ->value);
+      if (len != makefile_list_length + 1 + strlen (filename))
+        makefile_list_changed = 1;
+      makefile_list_length = len;
+      rec->found = 1;
+    }
+#endif
+
   if (b_debugger_preread && i_debugger_stepping && !in_debugger) {
       enter_debugger (NULL, NULL, 0, DEBUG_READ_HIT);
   }
 
   /* Evaluate the makefile */
 
-  ebuf.size = 200;
-  ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
+#ifdef MAP_MAKEFILES
+  if (!ebuf.mapped)
+    ebuf.mapped = map_makefile (&ebuf);
+#endif
+  if (!ebuf.mapped)
+    {
+      ebuf.size = 200;
+      ebuf.buffer = ebuf.bufnext = ebuf.bufstart = xmalloc (ebuf.size);
+    }
 
   curfile = reading_file;
   reading_file = &ebuf.floc;
 
-  eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+  if (profiling_parse)
+    profile_parse_enter (&ebuf.floc, 1);
+
+#ifdef SIMPLE_DEPS
+  if (ebuf.mapped && simple < 0)
+    simple = simple_deps_p (ebuf.bufstart, ebuf.size);
+  if (ebuf.mapped && simple)
+    {
+      /* Nothing else is read before eval_simple_deps returns, so REC
+         stays where it is.  */
+      if (rec != 0)
+        rec->simple = 1;
+      current_read = rec;
+      eval_simple_deps (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+      current_read = 0;
+    }
+  else
+#endif
+    {
+#ifdef SIMPLE_DEPS
+      if (rec != 0)
+        rec->unsafe = 1;
+#endif
+      eval (&ebuf, !(flags & RM_NO_DEFAULT_GOAL));
+    }
 
+  if (profiling_parse)
+    profile_parse_leave ();
   reading_file = curfile;
   deps->file->nlines = ebuf.floc.lineno;
 
   fclose (ebuf.fp);
 
-  free (ebuf.bufstart);
+#ifdef MAP_MAKEFILES
+  if (ebuf.mapped)
+    munmap (ebuf.bufstart, ebuf.size + 1);
+  else
+#endif
+    free (ebuf.bufstart);
   alloca (0);
 
   return 1;
 }
 
+/* Return a hash of the string S.  Templates instantiated with different
+   arguments differ in a few bytes, so it has to mix every one of them.
+   This is FNV-1a.  */
+
+static unsigned long
+text_hash (const char *s)
+{
+  const unsigned char *cp;
+  unsigned long hash = 2166136261UL;
+
+  for (cp = (const unsigned char *) s; *cp != '\0'; ++cp)
+    hash = (hash ^ *cp) * 16777619UL;
+
+  return hash;
+}
+
+static unsigned long
+eval_cache_hash_1 (const void *key)
+{
+  return ((const struct eval_cache *) key)->hash;
+}
+
+static unsigned long
+eval_cache_hash_2 (const void *key)
+{
+  unsigned long hash = ((const struct eval_cache *) key)->hash;
+  return hash >> 16 ^ hash >> 7;
+}
+
+static int
+eval_cache_hash_cmp (const void *x, const void *y)
+{
+  const struct eval_cache *cx = x;
+  const struct eval_cache *cy = y;
+
+  if (cx->hash != cy->hash)
+    return cx->hash < cy->hash ? -1 : 1;
+  if (cx->size != cy->size)
+    return cx->size < cy->size ? -1 : 1;
+  if (cx->posix != cy->posix)
+    return cx->posix - cy->posix;
+  /* A buffer seen only once is known by its hash alone.  */
+  if (cx->text == 0 || cy->text == 0)
+    return 0;
+  return memcmp (cx->text, cy->text, cx->size);
+}
+
+/* Return the cached lines of BUFFER, which is SIZE bytes long.  Return NULL
+   if it can't be cached, or if this is the first time it is seen: most
+   buffers are never seen again, and the lines aren't worth keeping for
+   those.  The lines end where readstring would end them.  */
+
+static struct eval_cache *
+find_eval_cache (const char *buffer, unsigned int size)
+{
+  struct eval_cache key;
+  struct eval_cache *ec;
+  struct eval_line *lines;
+  unsigned int nlines = 0;
+  unsigned int maxlines = 8;
+  unsigned int pos = 0;
+  void **slot;
+
+  /* Descriptions in comments are collected as a side effect of removing
+     them, and a byte order mark is only skipped on line 1.  */
+  if (!eval_cache_flag || show_tasks_flag || show_targets_flag
+      || buffer[0] == (char)0xEF)
+    return 0;
+
+  if (eval_cache_table.ht_vec == 0)
+    hash_init (&eval_cache_table, 1009, eval_cache_hash_1, eval_cache_hash_2,
+               eval_cache_hash_cmp);
+
+  key.hash = text_hash (buffer);
+  key.text = (char *) buffer;
+  key.size = size;
+  key.posix = posix_pedantic;
+
+  slot = hash_find_slot (&eval_cache_table, &key);
+  ec = *slot;
+  if (! HASH_VACANT (ec) && ec->text != 0)
+    {
+      ++eval_cache_hits;
+      return ec;
+    }
+
+  ++eval_cache_misses;
+  if (eval_cache_bytes > EVAL_CACHE_MAX)
+    return 0;
+
+  /* The first time, just remember that it was seen.  */
+  if (HASH_VACANT (ec))
+    {
+      ec = xmalloc (sizeof (struct eval_cache));
+      *ec = key;
+      ec->text = 0;
+      ec->nlines = 0;
+      ec->lines = 0;
+      hash_insert_at (&eval_cache_table, ec, slot);
+      eval_cache_bytes += sizeof (struct eval_cache);
+      return 0;
+    }
+
+  lines = xmalloc (maxlines * sizeof (struct eval_line));
+  while (pos < size)
+    {
+      const char *eol = buffer + pos;
+      unsigned int end;
+
+      while (1)
+        {
+          int backslash = 0;
+          const char *bol = eol;
+          const char *p;
+
+          p = eol = strchr (eol, '\n');
+          if (!eol)
+            break;
+
+          while (p > bol && *(--p) == '\\')
+            backslash = !backslash;
+          if (!backslash)
+            break;
+          ++eol;
+        }
+
+      end = eol ? eol - buffer : size;
+      if (nlines == maxlines)
+        {
+          maxlines *= 2;
+          lines = xrealloc (lines, maxlines * sizeof (struct eval_line));
+        }
+      lines[nlines].start = pos;
+      lines[nlines].len = end - pos;
+      lines[nlines].text = 0;
+      ++nlines;
+      pos = end + 1;
+    }
+
+  ec->text = xstrdup (buffer);
+  ec->nlines = nlines;
+  ec->lines = lines;
+  eval_cache_bytes += size + 1 + maxlines * sizeof (struct eval_line);
+
+  return ec;
+}
+
+/* Print the eval_buffer cache statistics.  */
+
+void
+eval_cache_print_stats (const char *prefix)
+{
+  printf (_("\n%s $(eval) cache: %lu buffers / hits = %lu / misses = %lu / storage = %lu B\n"),
+          prefix, eval_cache_table.ht_fill, eval_cache_hits,
+          eval_cache_misses, eval_cache_bytes);
+}
+
 void
 eval_buffer (char *buffer, const gmk_floc *floc)
 {
@@ -479,6 +906,10 @@ eval_buffer (char *buffer, const gmk_floc *floc)
   ebuf.size = strlen (buffer);
   ebuf.buffer = ebuf.bufnext = ebuf.bufstart = buffer;
   ebuf.fp = NULL;
+  ebuf.mapped = 0;
+  ebuf.cache = find_eval_cache (buffer, ebuf.size);
+  ebuf.line = 0;
+  ebuf.iline = 0;
 
   if (floc)
     ebuf.floc = *floc;
@@ -495,7 +926,11 @@ eval_buffer (char *buffer, const gmk_floc *floc)
 
   saved = install_conditionals (&new);
 
+  if (profiling_parse)
+    profile_parse_enter (&ebuf.floc, 0);
   eval (&ebuf, 1);
+  if (profiling_parse)
+    profile_parse_leave ();
 
   restore_conditionals (saved);
 
@@ -686,6 +1121,9 @@ eval (struct ebuffer *ebuf, int set_default)
       if (nlines < 0)
         break;
 
+      if (profiling_parse)
+        profile_parse_line (fstart);
+
       line = ebuf->buffer;
 
       /* If this is the first line, check for a UTF-8 BOM and skip it.  */
@@ -755,20 +1193,42 @@ eval (struct ebuffer *ebuf, int set_default)
           /* Don't need xrealloc: we don't need to preserve the content.  */
           collapsed = xmalloc (collapsed_length);
         }
-      strcpy (collapsed, line);
-      /* Collapse continuation lines.  */
-      collapse_continuations (collapsed);
-      remove_comments (collapsed, &target_description,
-		       &prev_target_description, ebuf->floc.lineno);
 
-      /* Get rid if starting space (including formfeed, vtab, etc.)  */
-      p = collapsed;
-      while (isspace ((unsigned char)*p))
-        ++p;
+      /* If this line was seen before, start from where it got to then.  */
+      if (ebuf->line != 0 && ebuf->line->text != 0)
+        {
+          strcpy (collapsed, ebuf->line->text);
+          p = collapsed + ebuf->line->assign;
+          vmod = ebuf->line->vmod;
+        }
+      else
+        {
+          char *start;
+
+          strcpy (collapsed, line);
+          /* Collapse continuation lines.  */
+          collapse_continuations (collapsed);
+          remove_comments (collapsed, &target_description,
+                           &prev_target_description, ebuf->floc.lineno);
+
+          /* Get rid if starting space (including formfeed, vtab, etc.)  */
+          start = collapsed;
+          while (isspace ((unsigned char)*start))
+            ++start;
+
+          /* See if this is a variable assignment.  We need to do this early,
+             to allow variables with names like 'ifdef', 'export', 'private',
+             etc.  */
+          p = parse_var_assignment (start, &vmod);
 
-      /* See if this is a variable assignment.  We need to do this early, to
-         allow variables with names like 'ifdef', 'export', 'private', etc.  */
-      p = parse_var_assignment (p, &vmod);
+          if (ebuf->line != 0)
+            {
+              ebuf->line->text = xstrdup (start);
+              ebuf->line->assign = p - start;
+              ebuf->line->vmod = vmod;
+              eval_cache_bytes += strlen (start) + 1;
+            }
+        }
       if (vmod.assign_v)
         {
           struct variable *v;
@@ -870,6 +1330,8 @@ eval (struct ebuffer *ebuf, int set_default)
                   if (v == 0)
                     v = define_variable_global (p, l, "", o_file, 0, fstart);
                   v->export = exporting ? v_export : v_noexport;
+                  /* The environment of jobs may change.  */
+                  ++variable_generation;
                 }
 
               free (ap);
@@ -916,6 +1378,11 @@ eval (struct ebuffer *ebuf, int set_default)
           /* "-include" (vs "include") says no error if the file does not
              exist.  "sinclude" is an alias for this from SGI.  */
           int noerror = (p[0] != 'i');
+#ifdef PARALLEL_INCLUDE
+          struct preload *preloads = 0;
+          unsigned int npreloads = 0;
+          unsigned int ipreload = 0;
+#endif
 
           /* Include ends the previous rule.  */
           record_waiting_files ();
@@ -950,6 +1417,18 @@ eval (struct ebuffer *ebuf, int set_default)
               const char *name = files->name;
               int r;
 
+#ifdef PARALLEL_INCLUDE
+              /* Open the next few files in the list all at once.  */
+              if (ipreload == npreloads && parallel_include > 1 && next != 0)
+                {
+                  free_preloads (preloads, npreloads);
+                  preloads = preload_makefiles (files, &npreloads);
+                  ipreload = 0;
+                }
+              if (ipreload < npreloads)
+                next_preload = &preloads[ipreload++];
+#endif
+
               free_ns (files);
               files = next;
 
@@ -964,6 +1443,10 @@ eval (struct ebuffer *ebuf, int set_default)
                 }
             }
 
+#ifdef PARALLEL_INCLUDE
+          free_preloads (preloads, npreloads);
+#endif
+
           /* Restore conditional state.  */
           restore_conditionals (save);
 
@@ -1368,64 +1851,8 @@ eval (struct ebuffer *ebuf, int set_default)
            evaluated the .DEFAULT_GOAL does not contain foo yet as one
            would expect. Because of this we have to move the logic here.  */
 
-        if (set_default && default_goal_var->value[0] == '\0')
-          {
-            struct dep *d;
-            struct nameseq *t = filenames;
-
-            for (; t != 0; t = t->next)
-              {
-                int reject = 0;
-                const char *name = t->name;
-
-                /* We have nothing to do if this is an implicit rule. */
-                if (strchr (name, '%') != 0)
-                  break;
-
-                /* See if this target's name does not start with a '.',
-                   unless it contains a slash.  */
-                if (*name == '.' && strchr (name, '/') == 0
-#ifdef HAVE_DOS_PATHS
-                    && strchr (name, '\\') == 0
-#endif
-                    )
-                  continue;
-
-
-                /* If this file is a suffix, don't let it be
-                   the default goal file.  */
-                for (d = suffix_file->deps; d != 0; d = d->next)
-                  {
-                    register struct dep *d2;
-                    if (*dep_name (d) != '.' && streq (name, dep_name (d)))
-                      {
-                        reject = 1;
-                        break;
-                      }
-                    for (d2 = suffix_file->deps; d2 != 0; d2 = d2->next)
-                      {
-                        unsigned int l = strlen (dep_name (d2));
-                        if (!strneq (name, dep_name (d2), l))
-                          continue;
-                        if (streq (name + l, dep_name (d)))
-                          {
-                            reject = 1;
-                            break;
-                          }
-                      }
-
-                    if (reject)
-                      break;
-                  }
-
-                if (!reject)
-                  {
-                    define_variable_global (".DEFAULT_GOAL", 13, t->name,
-                                            o_file, 0, NILF);
-                    break;
-                  }
-              }
-          }
+        if (set_default)
+          check_default_goal (filenames);
 
         continue;
       }
@@ -1449,86 +1876,1007 @@ eval (struct ebuffer *ebuf, int set_default)
 }
 
 
-/* Remove comments from LINE.
-   This is done by copying the text at LINE onto itself.  */
+#ifdef SIMPLE_DEPS
+/* Compiler-generated dependency files consist of nothing but lines like
 
-static void
-remove_comments (char *line, char **target_description,
-                 char **prev_target_description, unsigned long lineno)
-{
-  char *comment;
+     foo.o: foo.c foo.h \
+       bar.h
 
-  comment = find_char_unquote (line, MAP_COMMENT);
+   These don't need most of what eval does, so if a mapped makefile is known
+   to contain nothing else, eval_simple_deps reads it.
 
-  if (comment != 0) {
-    if (show_tasks_flag || show_targets_flag) {
-      if (0 == strncmp(comment, "#: ", 3) && target_description) {
-	  *prev_target_description = *target_description;
-	  prev_target_description_lineno = target_description_lineno;
-	  *target_description = xstrdup(&comment[3]);
-	  target_description_lineno = lineno;
-      }
-    }
-    /* Cut off the line at the #.  */
-    *comment = '\0';
-  }
-}
+   Return nonzero if the SIZE bytes at BUF are only such lines: one colon
+   with some text before it on each non-blank line, no recipes, and nothing
+   that could be a variable reference, assignment, comment, quote, wildcard,
+   archive member, pattern or directive.  */
 
-/* Execute a 'undefine' directive.
-   The undefine line has already been read, and NAME is the name of
-   the variable to be undefined. */
+/* Characters that rule a file out.  */
+static char simple_deps_bad[UCHAR_MAX + 1];
 
 static void
-do_undefine (char *name, enum variable_origin origin, struct ebuffer *ebuf)
+init_simple_deps (void)
 {
-  char *p, *var;
+  const char *c;
 
-  /* Expand the variable name and find the beginning (NAME) and end.  */
-  var = allocated_variable_expand (name);
-  name = next_token (var);
-  if (*name == '\0')
-    O (fatal, &ebuf->floc, _("empty variable name"));
-  p = name + strlen (name) - 1;
-  while (p > name && isblank ((unsigned char)*p))
-    --p;
-  p[1] = '\0';
+  if (simple_deps_bad[0] != 0)
+    return;
 
-  undefine_variable_global (name, p - name + 1, origin);
-  free (var);
+  for (c = "$=;#%|()'\"`*?[]{}~\t\r\v\f"; *c != '\0'; ++c)
+    simple_deps_bad[(unsigned char) *c] = 1;
+  simple_deps_bad[0] = 1;
 }
 
-/* Execute a 'define' directive.
-   The first line has already been read, and NAME is the name of
-   the variable to be defined.  The following lines remain to be read.  */
-
-static struct variable *
-do_define (char *name, enum variable_origin origin, struct ebuffer *ebuf)
+static int
+simple_deps_p (const char *buf, unsigned int size)
 {
-  struct variable *v;
-  struct variable var;
-  gmk_floc defstart;
-  int nlevels = 1;
-  unsigned int length = 100;
-  char *definition = xmalloc (length);
-  unsigned int idx = 0;
-  char *p, *n;
+  static const char *const directives[] =
+    {
+      "define", "else", "endef", "endif", "export", "ifdef", "ifeq",
+      "ifndef", "ifneq", "include", "-include", "load", "-load",
+      "override", "private", "sinclude", "undefine", "unexport", "vpath",
+      0
+    };
+  const char *p = buf;
+  const char *end = buf + size;
+  int colons = 0;
+  int words = 0;
+
+  /* Any other recipe prefix might start an ordinary-looking line.  */
+  if (cmd_prefix != '\t')
+    return 0;
+
+  init_simple_deps ();
+
+  for (; p < end; ++p)
+    {
+      unsigned char c = *p;
 
-  defstart = ebuf->floc;
+      if (simple_deps_bad[c])
+        return 0;
 
-  p = parse_variable_definition (name, &var);
-  if (p == NULL)
-    /* No assignment token, so assume recursive.  */
-    var.flavor = f_recursive;
-  else
-    {
-      if (var.value[0] != '\0')
-        O (error, &defstart, _("extraneous text after 'define' directive"));
+      switch (c)
+        {
+        case '\\':
+          /* Only a backslash/newline is allowed.  */
+          if (p + 1 == end || p[1] != '\n')
+            return 0;
+          ++p;
+          break;
 
-      /* Chop the string before the assignment token to get the name.  */
-      var.name[var.length] = '\0';
-    }
+        case '\n':
+          if (words != colons)
+            return 0;
+          words = colons = 0;
+          break;
 
-  /* Expand the variable name and find the beginning (NAME) and end.  */
+        case ':':
+          if (words == 0 || ++colons > 1)
+            return 0;
+          break;
+
+        case ' ':
+          break;
+
+        default:
+          if (words == 0)
+            {
+              /* The first word of a line: a recipe, a directive or a
+                 UTF-8 byte order mark need eval.  */
+              const char *const *d;
+              const char *e = p;
+
+              if (p == buf || p[-1] == '\n')
+                if (c == (unsigned char) cmd_prefix || c == 0xEF)
+                  return 0;
+
+              while (e < end && *e != ' ' && *e != ':' && *e != '\n'
+                     && *e != '\\')
+                ++e;
+              for (d = directives; *d != 0; ++d)
+                if (strlen (*d) == (size_t) (e - p) && strneq (*d, p, e - p))
+                  return 0;
+              words = 1;
+            }
+        }
+    }
+
+  return words == colons;
+}
+
+/* Read the next line of the mapped makefile in EBUF, known to pass
+   simple_deps_p.  Return its targets and set *DEPSTRP to a copy of its
+   prerequisites, or NULL if there are none; return NULL at the end of the
+   file.  *NLINESP holds the number of lines in the previous one.  */
+
+static struct nameseq *
+read_simple_dep (struct ebuffer *ebuf, long *nlinesp, char **depstrp)
+{
+  while (1)
+    {
+      struct nameseq *filenames;
+      const char *beg;
+      const char *end;
+      char *colonp;
+      char *p;
+
+      ebuf->floc.lineno += *nlinesp;
+      *nlinesp = readline (ebuf);
+      if (*nlinesp < 0)
+        return 0;
+
+      p = next_token (ebuf->buffer);
+      if (*p == '\0')
+        continue;
+
+      collapse_continuations (p);
+
+      colonp = strchr (p, ':');
+      *colonp = '\0';
+      /* There are no wildcards or archive members to look for.  */
+      filenames = PARSE_FILE_SEQ (&p, struct nameseq, MAP_NUL, NULL,
+                                  PARSEFS_NOGLOB|PARSEFS_NOAR);
+      if (filenames == 0)
+        continue;
+
+      beg = colonp + 1;
+      end = beg + strlen (beg) - 1;
+      strip_whitespace (&beg, &end);
+      if (beg <= end && *beg != '\0')
+        *depstrp = xstrndup (beg, end - beg + 1);
+      else
+        *depstrp = 0;
+
+      return filenames;
+    }
+}
+
+/* Read the mapped makefile in EBUF, known to pass simple_deps_p, and record
+   its rules.  This does what eval would do with the same lines.  */
+
+static void
+eval_simple_deps (struct ebuffer *ebuf, int set_default)
+{
+  gmk_floc fi;
+  long nlines = 0;
+  struct nameseq *filenames;
+  char *depstr;
+
+  fi.filenm = ebuf->floc.filenm;
+
+  while ((filenames = read_simple_dep (ebuf, &nlines, &depstr)) != 0)
+    {
+      unsigned int ndeps = 0;
+
+      if (set_default)
+        check_default_goal (filenames);
+
+      fi.lineno = ebuf->floc.lineno;
+
+      if (current_read != 0)
+        {
+          const char *p = depstr;
+          while (p != 0 && find_next_token (&p, 0) != 0)
+            ++ndeps;
+          note_deps_targets (current_read, filenames, fi.lineno);
+        }
+
+      record_files (filenames, 0, 0, depstr, fi.lineno, 0, 0, 0, NULL,
+                    cmd_prefix, &fi);
+
+      if (current_read != 0)
+        count_deps_targets (current_read, fi.lineno, ndeps);
+    }
+}
+
+
+/* Remember that the makefile NAME, found as PATH or not found at all, is
+   being read with FLAGS.  */
+
+static struct makefile_read *
+note_makefile_read (const char *name, const char *path, int flags)
+{
+  struct makefile_read *rec;
+
+  if (nmakefiles_read == maxmakefiles_read)
+    {
+      maxmakefiles_read = maxmakefiles_read ? maxmakefiles_read * 2 : 64;
+      makefiles_read = xrealloc (makefiles_read,
+                                 maxmakefiles_read * sizeof (*makefiles_read));
+    }
+
+  rec = &makefiles_read[nmakefiles_read++];
+  memset (rec, '\0', sizeof (*rec));
+  rec->name = name;
+  rec->path = path;
+  rec->list_offset = makefile_list_length;
+
+  /* Only included files are read again in place.  One that could choose the
+     default goal might choose another one next time.  */
+  if (!(flags & RM_INCLUDED) || second_expansion
+      || (!(flags & RM_NO_DEFAULT_GOAL)
+          && default_goal_var->value[0] == '\0'))
+    rec->unsafe = 1;
+
+  return rec;
+}
+
+/* Return the entry for FILE among the targets of REC, or NULL.  */
+
+static struct deps_target *
+find_deps_target (const struct makefile_read *rec, const struct file *file)
+{
+  unsigned int i;
+
+  for (i = 0; i < rec->ntargets; ++i)
+    if (rec->targets[i].file == file)
+      return &rec->targets[i];
+
+  return 0;
+}
+
+/* Note the targets FILENAMES of the line at LINENO of the makefile REC,
+   before record_files adds their prerequisites.  */
+
+static void
+note_deps_targets (struct makefile_read *rec, const struct nameseq *filenames,
+                   unsigned long lineno)
+{
+  for (; filenames != 0; filenames = filenames->next)
+    {
+      struct file *f = lookup_file (filenames->name);
+      struct deps_target *t;
+      int was_target = f != 0 && f->is_target;
+
+      /* Special targets do more than add prerequisites.  */
+      if (filenames->name[0] == '.')
+        rec->unsafe = 1;
+
+      /* record_files would enter it anyway.  */
+      if (f == 0)
+        f = enter_file (filenames->name);
+
+      t = find_deps_target (rec, f);
+      if (t != 0)
+        {
+          /* The same target twice on one line gets its prerequisites
+             twice; don't bother keeping track of that.  */
+          if (t->lineno == lineno)
+            rec->unsafe = 1;
+          t->lineno = lineno;
+          continue;
+        }
+
+      if (rec->ntargets == rec->maxtargets)
+        {
+          rec->maxtargets = rec->maxtargets ? rec->maxtargets * 2 : 8;
+          rec->targets = xrealloc (rec->targets,
+                                   rec->maxtargets * sizeof (*rec->targets));
+        }
+      t = &rec->targets[rec->ntargets++];
+      t->file = f;
+      t->deps = 0;
+      t->count = 0;
+      t->lineno = lineno;
+      t->was_target = was_target;
+    }
+}
+
+/* Note where the NDEPS prerequisites that record_files gave each target on
+   the line at LINENO of REC are.  A rule without a recipe adds them at the
+   end, and all those a dependency file gives a target follow each other.  */
+
+static void
+count_deps_targets (struct makefile_read *rec, unsigned long lineno,
+                    unsigned int ndeps)
+{
+  unsigned int i;
+
+  if (ndeps == 0)
+    return;
+
+  for (i = 0; i < rec->ntargets; ++i)
+    {
+      struct deps_target *t = &rec->targets[i];
+      struct dep *d;
+      unsigned int n = 0;
+
+      if (t->lineno != lineno)
+        continue;
+
+      if (t->count > 0)
+        {
+          t->count += ndeps;
+          continue;
+        }
+
+      for (d = t->file->deps; d != 0; d = d->next)
+        ++n;
+      for (d = t->file->deps; n > ndeps; d = d->next)
+        --n;
+      t->deps = d;
+      t->count = ndeps;
+    }
+}
+
+/* Return the link that points to the COUNT prerequisites of F starting with
+   FIRST, or NULL if they are not all there any more.  */
+
+static struct dep **
+find_deps_run (struct file *f, struct dep *first, unsigned int count)
+{
+  struct dep **link;
+  struct dep *d;
+
+  for (link = &f->deps; *link != 0; link = &(*link)->next)
+    if (*link == first)
+      break;
+
+  for (d = *link; d != 0 && count > 1; d = d->next)
+    --count;
+
+  return d != 0 ? link : 0;
+}
+
+/* Return nonzero if FILENM is the name of the makefile REC.  */
+
+static int
+same_makefile_p (const char *filenm, const struct makefile_read *rec)
+{
+  return filenm == rec->name || (filenm != 0 && streq (filenm, rec->name));
+}
+
+/* Return nonzero if every makefile named FILENM was read before REC.  */
+
+static int
+read_before_p (const char *filenm, const struct makefile_read *rec)
+{
+  const struct makefile_read *r;
+  int found = 0;
+
+  for (r = makefiles_read; r < makefiles_read + nmakefiles_read; ++r)
+    if (same_makefile_p (filenm, r))
+      {
+        if (r >= rec)
+          return 0;
+        found = 1;
+      }
+
+  return found;
+}
+
+/* The state of one target while a makefile is read again in place.  */
+
+struct reread_target
+  {
+    const char *name;
+    struct file *file;          /* Its file, if there is one yet.  */
+    struct deps_target *old;    /* What it was given before, or NULL.  */
+    struct dep *deps;           /* The prerequisites it is given now.  */
+    struct dep *last;
+    unsigned long lineno;       /* The last line it is a target on.  */
+    unsigned int was_target:1;
+    unsigned int has_deps:1;    /* Nonzero if it is given any now.  */
+    unsigned int later:1;       /* Nonzero if a later makefile names it.  */
+  };
+
+/* One line of a makefile read again in place.  */
+
+struct reread_line
+  {
+    struct nameseq *targets;
+    struct dep *deps;
+    unsigned long lineno;
+  };
+
+static int
+ptr_cmp (const void *a, const void *b)
+{
+  const char *x = *(const char * const *) a;
+  const char *y = *(const char * const *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Arguments of find_dep_references.  */
+
+struct dep_references
+  {
+    const struct makefile_read *rec;
+    const struct file **files;  /* Sorted, NULLed out once found.  */
+    unsigned int nfiles;
+  };
+
+/* Look for the files in ARG among the prerequisites of ITEM, apart from the
+   ones the makefile being read again gave it.  */
+
+static void
+find_dep_references (const void *item, void *arg)
+{
+  const struct file *f = item;
+  struct dep_references *refs = arg;
+  const struct deps_target *t = find_deps_target (refs->rec, f);
+  const struct dep *d;
+  unsigned int skip = 0;
+
+  for (d = f->deps; d != 0; d = d->next)
+    {
+      const struct file **found;
+
+      if (t != 0 && d == t->deps)
+        skip = t->count;
+      if (skip > 0)
+        {
+          --skip;
+          continue;
+        }
+
+      found = bsearch (&d->file, refs->files, refs->nfiles,
+                       sizeof (*refs->files), ptr_cmp);
+      if (found != 0)
+        *found = 0;
+    }
+}
+
+/* Read the makefile D again after it has been remade, as make would if it
+   started over, but changing only what that makefile added to the data
+   base.  This is only possible if it was and still is a dependency file
+   read by eval_simple_deps, and what it adds can be put exactly where a
+   fresh start would put it.  Return nonzero if it was read; otherwise the
+   data base may be half updated, and make must start over.  */
+
+int
+reread_makefile (struct dep *d)
+{
+  struct makefile_read *rec = 0;
+  struct makefile_read *r;
+  struct ebuffer ebuf;
+  const gmk_floc *curfile;
+  struct reread_line *lines = 0;
+  unsigned int nlines = 0;
+  unsigned int maxlines = 0;
+  struct reread_target *targets = 0;
+  unsigned int ntargets = 0;
+  unsigned int maxtargets = 0;
+  const char **names = 0;
+  unsigned int nnames = 0;
+  const struct file **orphans = 0;
+  unsigned int norphans = 0;
+  struct deps_target *newtargets;
+  struct variable *list;
+  struct nameseq *ns;
+  char *depstr;
+  long n = 0;
+  unsigned int i, j;
+  int ok = 0;
+
+  for (r = makefiles_read; r < makefiles_read + nmakefiles_read; ++r)
+    if (r->path == d->file->name)
+      {
+        /* It could have been read twice, under different names.  */
+        if (rec != 0)
+          return 0;
+        rec = r;
+      }
+
+  if (rec == 0 || rec->unsafe || second_expansion)
+    return 0;
+
+  /* .SECONDARY without prerequisites applies to files that are new.  */
+  {
+    struct file *f = lookup_file (".SECONDARY");
+    if (f != 0 && f->is_target && f->deps == 0)
+      return 0;
+  }
+
+  DB (DB_BASIC, (_("Reading makefile '%s' again in place...\n"), rec->path));
+
+  ebuf.fp = fopen (rec->path, "r");
+  if (ebuf.fp == 0)
+    return 0;
+  ebuf.floc.filenm = rec->name;
+  ebuf.floc.lineno = 1;
+  ebuf.cache = 0;
+  ebuf.line = 0;
+  ebuf.mapped = map_makefile (&ebuf);
+  if (!ebuf.mapped || !simple_deps_p (ebuf.bufstart, ebuf.size))
+    goto done;
+
+  /* Read its lines.  Nothing in the data base changes yet.  */
+  curfile = reading_file;
+  reading_file = &ebuf.floc;
+  while ((ns = read_simple_dep (&ebuf, &n, &depstr)) != 0)
+    {
+      if (nlines == maxlines)
+        {
+          maxlines = maxlines ? maxlines * 2 : 64;
+          lines = xrealloc (lines, maxlines * sizeof (*lines));
+        }
+      lines[nlines].targets = ns;
+      lines[nlines].deps = depstr != 0 ? split_prereqs (depstr) : 0;
+      lines[nlines].lineno = ebuf.floc.lineno;
+      free (depstr);
+
+      for (; ns != 0; ns = ns->next)
+        {
+          struct reread_target *t = 0;
+
+          for (j = 0; j < ntargets; ++j)
+            if (targets[j].name == ns->name)
+              t = &targets[j];
+          if (t == 0)
+            {
+              if (ntargets == maxtargets)
+                {
+                  maxtargets = maxtargets ? maxtargets * 2 : 16;
+                  targets = xrealloc (targets,
+                                      maxtargets * sizeof (*targets));
+                }
+              t = &targets[ntargets++];
+              memset (t, '\0', sizeof (*t));
+              t->name = ns->name;
+            }
+          t->lineno = ebuf.floc.lineno;
+          if (lines[nlines].deps != 0)
+            t->has_deps = 1;
+        }
+      ++nlines;
+    }
+  reading_file = curfile;
+
+  /* Make sure each target's prerequisites can go where a fresh start would
+   put them: in place of those it had from this makefile, or at the end if
+   no makefile read after this one gave it any.  */
+  for (i = 0; i < ntargets; ++i)
+    {
+      struct reread_target *t = &targets[i];
+      struct file *f = lookup_file (t->name);
+
+      if (t->name[0] == '.')
+        goto done;
+      t->file = f;
+      if (f == 0)
+        continue;
+      t->was_target = f->is_target;
+      t->old = find_deps_target (rec, f);
+
+      /* A file already looked at while remaking the makefiles would have
+         to be looked at again.  The makefile itself was just remade.  */
+      if (f->double_colon
+          || (f != d->file && (f->command_state != cs_not_started
+                               || f->tried_implicit || f->updated)))
+        goto done;
+
+      t->later = (f->floc.filenm != 0
+                  && !same_makefile_p (f->floc.filenm, rec)
+                  && !read_before_p (f->floc.filenm, rec));
+      if (t->old != 0 && t->old->count > 0)
+        {
+          if (find_deps_run (f, t->old->deps, t->old->count) == 0)
+            goto done;
+        }
+      else if (t->has_deps
+               && (t->later || (f->floc.filenm == 0 && f->deps != 0)))
+        goto done;
+    }
+
+  /* A target that is gone must not have been one before this makefile made
+   it one, nor after.  */
+  for (i = 0; i < rec->ntargets; ++i)
+    {
+      struct deps_target *old = &rec->targets[i];
+      struct file *f = old->file;
+
+      for (j = 0; j < ntargets; ++j)
+        if (targets[j].old == old)
+          break;
+      if (j < ntargets)
+        continue;
+
+      if (old->was_target || !same_makefile_p (f->floc.filenm, rec)
+          || (f != d->file && (f->command_state != cs_not_started
+                               || f->tried_implicit || f->updated))
+          || (old->count > 0 && find_deps_run (f, old->deps, old->count) == 0))
+        goto done;
+    }
+
+  /* A fresh start would not know about files only this makefile mentioned,
+   if it no longer does.  Find those that nothing else mentions.  */
+  nnames = ntargets;
+  for (i = 0; i < nlines; ++i)
+    {
+      struct dep *dp;
+      for (dp = lines[i].deps; dp != 0; dp = dp->next)
+        ++nnames;
+    }
+  names = xmalloc ((nnames + 1) * sizeof (*names));
+  nnames = 0;
+  for (i = 0; i < ntargets; ++i)
+    names[nnames++] = targets[i].name;
+  for (i = 0; i < nlines; ++i)
+    {
+      struct dep *dp;
+      for (dp = lines[i].deps; dp != 0; dp = dp->next)
+        names[nnames++] = dp->name;
+    }
+  qsort (names, nnames, sizeof (*names), ptr_cmp);
+
+  for (i = 0; i < rec->ntargets; ++i)
+    {
+      struct deps_target *old = &rec->targets[i];
+      struct dep *dp = old->deps;
+      unsigned int k;
+
+      /* A target that is gone, then its old prerequisites.  */
+      for (k = 0; k <= old->count; ++k)
+        {
+          struct file *f = k == 0 ? old->file : dp->file;
+          int gone = 0;
+
+          if (k > 0)
+            dp = dp->next;
+
+          if (bsearch (&f->name, names, nnames, sizeof (*names), ptr_cmp))
+            continue;
+
+          for (j = 0; j < rec->ntargets; ++j)
+            if (rec->targets[j].file == f)
+              {
+                gone = 1;
+                break;
+              }
+          if ((f->is_target || f->deps != 0) && !gone)
+            continue;
+
+          orphans = xrealloc (orphans, (norphans + 1) * sizeof (*orphans));
+          orphans[norphans++] = f;
+        }
+    }
+
+  if (norphans > 0)
+    {
+      struct dep_references refs;
+
+      qsort (orphans, norphans, sizeof (*orphans), ptr_cmp);
+      for (i = 1, j = 1; i < norphans; ++i)
+        if (orphans[i] != orphans[j - 1])
+          orphans[j++] = orphans[i];
+      norphans = j;
+
+      refs.rec = rec;
+      refs.files = orphans;
+      refs.nfiles = norphans;
+      map_files (find_dep_references, &refs);
+      for (i = 0; i < norphans; ++i)
+        if (orphans[i] != 0)
+          goto done;
+    }
+
+  /* A makefile that wasn't there before goes into MAKEFILE_LIST where it
+   would have been.  */
+  list = lookup_variable ("MAKEFILE_LIST", CSTRLEN ("MAKEFILE_LIST"));
+  if (!rec->found
+      && (makefile_list_changed || list == 0
+          || strlen (list->value) != makefile_list_length))
+    goto done;
+
+  /* It can be done.  Give each target its new prerequisites, as
+   record_files would.  */
+  for (i = 0; i < nlines; ++i)
+    {
+      struct dep *deps = enter_prereqs (lines[i].deps, NULL);
+
+      lines[i].deps = 0;
+      for (ns = lines[i].targets; ns != 0; ns = ns->next)
+        {
+          struct reread_target *t = 0;
+          struct dep *this;
+
+          for (j = 0; j < ntargets; ++j)
+            if (targets[j].name == ns->name)
+              t = &targets[j];
+
+          this = ns->next != 0 ? copy_dep_chain (deps) : deps;
+          if (this == 0)
+            continue;
+          if (t->deps == 0)
+            t->deps = this;
+          else
+            t->last->next = this;
+          for (t->last = this; t->last->next != 0; t->last = t->last->next)
+            ;
+        }
+    }
+
+  newtargets = xmalloc ((ntargets + 1) * sizeof (*newtargets));
+  for (i = 0; i < ntargets; ++i)
+    {
+      struct reread_target *t = &targets[i];
+      struct file *f = t->file;
+      struct deps_target *nt = &newtargets[i];
+      struct dep **link;
+
+      if (f == 0)
+        f = enter_file (t->name);
+
+      if (t->old != 0 && t->old->count > 0)
+        {
+          struct dep *rest;
+
+          link = find_deps_run (f, t->old->deps, t->old->count);
+          for (rest = *link, j = 0; j < t->old->count; ++j)
+            {
+              struct dep *next = rest->next;
+              free_dep (rest);
+              rest = next;
+            }
+          if (t->deps != 0)
+            t->last->next = rest;
+          else
+            t->deps = rest;
+          *link = t->deps;
+        }
+      else
+        {
+          for (link = &f->deps; *link != 0; link = &(*link)->next)
+            ;
+          *link = t->deps;
+        }
+
+      if (!t->later)
+        {
+          f->floc.filenm = rec->name;
+          f->floc.lineno = t->lineno;
+          f->description = 0;
+        }
+      f->is_target = 1;
+
+      nt->file = f;
+      nt->deps = t->deps;
+      nt->count = 0;
+      if (t->last != 0)
+        {
+          struct dep *dp;
+          for (dp = t->deps, nt->count = 1; dp != t->last; dp = dp->next)
+            ++nt->count;
+        }
+      else
+        nt->deps = 0;
+      nt->lineno = t->lineno;
+      nt->was_target = t->old != 0 ? t->old->was_target : t->was_target;
+    }
+
+  /* Take away what is gone.  */
+  for (i = 0; i < rec->ntargets; ++i)
+    {
+      struct deps_target *old = &rec->targets[i];
+      struct file *f = old->file;
+
+      for (j = 0; j < ntargets; ++j)
+        if (targets[j].old == old)
+          break;
+      if (j < ntargets)
+        continue;
+
+      if (old->count > 0)
+        {
+          struct dep **link = find_deps_run (f, old->deps, old->count);
+          struct dep *rest = *link;
+
+          for (j = 0; j < old->count; ++j)
+            {
+              struct dep *next = rest->next;
+              free_dep (rest);
+              rest = next;
+            }
+          *link = rest;
+        }
+      f->is_target = f->phony;
+      f->floc.filenm = 0;
+      f->floc.lineno = 0;
+      f->description = 0;
+    }
+
+  if (!rec->found)
+    {
+      unsigned int len = strlen (rec->path);
+      char *value = xmalloc (makefile_list_length + len + 2);
+
+      memcpy (value, list->value, rec->list_offset);
+      value[rec->list_offset] = ' ';
+      memcpy (value + rec->list_offset + 1, rec->path, len);
+      strcpy (value + rec->list_offset + 1 + len,
+              list->value + rec->list_offset);
+      forget_expansion (list);
+      free (list->value);
+      list->value = value;
+      ++variable_generation;
+
+      makefile_list_length += len + 1;
+      for (r = rec + 1; r < makefiles_read + nmakefiles_read; ++r)
+        r->list_offset += len + 1;
+      rec->found = 1;
+    }
+
+  free (rec->targets);
+  rec->targets = newtargets;
+  rec->ntargets = rec->maxtargets = ntargets;
+  rec->simple = 1;
+  d->file->nlines = ebuf.floc.lineno;
+  ok = 1;
+
+ done:
+  for (i = 0; i < nlines; ++i)
+    {
+      free_ns_chain (lines[i].targets);
+      free_dep_chain (lines[i].deps);
+    }
+  free (lines);
+  free (targets);
+  free (names);
+  free (orphans);
+
+  fclose (ebuf.fp);
+  if (ebuf.mapped)
+    munmap (ebuf.bufstart, ebuf.size + 1);
+
+  return ok;
+}
+#endif /* SIMPLE_DEPS */
+
+#ifndef SIMPLE_DEPS
+int
+reread_makefile (struct dep *d UNUSED)
+{
+  return 0;
+}
+#endif
+
+/* If no default goal has been chosen yet, make it the first of the targets
+   FILENAMES that is eligible.  */
+
+static void
+check_default_goal (const struct nameseq *filenames)
+{
+  struct dep *d;
+  const struct nameseq *t = filenames;
+
+  if (default_goal_var->value[0] != '\0')
+    return;
+
+  for (; t != 0; t = t->next)
+    {
+      int reject = 0;
+      const char *name = t->name;
+
+      /* We have nothing to do if this is an implicit rule. */
+      if (strchr (name, '%') != 0)
+        break;
+
+      /* See if this target's name does not start with a '.',
+         unless it contains a slash.  */
+      if (*name == '.' && strchr (name, '/') == 0
+#ifdef HAVE_DOS_PATHS
+          && strchr (name, '\\') == 0
+#endif
+          )
+        continue;
+
+
+      /* If this file is a suffix, don't let it be
+         the default goal file.  */
+      for (d = suffix_file->deps; d != 0; d = d->next)
+        {
+          register struct dep *d2;
+          if (*dep_name (d) != '.' && streq (name, dep_name (d)))
+            {
+              reject = 1;
+              break;
+            }
+          for (d2 = suffix_file->deps; d2 != 0; d2 = d2->next)
+            {
+              unsigned int l = strlen (dep_name (d2));
+              if (!strneq (name, dep_name (d2), l))
+                continue;
+              if (streq (name + l, dep_name (d)))
+                {
+                  reject = 1;
+                  break;
+                }
+            }
+
+          if (reject)
+            break;
+        }
+
+      if (!reject)
+        {
+          define_variable_global (".DEFAULT_GOAL", 13, t->name,
+                                  o_file, 0, NILF);
+          break;
+        }
+    }
+}
+
+/* Remove comments from LINE.
+   This is done by copying the text at LINE onto itself.  */
+
+static void
+remove_comments (char *line, char **target_description,
+                 char **prev_target_description, unsigned long lineno)
+{
+  char *comment;
+
+  comment = find_char_unquote (line, MAP_COMMENT);
+
+  if (comment != 0) {
+    if (show_tasks_flag || show_targets_flag) {
+      if (0 == strncmp(comment, "#: ", 3) && target_description) {
+	  *prev_target_description = *target_description;
+	  prev_target_description_lineno = target_description_lineno;
+	  *target_description = xstrdup(&comment[3]);
+	  target_description_lineno = lineno;
+      }
+    }
+    /* Cut off the line at the #.  */
+    *comment = '\0';
+  }
+}
+
+/* Execute a 'undefine' directive.
+   The undefine line has already been read, and NAME is the name of
+   the variable to be undefined. */
+
+static void
+do_undefine (char *name, enum variable_origin origin, struct ebuffer *ebuf)
+{
+  char *p, *var;
+
+  /* Expand the variable name and find the beginning (NAME) and end.  */
+  var = allocated_variable_expand (name);
+  name = next_token (var);
+  if (*name == '\0')
+    O (fatal, &ebuf->floc, _("empty variable name"));
+  p = name + strlen (name) - 1;
+  while (p > name && isblank ((unsigned char)*p))
+    --p;
+  p[1] = '\0';
+
+  undefine_variable_global (name, p - name + 1, origin);
+  free (var);
+}
+
+/* Execute a 'define' directive.
+   The first line has already been read, and NAME is the name of
+   the variable to be defined.  The following lines remain to be read.  */
+
+static struct variable *
+do_define (char *name, enum variable_origin origin, struct ebuffer *ebuf)
+{
+  struct variable *v;
+  struct variable var;
+  gmk_floc defstart;
+  int nlevels = 1;
+  unsigned int length = 100;
+  char *definition = xmalloc (length);
+  unsigned int idx = 0;
+  char *p, *n;
+
+  defstart = ebuf->floc;
+
+  p = parse_variable_definition (name, &var);
+  if (p == NULL)
+    /* No assignment token, so assume recursive.  */
+    var.flavor = f_recursive;
+  else
+    {
+      if (var.value[0] != '\0')
+        O (error, &defstart, _("extraneous text after 'define' directive"));
+
+      /* Chop the string before the assignment token to get the name.  */
+      var.name[var.length] = '\0';
+    }
+
+  /* Expand the variable name and find the beginning (NAME) and end.  */
   n = allocated_variable_expand (name);
   name = next_token (n);
   if (name[0] == '\0')
@@ -1609,6 +2957,96 @@ do_define (char *name, enum variable_origin origin, struct ebuffer *ebuf)
   return (v);
 }
 
+static unsigned long
+cond_cache_hash_1 (const void *key)
+{
+  return ((const struct cond_cache *) key)->hash;
+}
+
+static unsigned long
+cond_cache_hash_2 (const void *key)
+{
+  unsigned long hash = ((const struct cond_cache *) key)->hash;
+  return hash >> 16 ^ hash >> 7;
+}
+
+static int
+cond_cache_hash_cmp (const void *x, const void *y)
+{
+  const struct cond_cache *cx = x;
+  const struct cond_cache *cy = y;
+
+  if (cx->hash != cy->hash)
+    return cx->hash < cy->hash ? -1 : 1;
+  if (cx->lineno != cy->lineno)
+    return cx->lineno < cy->lineno ? -1 : 1;
+  if (cx->filenm != cy->filenm)
+    return cx->filenm < cy->filenm ? -1 : 1;
+  return strcmp (cx->text, cy->text);
+}
+
+/* Return the cache entry for the conditional TEXT at FLOCP, making a new
+   one if there is none.  Lines of a $(eval) all have the same location, so
+   the text is part of the key.  */
+
+static struct cond_cache *
+find_cond_cache (const char *text, const gmk_floc *flocp)
+{
+  struct cond_cache key;
+  struct cond_cache *cc;
+  void **slot;
+
+  if (cond_cache_table.ht_vec == 0)
+    hash_init (&cond_cache_table, 509, cond_cache_hash_1, cond_cache_hash_2,
+               cond_cache_hash_cmp);
+
+  key.filenm = flocp->filenm;
+  key.lineno = flocp->lineno;
+  key.text = (char *) text;
+  key.hash = text_hash (text) ^ (key.lineno * 16777619UL)
+    ^ (unsigned long) key.filenm;
+
+  slot = hash_find_slot (&cond_cache_table, &key);
+  if (! HASH_VACANT (*slot))
+    return *slot;
+
+  cc = xmalloc (sizeof (struct cond_cache));
+  *cc = key;
+  cc->text = xstrdup (text);
+  cc->deps = 0;
+  cc->ndeps = 0;
+  cc->known = 0;
+  hash_insert_at (&cond_cache_table, cc, slot);
+  return cc;
+}
+
+/* Remember that IGNORING is the value of the conditional CC, worked out
+   from the variables in DEPS, if no function with side effects was called
+   since CALLS.  */
+
+static void
+remember_cond (struct cond_cache *cc, struct variable_deps *deps,
+               unsigned long generation, unsigned long calls, int ignoring)
+{
+  if (cc == 0 || deps->overflow || generation != variable_generation
+      || calls != impure_function_calls)
+    {
+      free_variable_deps (deps->deps, deps->count);
+      ++cond_cache_uncacheable;
+      return;
+    }
+
+  free_variable_deps (cc->deps, cc->ndeps);
+  free (cc->deps);
+  cc->ndeps = deps->count;
+  cc->deps = xmalloc (deps->count * sizeof (struct variable_dep) + 1);
+  memcpy (cc->deps, deps->deps, deps->count * sizeof (struct variable_dep));
+  cc->generation = generation;
+  cc->ignoring = ignoring;
+  cc->known = 1;
+  ++cond_cache_misses;
+}
+
 /* Interpret conditional commands "ifdef", "ifndef", "ifeq",
    "ifneq", "else" and "endif".
    LINE is the input line, with the command as its first word.
@@ -1628,6 +3066,12 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
   enum { c_ifdef, c_ifndef, c_ifeq, c_ifneq, c_else, c_endif } cmdtype;
   unsigned int i;
   unsigned int o;
+  const char *text = line;
+  struct cond_cache *cc = 0;
+  struct variable_deps deps;
+  struct variable_deps *outer = variable_deps;
+  unsigned long generation;
+  unsigned long calls;
 
   /* Compare a word, both length and contents. */
 #define word1eq(s)      (len == CSTRLEN (s) && strneq (s, line, CSTRLEN (s)))
@@ -1701,8 +3145,7 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
          and cannot be an 'else' or 'endif'.  */
 
       /* Find the length of the next word.  */
-      for (p = line+1; ! STOP_SET (*p, MAP_SPACE|MAP_NUL); ++p)
-        ;
+      p = scan_stopchar (line+1, MAP_SPACE|MAP_NUL);
       len = p - line;
 
       /* If it's 'else' or 'endif' or an illegal conditional, fail.  */
@@ -1752,6 +3195,30 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
         return 1;
       }
 
+  /* Use the value this conditional had last time, if it is still good.
+     Lookups in any but the global variable set, as in a $(eval) in a recipe,
+     could give something else; only the global set list has no parent.
+     Undefined variables may have to be warned about again.  */
+  deps.count = 0;
+  deps.overflow = 0;
+  deps.local = 0;
+  deps.context = 0;
+  if (current_variable_set_list->next == 0 && !warn_undefined_variables_flag)
+    {
+      cc = find_cond_cache (text, flocp);
+      if (cc->known && (cc->generation == variable_generation
+                        || variable_deps_unchanged (cc->deps, cc->ndeps)))
+        {
+          cc->generation = variable_generation;
+          conditionals->ignoring[o] = cc->ignoring;
+          ++cond_cache_hits;
+          goto DONE;
+        }
+      variable_deps = &deps;
+    }
+  generation = variable_generation;
+  calls = impure_function_calls;
+
   if (cmdtype == c_ifdef || cmdtype == c_ifndef)
     {
       char *var;
@@ -1767,13 +3234,15 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
       i = p - var;
       p = next_token (p);
       if (*p != '\0')
-        return -1;
+        goto INVALID;
 
       var[i] = '\0';
       v = lookup_variable (var, i);
+      variable_deps = outer;
 
       conditionals->ignoring[o] =
         ((v != 0 && *v->value != '\0') == (cmdtype == c_ifndef));
+      remember_cond (cc, &deps, generation, calls, conditionals->ignoring[o]);
 
       free (var);
     }
@@ -1785,7 +3254,7 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
       char termin = *line == '(' ? ',' : *line;
 
       if (termin != ',' && termin != '"' && termin != '\'')
-        return -1;
+        goto INVALID;
 
       s1 = ++line;
       /* Find the end of the first string.  */
@@ -1805,7 +3274,7 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
           ++line;
 
       if (*line == '\0')
-        return -1;
+        goto INVALID;
 
       if (termin == ',')
         {
@@ -1831,7 +3300,7 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
 
       termin = termin == ',' ? ')' : *line;
       if (termin != ')' && termin != '"' && termin != '\'')
-        return -1;
+        goto INVALID;
 
       /* Find the end of the second string.  */
       if (termin == ')')
@@ -1860,15 +3329,21 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
         }
 
       if (*line == '\0')
-        return -1;
+        goto INVALID;
 
       *line = '\0';
       line = next_token (++line);
       if (*line != '\0')
-        EXTRATEXT ();
+        {
+          /* Complain about this every time.  */
+          EXTRATEXT ();
+          cc = 0;
+        }
 
       s2 = variable_expand (s2);
+      variable_deps = outer;
       conditionals->ignoring[o] = (streq (s1, s2) == (cmdtype == c_ifneq));
+      remember_cond (cc, &deps, generation, calls, conditionals->ignoring[o]);
     }
 
  DONE:
@@ -1877,6 +3352,11 @@ conditional_line (char *line, int len, const gmk_floc *flocp)
     if (conditionals->ignoring[i])
       return 1;
   return 0;
+
+ INVALID:
+  variable_deps = outer;
+  free_variable_deps (deps.deps, deps.count);
+  return -1;
 }
 
 
@@ -1899,6 +3379,10 @@ record_target_var (struct nameseq *filenames, char *defn,
 
   global = current_variable_set_list;
 
+  /* Frozen variables may refer to this one.  */
+  if (freezing_variables)
+    thaw_variables ();
+
   /* If the variable is an append version, store that but treat it as a
      normal recursive variable.  */
 
@@ -1954,7 +3438,10 @@ record_target_var (struct nameseq *filenames, char *defn,
           current_variable_set_list = global;
         }
 
-      /* Set up the variable to be *-specific.  */
+      /* Set up the variable to be *-specific.  Views of the sets may have
+         left it out because it was private.  */
+      if (v->private_var != vmod->private_v)
+        ++variable_view_generation;
       v->per_target = 1;
       v->private_var = vmod->private_v;
       v->export = vmod->export_v ? v_export : v_default;
@@ -1970,6 +3457,7 @@ record_target_var (struct nameseq *filenames, char *defn,
           if (gv && v != gv
               && (gv->origin == o_env_override || gv->origin == o_command))
             {
+              forget_expansion (v);
               free (v->value);
               v->value = xstrdup (gv->value);
               v->origin = gv->origin;
@@ -2312,8 +3800,7 @@ find_char_unquote (char *string, int map)
 
   while (1)
     {
-      while (! STOP_SET (*p, map))
-        ++p;
+      p = scan_stopchar (p, map);
 
       if (*p == '\0')
         break;
@@ -2450,8 +3937,7 @@ find_percent_cached (const char **string)
 
   while (1)
     {
-      while (! STOP_SET (*p, MAP_PERCENT|MAP_NUL))
-        ++p;
+      p = scan_stopchar (p, MAP_PERCENT|MAP_NUL);
 
       if (*p == '\0')
         break;
@@ -2524,6 +4010,20 @@ readstring (struct ebuffer *ebuf)
 {
   char *eol;
 
+  /* If the lines of this buffer are known, just cut off the next one.  */
+  if (ebuf->cache)
+    {
+      struct eval_line *line;
+
+      if (ebuf->iline == ebuf->cache->nlines)
+        return -1;
+
+      line = ebuf->line = &ebuf->cache->lines[ebuf->iline++];
+      ebuf->buffer = ebuf->bufstart + line->start;
+      ebuf->buffer[line->len] = '\0';
+      return 0;
+    }
+
   /* If there is nothing left in this buffer, return 0.  */
   if (ebuf->bufnext >= ebuf->bufstart + ebuf->size)
     return -1;
@@ -2562,6 +4062,273 @@ readstring (struct ebuffer *ebuf)
   return 0;
 }
 
+#ifdef MAP_MAKEFILES
+/* Map the makefile open on EBUF->fp into memory, so that readmapped can hand
+   out its lines without reading them into a buffer one by one.  The mapping
+   is private and writable since eval modifies lines in place.  Return
+   nonzero if the file was mapped.  */
+
+static int
+map_makefile (struct ebuffer *ebuf)
+{
+  struct stat st;
+  char *map;
+  int r;
+
+  EINTRLOOP (r, fstat (fileno (ebuf->fp), &st));
+  if (r != 0)
+    return 0;
+
+  map = map_fd (fileno (ebuf->fp), &st);
+  if (map == 0)
+    return 0;
+
+  ebuf->buffer = ebuf->bufnext = ebuf->bufstart = map;
+  ebuf->size = st.st_size;
+  return 1;
+}
+
+/* Map the file open on FD, whose status is ST, as map_makefile needs it.
+   Return NULL if it can't be mapped.  This is called from the threads of
+   preload_makefiles, so it must not touch anything else.  */
+
+static char *
+map_fd (int fd, const struct stat *st)
+{
+  long pagesize;
+  char *map;
+
+  if (!S_ISREG (st->st_mode) || st->st_size <= 0 || st->st_size >= UINT_MAX)
+    return 0;
+
+  /* The last line needs a terminating nul.  The rest of the page after the
+     end of the file reads as zeros, so map one byte more; if the file fills
+     its last page there is no such byte, so read it the usual way.  */
+#ifdef _SC_PAGESIZE
+  pagesize = sysconf (_SC_PAGESIZE);
+#else
+  pagesize = getpagesize ();
+#endif
+  if (pagesize <= 0 || st->st_size % pagesize == 0)
+    return 0;
+
+  /* Prefault the whole file where we can: eval writes to every line, and
+     breaking copy-on-write for all pages in one go is much cheaper than
+     taking a write fault on each.  */
+  map = mmap (0, st->st_size + 1, PROT_READ | PROT_WRITE,
+#ifdef MAP_POPULATE
+              MAP_PRIVATE | MAP_POPULATE,
+#else
+              MAP_PRIVATE,
+#endif
+              fd, 0);
+  return map == MAP_FAILED ? 0 : map;
+}
+
+/* Find the next logical line of a mapped makefile and nul-terminate it in
+   place.  Backslash/newline pairs are left for eval to collapse; the text is
+   only moved down if a CR has to be removed from inside the line.  Returns
+   the number of physical lines read, or -1 at the end of the file.  */
+
+static long
+readmapped (struct ebuffer *ebuf)
+{
+  char *end = ebuf->bufstart + ebuf->size;
+  char *src = ebuf->bufnext;
+  char *dst;
+  long nlines = 0;
+
+  if (src >= end)
+    return -1;
+
+  ebuf->buffer = dst = src;
+
+  while (1)
+    {
+      char *nl = memchr (src, '\n', end - src);
+      char *eol = nl ? nl : end;
+      char *p;
+      int backslash;
+
+      if (*src == '\0' && src < eol)
+        {
+          /* See the comment in readline.  Skip the rest of the line.  */
+          O (error, &ebuf->floc,
+             _("warning: NUL character seen; rest of line ignored"));
+          src = nl ? nl + 1 : end;
+          if (nl)
+            ++nlines;
+          break;
+        }
+
+      if (nl)
+        ++nlines;
+
+#if !defined(WINDOWS32) && !defined(__MSDOS__) && !defined(__EMX__)
+      /* Ignore the CR of a CRLF line ending.  */
+      if (nl && eol > src && eol[-1] == '\r')
+        --eol;
+#endif
+
+      if (dst != src)
+        memmove (dst, src, eol - src);
+      dst += eol - src;
+      src = nl ? nl + 1 : end;
+
+      backslash = 0;
+      for (p = dst - 1; p >= ebuf->buffer && *p == '\\'; --p)
+        backslash = !backslash;
+
+      if (!backslash || !nl)
+        break;
+
+      /* Keep the newline of a backslash/newline pair.  */
+      *(dst++) = '\n';
+    }
+
+  /* At the end of the file this writes the byte after it, which was mapped
+     for the purpose.  */
+  *dst = '\0';
+  ebuf->bufnext = src;
+
+  return nlines ? nlines : 1;
+}
+#endif /* MAP_MAKEFILES */
+
+#ifdef PARALLEL_INCLUDE
+/* The part of an include list the threads of preload_makefiles share.  */
+
+struct preload_batch
+  {
+    struct preload *files;
+    unsigned int count;
+    unsigned int next;          /* The next file nobody has taken yet.  */
+    pthread_mutex_t lock;
+  };
+
+/* Open, map and check the files of BATCH until there are none left.  Only
+   system calls and simple_deps_p are used here: the rest of make isn't safe
+   to use from more than one thread.  */
+
+static void *
+preload_thread (void *arg)
+{
+  struct preload_batch *batch = arg;
+
+  while (1)
+    {
+      struct preload *pre = 0;
+      int r;
+
+      pthread_mutex_lock (&batch->lock);
+      if (batch->next < batch->count)
+        pre = &batch->files[batch->next++];
+      pthread_mutex_unlock (&batch->lock);
+      if (pre == 0)
+        break;
+
+      EINTRLOOP (pre->fd, open (pre->name, O_RDONLY));
+      if (pre->fd < 0)
+        continue;
+      CLOSE_ON_EXEC (pre->fd);
+
+      EINTRLOOP (r, fstat (pre->fd, &pre->st));
+      if (r != 0)
+        {
+          close (pre->fd);
+          pre->fd = -1;
+          continue;
+        }
+
+      pre->map = map_fd (pre->fd, &pre->st);
+      if (pre->map != 0)
+        pre->simple = simple_deps_p (pre->map, pre->st.st_size);
+    }
+
+  return 0;
+}
+
+/* Open and map the makefiles at the start of the include list FILES, using
+   up to parallel_include threads, so that the time spent waiting for the
+   disk and faulting in the pages overlaps.  Everything that could change the
+   meaning of a makefile is still done in order by eval_makefile.  Return the
+   files handled, and store how many there are in *COUNTP.  */
+
+static struct preload *
+preload_makefiles (struct nameseq *files, unsigned int *countp)
+{
+  struct preload_batch batch;
+  pthread_t *threads;
+  struct nameseq *ns;
+  unsigned int max = parallel_include * PRELOAD_PER_THREAD;
+  unsigned int nthreads;
+  unsigned int i;
+  sigset_t all, old;
+
+  batch.count = 0;
+  for (ns = files; ns != 0 && batch.count < max; ns = ns->next)
+    ++batch.count;
+
+  batch.files = xcalloc (batch.count * sizeof (struct preload));
+  batch.next = 0;
+  for (i = 0, ns = files; i < batch.count; ++i, ns = ns->next)
+    {
+      batch.files[i].name = ns->name;
+      batch.files[i].fd = -1;
+      batch.files[i].prefix = cmd_prefix;
+    }
+
+  init_simple_deps ();
+  pthread_mutex_init (&batch.lock, 0);
+
+  /* This thread does its share too.  The others leave signals to it.  */
+  nthreads = parallel_include - 1;
+  if (nthreads > batch.count - 1)
+    nthreads = batch.count - 1;
+  threads = xmalloc ((nthreads + 1) * sizeof (pthread_t));
+
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (i = 0; i < nthreads; ++i)
+    if (pthread_create (&threads[i], 0, preload_thread, &batch) != 0)
+      break;
+  nthreads = i;
+  pthread_sigmask (SIG_SETMASK, &old, 0);
+
+  preload_thread (&batch);
+
+  for (i = 0; i < nthreads; ++i)
+    pthread_join (threads[i], 0);
+
+  pthread_mutex_destroy (&batch.lock);
+  free (threads);
+
+  DB (DB_VERBOSE, (_("Read ahead %u included makefiles on %u threads.\n"),
+                   batch.count, nthreads + 1));
+
+  *countp = batch.count;
+  return batch.files;
+}
+
+/* Release whatever eval_makefile didn't use of the COUNT files at PRE.  */
+
+static void
+free_preloads (struct preload *pre, unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; ++i)
+    {
+      if (pre[i].map != 0)
+        munmap (pre[i].map, pre[i].st.st_size + 1);
+      if (pre[i].fd >= 0)
+        close (pre[i].fd);
+    }
+
+  free (pre);
+}
+#endif /* PARALLEL_INCLUDE */
+
 static long
 readline (struct ebuffer *ebuf)
 {
@@ -2576,6 +4343,11 @@ readline (struct ebuffer *ebuf)
   if (!ebuf->fp)
     return readstring (ebuf);
 
+#ifdef MAP_MAKEFILES
+  if (ebuf->mapped)
+    return readmapped (ebuf);
+#endif
+
   /* When reading from a file, we always start over at the beginning of the
      buffer for each new line.  */
 
@@ -2693,8 +4465,7 @@ get_next_mword (char *buffer, char *delim, char **startp, unsigned int *length)
   char c;
 
   /* Skip any leading whitespace.  */
-  while (isblank ((unsigned char)*p))
-    ++p;
+  p = next_token (p);
 
   beg = p;
   c = *(p++);
@@ -2768,6 +4539,15 @@ get_next_mword (char *buffer, char *delim, char **startp, unsigned int *length)
       char closeparen;
       int count;
 
+      /* Skip straight to the next character the switch cares about.  */
+      if (!delim && !STOP_SET (c, MAP_MWORD|MAP_BLANK|MAP_EQUALS|MAP_COLON
+                                  |MAP_VARIABLE|MAP_NUL))
+        {
+          p = scan_stopchar (p, MAP_MWORD|MAP_BLANK|MAP_EQUALS|MAP_COLON
+                                |MAP_VARIABLE);
+          c = *(p++);
+        }
+
       switch (c)
         {
         case '\0':
@@ -3079,7 +4859,7 @@ parse_file_seq (char **stringp, unsigned int size, int stopmap,
   struct nameseq **newp = &new;
 #define NEWELT(_n)  do { \
                         const char *__n = (_n); \
-                        *newp = xcalloc (size); \
+                        *newp = alloc_seq_elt (size); \
                         (*newp)->name = (cachep ? strcache_add (__n) : xstrdup (__n)); \
                         newp = &(*newp)->next; \
                     } while(0)
@@ -246,7 +246,7 @@ update_goal_chain (struct dep *goals)
                 lastgoal->next = g->next;
 
               /* Free the storage.  */
-              free (g);
+              free_dep (g);
 
               g = lastgoal == 0 ? goals : lastgoal->next;
 
@@ -0,0 +1,350 @@
+/* Scanning strings for stop characters, for GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The tokenizers in read.c, misc.c and function.c spend much of their time
+   looking for the next character in some set of stopchar_map classes.  The
+   functions here do that 16 bytes at a time when SSE2 is available, and a
+   byte at a time otherwise.
+
+   A set of classes is turned into the list of characters in it the first
+   time it is used.  Sets with more than SCAN_MAX_CHARS characters, such as
+   MAP_USERFUNC, are always scanned a byte at a time.
+
+   Compile with -DTEST to get a program that times each kernel against the
+   plain loop it replaces.  */
+
+#include "makeint.h"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+
+/* Largest set searched with vector compares; each character costs one.  */
+#define SCAN_MAX_CHARS  8
+
+/* Number of different sets remembered.  Callers use a handful of constant
+   maps, so this is plenty.  */
+#define SCAN_NUM_SETS   32
+
+struct scan_set
+  {
+    int map;                    /* The stopchar_map classes.  */
+    int nchars;                 /* Number of characters, or -1 if too many.  */
+    __m128i chars[SCAN_MAX_CHARS];  /* Each character, in all 16 bytes.  */
+  };
+
+static struct scan_set scan_sets[SCAN_NUM_SETS];
+static unsigned int scan_nsets = 0;
+static const struct scan_set *scan_last = 0;
+
+/* Return the set of characters in the classes MAP, or NULL if they can't be
+   searched for with vector compares.  */
+
+static const struct scan_set *
+get_scan_set (int map)
+{
+  struct scan_set *set;
+  unsigned int i;
+  int c;
+
+  if (scan_last != 0 && scan_last->map == map)
+    return scan_last->nchars > 0 ? scan_last : 0;
+
+  for (i = 0; i < scan_nsets; ++i)
+    if (scan_sets[i].map == map)
+      {
+        scan_last = &scan_sets[i];
+        return scan_last->nchars > 0 ? scan_last : 0;
+      }
+
+  /* Don't remember anything until initialize_stopchar_map has run.  */
+  if (scan_nsets == SCAN_NUM_SETS || ! STOP_SET ('\0', MAP_NUL))
+    return 0;
+
+  set = &scan_sets[scan_nsets++];
+  set->map = map;
+  set->nchars = 0;
+  for (c = 0; c <= UCHAR_MAX; ++c)
+    if (ANY_SET (stopchar_map[c], map))
+      {
+        if (set->nchars == SCAN_MAX_CHARS)
+          {
+            set->nchars = -1;
+            break;
+          }
+        set->chars[set->nchars++] = _mm_set1_epi8 ((char) c);
+      }
+
+  scan_last = set;
+  return set->nchars > 0 ? set : 0;
+}
+
+/* Return a bit mask of the bytes in the 16-byte aligned block P that are in
+   SET.  Aligned loads never cross into another page, so it is safe to read
+   the bytes around a string.  */
+
+static unsigned int
+scan_block (const char *p, const struct scan_set *set)
+{
+  __m128i v = _mm_load_si128 ((const __m128i *) p);
+  __m128i m = _mm_cmpeq_epi8 (v, set->chars[0]);
+  int i;
+
+  for (i = 1; i < set->nchars; ++i)
+    m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, set->chars[i]));
+
+  return (unsigned int) _mm_movemask_epi8 (m);
+}
+
+/* Return the first character at or after S whose membership in SET is
+   WANT.  The search must be bound to stop, at the nul if nothing else.  */
+
+static const char *
+scan_vector (const char *s, const struct scan_set *set, int want)
+{
+  const char *p = (const char *) ((size_t) s & ~(size_t) 15);
+  unsigned int flip = want ? 0 : 0xffff;
+  unsigned int mask;
+
+  /* Ignore the bytes of the first block that come before S.  */
+  mask = ((scan_block (p, set) ^ flip) >> (s - p)) << (s - p);
+  while (mask == 0)
+    {
+      p += 16;
+      mask = scan_block (p, set) ^ flip;
+    }
+
+  return p + __builtin_ctz (mask);
+}
+#endif /* __SSE2__ */
+
+/* Number of characters looked at one by one before using vector compares.
+   Most tokens are shorter than this, and for them the plain loop wins.  */
+#define SCAN_SHORT      8
+
+/* Return a pointer to the first character in S that is in one of the
+   stopchar_map classes MAP, or to the terminating nul.  */
+
+char *
+scan_stopchar (const char *s, int map)
+{
+  map |= MAP_NUL;
+
+  /* Each test stops at the nul, so the next one is always in bounds.  */
+#define SCAN_ONE(_i) if (STOP_SET (s[_i], map)) return (char *) s + (_i)
+  SCAN_ONE (0); SCAN_ONE (1); SCAN_ONE (2); SCAN_ONE (3);
+  SCAN_ONE (4); SCAN_ONE (5); SCAN_ONE (6); SCAN_ONE (7);
+#undef SCAN_ONE
+  s += SCAN_SHORT;
+
+#ifdef __SSE2__
+  {
+    const struct scan_set *set = get_scan_set (map);
+    if (set != 0)
+      return (char *) scan_vector (s, set, 1);
+  }
+#endif
+
+  while (! STOP_SET (*s, map))
+    ++s;
+
+  return (char *) s;
+}
+
+/* Return a pointer to the first character in S that isn't blank.  This may
+   be used before initialize_stopchar_map, so the fallback uses isblank.  */
+
+char *
+scan_blanks (const char *s)
+{
+#define SCAN_ONE(_i) if (! isblank ((unsigned char) s[_i])) return (char *) s + (_i)
+  SCAN_ONE (0); SCAN_ONE (1); SCAN_ONE (2); SCAN_ONE (3);
+  SCAN_ONE (4); SCAN_ONE (5); SCAN_ONE (6); SCAN_ONE (7);
+#undef SCAN_ONE
+  s += SCAN_SHORT;
+
+#ifdef __SSE2__
+  {
+    const struct scan_set *set = get_scan_set (MAP_BLANK);
+    if (set != 0)
+      return (char *) scan_vector (s, set, 0);
+  }
+#endif
+
+  while (isblank ((unsigned char) *s))
+    ++s;
+
+  return (char *) s;
+}
+
+#ifdef TEST
+/* Microbenchmark: time each kernel against the loop it replaced, over
+   tokens of various lengths.  */
+
+#include <time.h>
+
+unsigned short stopchar_map[UCHAR_MAX + 1] = {0};
+
+static char *
+ref_stopchar (const char *s, int map)
+{
+  map |= MAP_NUL;
+  while (! STOP_SET (*s, map))
+    ++s;
+  return (char *) s;
+}
+
+static char *
+ref_blanks (const char *s)
+{
+  while (isblank ((unsigned char) *s))
+    ++s;
+  return (char *) s;
+}
+
+#define BENCH_BYTES     (1 << 20)
+
+/* Time scanning all of BUF with FN.  FN is always called through a
+   volatile pointer, as the callers in make can't inline the kernels
+   either.  */
+
+static double
+bench (char *(*fn) (const char *, int), const char *buf, int map)
+{
+  char *(*volatile call) (const char *, int) = fn;
+  unsigned long rounds = 0;
+  clock_t start = clock ();
+  clock_t elapsed;
+  volatile size_t sink = 0;
+
+  do
+    {
+      const char *p = buf;
+      while (*p != '\0')
+        {
+          const char *e = (*call) (p, map);
+          sink += e - p;
+          p = e + 1;
+        }
+      ++rounds;
+      elapsed = clock () - start;
+    }
+  while (elapsed < CLOCKS_PER_SEC / 2);
+
+  return (double) elapsed / CLOCKS_PER_SEC / rounds;
+}
+
+static char *
+blanks_kernel (const char *s, int map UNUSED)
+{
+  return scan_blanks (s);
+}
+
+static char *
+blanks_ref (const char *s, int map UNUSED)
+{
+  return ref_blanks (s);
+}
+
+/* Fill BUF with runs of LEN copies of FILL, each followed by one STOP.  */
+
+static void
+fill_buffer (char *buf, unsigned int len, char fill, char stop)
+{
+  char *p = buf;
+  char *end = buf + BENCH_BYTES - len - 2;
+
+  while (p < end)
+    {
+      memset (p, fill, len);
+      p += len;
+      *(p++) = stop;
+    }
+  *p = '\0';
+}
+
+int
+main (void)
+{
+  static const unsigned int lengths[] = { 1, 4, 16, 64, 256, 4096 };
+  static const struct
+    {
+      const char *name;
+      int map;
+      char fill;
+      char stop;
+    } kernels[] = {
+      { "end_of_token", MAP_BLANK, 'x', ' ' },
+      { "find_percent", MAP_PERCENT, 'x', '%' },
+      { "find_char_unquote", MAP_COLON|MAP_SEMI|MAP_EQUALS|MAP_VARIABLE,
+        'x', ':' },
+      { "next_token", -1, ' ', 'x' },
+      { 0, 0, 0, 0 }
+    };
+  char *buf = malloc (BENCH_BYTES + 16);
+  unsigned int i;
+  int k;
+
+  stopchar_map[(int)'\0'] = MAP_NUL;
+  stopchar_map[(int)'#'] = MAP_COMMENT;
+  stopchar_map[(int)';'] = MAP_SEMI;
+  stopchar_map[(int)'='] = MAP_EQUALS;
+  stopchar_map[(int)':'] = MAP_COLON;
+  stopchar_map[(int)'%'] = MAP_PERCENT;
+  stopchar_map[(int)'|'] = MAP_PIPE;
+  stopchar_map[(int)'$'] = MAP_VARIABLE;
+  stopchar_map[(int)'/'] = MAP_DIRSEP;
+  for (i = 1; i <= UCHAR_MAX; ++i)
+    {
+      if (isblank (i))
+        stopchar_map[i] = MAP_BLANK;
+      if (isspace (i))
+        stopchar_map[i] |= MAP_SPACE;
+    }
+
+#ifdef __SSE2__
+  puts ("Kernels use SSE2.");
+#else
+  puts ("Kernels use the byte-at-a-time fallback.");
+#endif
+  printf ("%-18s %6s %12s %12s %8s\n",
+          "kernel", "length", "loop MB/s", "kernel MB/s", "speedup");
+
+  for (k = 0; kernels[k].name != 0; ++k)
+    for (i = 0; i < sizeof (lengths) / sizeof (lengths[0]); ++i)
+      {
+        double t_ref, t_new;
+
+        fill_buffer (buf, lengths[i], kernels[k].fill, kernels[k].stop);
+        if (kernels[k].map < 0)
+          {
+            t_ref = bench (blanks_ref, buf, 0);
+            t_new = bench (blanks_kernel, buf, 0);
+          }
+        else
+          {
+            t_ref = bench (ref_stopchar, buf, kernels[k].map);
+            t_new = bench (scan_stopchar, buf, kernels[k].map);
+          }
+
+        printf ("%-18s %6u %12.0f %12.0f %7.2fx\n", kernels[k].name,
+                lengths[i], BENCH_BYTES / 1048576.0 / t_ref,
+                BENCH_BYTES / 1048576.0 / t_new, t_ref / t_new);
+      }
+
+  free (buf);
+  return 0;
+}
+#endif /* TEST */
@@ -0,0 +1,662 @@
+/* Caching the results of $(shell ...) across runs of GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* While the variable .CACHE_SHELL is defined, the output of each
+   $(shell ...) command is kept in SHELL_CACHE_FILE, and later runs use it
+   instead of running the command again.  The words of .CACHE_SHELL name
+   the files the commands read.
+
+   An entry is found by its key: the command, the values of SHELL and
+   .SHELLFLAGS, the directory make started in and the names in
+   .CACHE_SHELL.  It is only used if the environment, leaving out what
+   make keeps there for itself, and the state (identity, size and
+   modification time) of each of those files are still what they were
+   when the command was run; otherwise the command is run again and the
+   entry replaced.
+
+   As with snapshots, the format is private to one build of make on one
+   machine: numbers are stored in native byte order.  */
+
+#include "makeint.h"
+
+#include "filedef.h"
+#include "variable.h"
+#include "hash.h"
+#include "debug.h"
+#include "shellcache.h"
+
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+
+#define SHELL_CACHE_MAGIC       "remake shell cache 1\n"
+#define SHELL_CACHE_TRAILER     "end of shell cache\n"
+
+/* Numbers stored for each file named in .CACHE_SHELL.  */
+#define STAMP_SIZE              4
+
+int clear_shell_cache_flag = 0;
+
+struct shell_cache_entry
+  {
+    const char *key;            /* Command, shell, flags, directory, files. */
+    unsigned int key_length;
+    unsigned long hash;
+    uintmax_t *stamps;          /* Environment digest, then the files.  */
+    unsigned int nstamps;
+    const char *output;         /* What the command wrote.  */
+    unsigned int length;
+  };
+
+static struct hash_table shell_cache;
+static int shell_cache_loaded = 0;
+static int shell_cache_changed = 0;
+static char *shell_cache_name;
+
+/* The file as read, which loaded entries point into.  */
+static char *shell_cache_buf;
+
+/* The file as written by other makes meanwhile, read again to keep their
+   entries when the cache is written back.  */
+static char *shell_cache_merged;
+
+/* The entry a missed command is to be stored in.  */
+static struct shell_cache_entry *pending;
+
+static unsigned long shell_cache_hits;
+static unsigned long shell_cache_misses;
+
+/* FNV-1a, which unlike the string hashes of hash.h doesn't stop at a nul.  */
+
+static uintmax_t
+digest (uintmax_t h, const char *p, size_t len)
+{
+  const unsigned char *s = (const unsigned char *) p;
+  const unsigned char *end = s + len;
+
+  while (s < end)
+    {
+      h ^= *s++;
+      h *= 0x100000001b3ULL;
+    }
+
+  return h;
+}
+
+#define DIGEST_INIT             0xcbf29ce484222325ULL
+
+static unsigned long
+shell_cache_hash_1 (const void *key)
+{
+  return ((const struct shell_cache_entry *) key)->hash;
+}
+
+static unsigned long
+shell_cache_hash_2 (const void *key)
+{
+  return ((const struct shell_cache_entry *) key)->hash >> 7 | 1;
+}
+
+static int
+shell_cache_hash_cmp (const void *x, const void *y)
+{
+  const struct shell_cache_entry *ex = x;
+  const struct shell_cache_entry *ey = y;
+
+  if (ex->key_length != ey->key_length)
+    return ex->key_length < ey->key_length ? -1 : 1;
+  return memcmp (ex->key, ey->key, ex->key_length);
+}
+
+
+/* Reading the cache.  A file that isn't what we wrote is ignored.  */
+
+static const char *rcur;
+static const char *rend;
+static int rbad;
+
+static uintmax_t
+get_num (void)
+{
+  uintmax_t n;
+
+  if (rbad || (size_t) (rend - rcur) < sizeof (n))
+    {
+      rbad = 1;
+      return 0;
+    }
+  memcpy (&n, rcur, sizeof (n));
+  rcur += sizeof (n);
+  return n;
+}
+
+static const char *
+get_bytes (unsigned int *length)
+{
+  uintmax_t len = get_num ();
+  const char *s;
+
+  if (rbad || (uintmax_t) (rend - rcur) < len)
+    {
+      rbad = 1;
+      *length = 0;
+      return "";
+    }
+  s = rcur;
+  rcur += len;
+  *length = len;
+  return s;
+}
+
+static void
+free_entry (const void *item)
+{
+  struct shell_cache_entry *e = (struct shell_cache_entry *) item;
+
+  free (e->stamps);
+  free (e);
+}
+
+/* Read the entries of the cache file into the table.  When MERGING,
+   entries for keys that are already there are left out and a bad file is
+   just ignored; otherwise the file must be all right or none of it is
+   used.  */
+
+static void
+read_shell_cache (int merging)
+{
+  const char *why = 0;
+  struct stat st;
+  char *buf = 0;
+  size_t size = 0;
+  uintmax_t count;
+  int fd;
+  int r;
+
+  EINTRLOOP (fd, open (shell_cache_name, O_RDONLY));
+  if (fd < 0)
+    {
+      if (!merging)
+        DB (DB_BASIC, (_("No shell cache '%s'\n"), shell_cache_name));
+      return;
+    }
+
+  EINTRLOOP (r, fstat (fd, &st));
+  if (r == 0 && st.st_size > 0)
+    {
+      char *p;
+      size_t left;
+
+      size = st.st_size;
+      p = buf = xmalloc (size);
+      for (left = size; left > 0; )
+        {
+          ssize_t cc;
+          EINTRLOOP (cc, read (fd, p, left));
+          if (cc <= 0)
+            break;
+          p += cc;
+          left -= cc;
+        }
+      size -= left;
+    }
+  close (fd);
+
+  rcur = buf;
+  rend = buf + size;
+  rbad = 0;
+
+  if (size < CSTRLEN (SHELL_CACHE_MAGIC) + CSTRLEN (SHELL_CACHE_TRAILER)
+      || memcmp (rcur, SHELL_CACHE_MAGIC, CSTRLEN (SHELL_CACHE_MAGIC)) != 0
+      || memcmp (rend - CSTRLEN (SHELL_CACHE_TRAILER), SHELL_CACHE_TRAILER,
+                 CSTRLEN (SHELL_CACHE_TRAILER)) != 0)
+    why = _("not a shell cache");
+  else
+    {
+      unsigned int len;
+      const char *version;
+
+      rcur += CSTRLEN (SHELL_CACHE_MAGIC);
+      rend -= CSTRLEN (SHELL_CACHE_TRAILER);
+
+      version = get_bytes (&len);
+      if (len != strlen (version_string)
+          || memcmp (version, version_string, len) != 0)
+        why = _("written by another version of make");
+    }
+
+  if (why == 0)
+    for (count = get_num (); count > 0 && !rbad; --count)
+      {
+        struct shell_cache_entry *e = xmalloc (sizeof (*e));
+        struct shell_cache_entry **slot;
+        unsigned int i;
+
+        e->key = get_bytes (&e->key_length);
+        e->hash = digest (DIGEST_INIT, e->key, e->key_length);
+        e->nstamps = get_num ();
+        if (rbad || e->nstamps > (size_t) (rend - rcur) / sizeof (uintmax_t))
+          {
+            rbad = 1;
+            free (e);
+            break;
+          }
+        e->stamps = xmalloc (e->nstamps * sizeof (uintmax_t));
+        for (i = 0; i < e->nstamps; ++i)
+          e->stamps[i] = get_num ();
+        e->output = get_bytes (&e->length);
+
+        slot = (struct shell_cache_entry **) hash_find_slot (&shell_cache, e);
+        if (rbad || (!merging && !HASH_VACANT (*slot)))
+          rbad = 1;
+        if (rbad || !HASH_VACANT (*slot))
+          free_entry (e);
+        else
+          hash_insert_at (&shell_cache, e, slot);
+      }
+
+  if (why == 0 && (rbad || rcur != rend))
+    why = _("it is corrupt");
+
+  if (merging)
+    {
+      /* The entries point into BUF, and make is about to exit.  */
+      if (shell_cache_merged == 0)
+        shell_cache_merged = buf;
+      return;
+    }
+
+  shell_cache_buf = buf;
+  if (why != 0)
+    {
+      DB (DB_BASIC, (_("Ignoring shell cache '%s': %s\n"),
+                     shell_cache_name, why));
+      hash_map (&shell_cache, free_entry);
+      hash_free (&shell_cache, 0);
+      hash_init (&shell_cache, 256, shell_cache_hash_1, shell_cache_hash_2,
+                 shell_cache_hash_cmp);
+      return;
+    }
+
+  DB (DB_BASIC, (_("Read %lu entries from shell cache '%s'\n"),
+                 shell_cache.ht_fill, shell_cache_name));
+}
+
+static void
+load_shell_cache (void)
+{
+  hash_init (&shell_cache, 256, shell_cache_hash_1, shell_cache_hash_2,
+             shell_cache_hash_cmp);
+  shell_cache_loaded = 1;
+
+  if (starting_directory != 0)
+    {
+      shell_cache_name = xmalloc (strlen (starting_directory)
+                                  + CSTRLEN (SHELL_CACHE_FILE) + 2);
+      sprintf (shell_cache_name, "%s/%s", starting_directory,
+               SHELL_CACHE_FILE);
+    }
+  else
+    shell_cache_name = xstrdup (SHELL_CACHE_FILE);
+
+  if (clear_shell_cache_flag)
+    DB (DB_BASIC, (_("Clearing shell cache '%s'\n"), shell_cache_name));
+  else
+    read_shell_cache (0);
+}
+
+
+/* Looking commands up.  */
+
+/* The key and stamps of one command being looked up.  Each lookup has its
+   own, as expanding the variables that go in it may run $(shell ...),
+   which looks up another command.  */
+
+struct shell_cache_key
+  {
+    char *key;
+    unsigned int length;
+    unsigned int size;
+    uintmax_t *stamps;
+    unsigned int nstamps;
+    unsigned int stamps_size;
+  };
+
+static void
+add_key (struct shell_cache_key *k, const char *p, unsigned int len)
+{
+  if (k->length + len + 1 > k->size)
+    {
+      k->size = (k->length + len + 1) * 2;
+      k->key = xrealloc (k->key, k->size);
+    }
+  memcpy (k->key + k->length, p, len);
+  k->length += len;
+  k->key[k->length++] = '\0';
+}
+
+static void
+add_stamp (struct shell_cache_key *k, uintmax_t n)
+{
+  if (k->nstamps == k->stamps_size)
+    {
+      k->stamps_size = k->stamps_size * 2 + 16;
+      k->stamps = xrealloc (k->stamps, k->stamps_size * sizeof (uintmax_t));
+    }
+  k->stamps[k->nstamps++] = n;
+}
+
+/* Record what we know about the file NAME: whether it exists and, if so,
+   which file it is and when it was last changed.  */
+
+static void
+add_file_stamp (struct shell_cache_key *k, const char *name)
+{
+  struct stat st;
+  int r;
+
+  EINTRLOOP (r, stat (name, &st));
+  if (r != 0)
+    {
+      unsigned int i;
+      for (i = 0; i < STAMP_SIZE; ++i)
+        add_stamp (k, 0);
+      return;
+    }
+  add_stamp (k, ((uintmax_t) st.st_dev << 1) | 1);
+  add_stamp (k, st.st_ino);
+  add_stamp (k, st.st_size);
+  add_stamp (k, FILE_TIMESTAMP_STAT_MODTIME (name, st));
+}
+
+/* Put the value of the variable NAME in the key.  */
+
+static void
+add_variable_key (struct shell_cache_key *k, const char *name,
+                  unsigned int length)
+{
+  struct variable *v = lookup_variable (name, length);
+
+  if (v == 0)
+    add_key (k, "", 0);
+  else if (!v->recursive)
+    add_key (k, v->value, strlen (v->value));
+  else
+    {
+      char *value = allocated_variable_expand (v->value);
+      add_key (k, value, strlen (value));
+      free (value);
+    }
+}
+
+/* Return nonzero if the environment entry ENTRY is one that make keeps for
+   itself, and that changes when it re-executes after remaking a makefile
+   or is given other options, without changing what commands write.  */
+
+static int
+make_environment_entry (const char *entry)
+{
+  static const char *const names[] =
+    { "MAKE_RESTARTS=", "MAKEFLAGS=", "MFLAGS=", 0 };
+  const char *const *np;
+
+  for (np = names; *np != 0; ++np)
+    if (strncmp (entry, *np, strlen (*np)) == 0)
+      return 1;
+  return 0;
+}
+
+int
+shell_cache_lookup (const char *command, const char **output,
+                    unsigned int *length)
+{
+  struct variable *v;
+  struct shell_cache_key k;
+  struct shell_cache_entry key;
+  struct shell_cache_entry **slot;
+  struct shell_cache_entry *e;
+  char *inputs;
+  const char *p;
+  const char *name;
+  unsigned int len;
+  uintmax_t env;
+  char **ep;
+
+  pending = 0;
+
+  v = lookup_variable (STRING_SIZE_TUPLE (".CACHE_SHELL"));
+  if (v == 0)
+    return 0;
+
+  if (!shell_cache_loaded)
+    load_shell_cache ();
+
+  inputs = v->recursive ? allocated_variable_expand (v->value) : v->value;
+
+  memset (&k, 0, sizeof (k));
+  add_key (&k, command, strlen (command));
+  add_variable_key (&k, STRING_SIZE_TUPLE ("SHELL"));
+  add_variable_key (&k, STRING_SIZE_TUPLE (".SHELLFLAGS"));
+  add_key (&k, starting_directory ? starting_directory : "",
+           starting_directory ? strlen (starting_directory) : 0);
+
+  for (env = DIGEST_INIT, ep = environ; *ep != 0; ++ep)
+    if (!make_environment_entry (*ep))
+      env = digest (env, *ep, strlen (*ep) + 1);
+  add_stamp (&k, env);
+
+  p = inputs;
+  while ((name = find_next_token (&p, &len)) != 0)
+    {
+      char *file = alloca (len + 1);
+      memcpy (file, name, len);
+      file[len] = '\0';
+      add_key (&k, file, len);
+      add_file_stamp (&k, file);
+    }
+
+  if (inputs != v->value)
+    free (inputs);
+
+  key.key = k.key;
+  key.key_length = k.length;
+  key.hash = digest (DIGEST_INIT, k.key, k.length);
+  slot = (struct shell_cache_entry **) hash_find_slot (&shell_cache, &key);
+  e = *slot;
+
+  if (!HASH_VACANT (e) && e->nstamps == k.nstamps
+      && memcmp (e->stamps, k.stamps, k.nstamps * sizeof (uintmax_t)) == 0)
+    {
+      ++shell_cache_hits;
+      DB (DB_VERBOSE, (_("Using cached output of shell command '%s'\n"),
+                       command));
+      *output = e->output;
+      *length = e->length;
+      free (k.key);
+      free (k.stamps);
+      return 1;
+    }
+
+  ++shell_cache_misses;
+  DB (DB_VERBOSE, (_("Shell command '%s' is not cached\n"), command));
+
+  if (HASH_VACANT (e))
+    {
+      e = xcalloc (sizeof (*e));
+      e->key = k.key;
+      e->key_length = k.length;
+      e->hash = key.hash;
+      hash_insert_at (&shell_cache, e, slot);
+    }
+  else
+    {
+      /* A stale entry; the old output, if it was loaded, stays where it
+         is in the file buffer.  */
+      free (k.key);
+      free (e->stamps);
+      e->output = 0;
+      e->length = 0;
+    }
+  e->stamps = k.stamps;
+  e->nstamps = k.nstamps;
+  pending = e;
+
+  /* Until the command has given its output, the entry can't be used.  */
+  e->stamps[0] = ~e->stamps[0];
+  return 0;
+}
+
+void
+shell_cache_store (const char *output, unsigned int length, int status)
+{
+  char *copy;
+
+  if (pending == 0)
+    return;
+
+  /* A command that failed may do better next time; leave the entry
+     unusable, and out of the file.  */
+  if (status != 0)
+    {
+      pending = 0;
+      return;
+    }
+
+  copy = xmalloc (length + 1);
+  memcpy (copy, output, length);
+  pending->output = copy;
+  pending->length = length;
+  pending->stamps[0] = ~pending->stamps[0];
+  pending = 0;
+  shell_cache_changed = 1;
+}
+
+
+/* Writing the cache.  */
+
+static char *wbuf;
+static size_t wlen;
+static size_t wsize;
+
+static void
+put_bytes (const void *p, size_t len)
+{
+  if (wlen + len > wsize)
+    {
+      wsize = (wlen + len) * 2;
+      wbuf = xrealloc (wbuf, wsize);
+    }
+  memcpy (wbuf + wlen, p, len);
+  wlen += len;
+}
+
+static void
+put_num (uintmax_t n)
+{
+  put_bytes (&n, sizeof (n));
+}
+
+static void
+put_counted (const char *p, unsigned int len)
+{
+  put_num (len);
+  put_bytes (p, len);
+}
+
+static uintmax_t put_count;
+
+static void
+count_entry (const void *item)
+{
+  const struct shell_cache_entry *e = item;
+
+  if (e->output != 0)
+    ++put_count;
+}
+
+static void
+put_entry (const void *item)
+{
+  const struct shell_cache_entry *e = item;
+  unsigned int i;
+
+  /* Commands that never gave their output aren't stored.  */
+  if (e->output == 0)
+    return;
+
+  put_counted (e->key, e->key_length);
+  put_num (e->nstamps);
+  for (i = 0; i < e->nstamps; ++i)
+    put_num (e->stamps[i]);
+  put_counted (e->output, e->length);
+}
+
+void
+shell_cache_save (void)
+{
+  char *tmpname;
+  FILE *fp;
+  int ok;
+
+  if (!shell_cache_loaded)
+    return;
+
+  DB (DB_BASIC, (_("Shell cache '%s': %lu hits, %lu misses\n"),
+                 shell_cache_name, shell_cache_hits, shell_cache_misses));
+
+  if (!shell_cache_changed)
+    return;
+  shell_cache_changed = 0;
+
+  /* Keep what other makes in this directory, such as sub-makes, have
+     stored since we read the file.  */
+  if (!clear_shell_cache_flag)
+    read_shell_cache (1);
+
+  wlen = 0;
+  put_bytes (SHELL_CACHE_MAGIC, CSTRLEN (SHELL_CACHE_MAGIC));
+  put_counted (version_string, strlen (version_string));
+  put_count = 0;
+  hash_map (&shell_cache, count_entry);
+  put_num (put_count);
+  hash_map (&shell_cache, put_entry);
+  put_bytes (SHELL_CACHE_TRAILER, CSTRLEN (SHELL_CACHE_TRAILER));
+
+  /* Write a temporary file and rename it into place, so that a concurrent
+     or interrupted make never sees half a cache.  */
+  tmpname = xmalloc (strlen (shell_cache_name) + 32);
+  sprintf (tmpname, "%s.%ld.tmp", shell_cache_name, (long) getpid ());
+
+  ENULLLOOP (fp, fopen (tmpname, "wb"));
+  ok = fp != 0;
+  if (ok)
+    {
+      ok = fwrite (wbuf, 1, wlen, fp) == wlen;
+      ok = (fclose (fp) == 0) && ok;
+      ok = ok && rename (tmpname, shell_cache_name) == 0;
+      if (!ok)
+        {
+          int e = errno;
+          unlink (tmpname);
+          errno = e;
+        }
+    }
+  if (!ok)
+    OSS (error, NILF, _("warning: cannot write shell cache '%s': %s"),
+         shell_cache_name, strerror (errno));
+
+  free (tmpname);
+}
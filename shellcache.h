@@ -0,0 +1,55 @@
+/* Caching the results of $(shell ...) across runs of GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/** \file shellcache.h
+ *
+ *  \brief Header for the .CACHE_SHELL cache of $(shell ...) results.
+ */
+
+#ifndef REMAKE_SHELLCACHE_H
+#define REMAKE_SHELLCACHE_H
+
+/*! Name of the file, in the directory make starts in, where the results
+    are kept.  */
+#define SHELL_CACHE_FILE        ".make-shell-cache"
+
+/*! Nonzero means ignore the results cached by earlier runs
+    (--clear-shell-cache).  */
+extern int clear_shell_cache_flag;
+
+/*! Look for the output of COMMAND in the cache, if .CACHE_SHELL is
+    defined.  The output is only used if it was stored for the same
+    command, shell, shell flags, directory and environment, and none of
+    the files named in .CACHE_SHELL has changed since.
+
+    @return 1 and set *OUTPUT and *LENGTH to the output as the command
+    wrote it, newlines and all, if it was found.  Otherwise return 0 and,
+    if .CACHE_SHELL is defined, remember COMMAND for shell_cache_store.
+*/
+extern int shell_cache_lookup (const char *command, const char **output,
+                               unsigned int *length);
+
+/*! Store the LENGTH bytes at OUTPUT as the output of the command last
+    given to shell_cache_lookup, if it was to be cached and its exit
+    STATUS is zero.  */
+extern void shell_cache_store (const char *output, unsigned int length,
+                               int status);
+
+/*! Write the cache back if anything was stored in it, and report how
+    often it was used.  Failing to write the cache is not an error.  */
+extern void shell_cache_save (void);
+
+#endif /*REMAKE_SHELLCACHE_H*/
@@ -0,0 +1,1145 @@
+/* Saving and restoring the parsed makefile data base for GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* A snapshot records everything that reading the makefiles leaves behind:
+   the file data base, the global and pattern-specific variables, the
+   pattern rules, the selective vpath lists and the chain of makefiles that
+   were read.  It is keyed on the command line, the environment, the
+   working directory and the identity and modification time of every
+   makefile that was read (or looked for and not found), so any change to
+   those makes the snapshot stale and the makefiles are read as usual.
+
+   The results of $(shell ...), $(wildcard ...) and the like are frozen in
+   the snapshot, as is any output they produced: that is the price of not
+   reading the makefiles.  Makefiles that use 'load' are never saved.
+
+   The format is private to one build of make on one machine: numbers are
+   stored in native byte order and strings are stored with their length
+   and a trailing nul so they can be used in place.  */
+
+#include "makeint.h"
+
+#include <assert.h>
+
+#include "filedef.h"
+#include "file.h"
+#include "dep.h"
+#include "variable.h"
+#include "rule.h"
+#include "commands.h"
+#include "debug.h"
+#include "snapshot.h"
+
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+# include <sys/mman.h>
+#endif
+
+#define SNAPSHOT_MAGIC          "remake snapshot 1\n"
+#define SNAPSHOT_TRAILER        "end of snapshot\n"
+
+/* Length stored for a null string pointer.  */
+#define NULL_STRING             ((uintmax_t) -1)
+
+/* Bits in the flags word stored for a file.  */
+#define SF_IS_TARGET            (1 << 0)
+#define SF_BUILTIN              (1 << 1)
+#define SF_PRECIOUS             (1 << 2)
+#define SF_PHONY                (1 << 3)
+#define SF_INTERMEDIATE         (1 << 4)
+#define SF_SECONDARY            (1 << 5)
+#define SF_DONTCARE             (1 << 6)
+#define SF_LOW_RESOLUTION_TIME  (1 << 7)
+#define SF_DOUBLE_COLON         (1 << 8)
+
+/* Bits in the flags word stored for a dependency.  The 'changed' member is
+   stored above these.  */
+#define SD_HAS_FILE             (1 << 0)
+#define SD_IGNORE_MTIME         (1 << 1)
+#define SD_STATICPATTERN        (1 << 2)
+#define SD_NEED_2ND_EXPANSION   (1 << 3)
+#define SD_DONTCARE             (1 << 4)
+#define SD_CHANGED_SHIFT        8
+
+/* Bits in the flags word stored for a variable.  */
+#define SV_RECURSIVE            (1 << 0)
+#define SV_APPEND               (1 << 1)
+#define SV_CONDITIONAL          (1 << 2)
+#define SV_PER_TARGET           (1 << 3)
+#define SV_SPECIAL              (1 << 4)
+#define SV_EXPORTABLE           (1 << 5)
+#define SV_PRIVATE              (1 << 6)
+
+char *snapshot_file = NULL;
+
+
+/* Writing a snapshot.  Everything is collected in memory first and written
+   to the file in one go.  */
+
+static char *wbuf;
+static size_t wlen;
+static size_t wsize;
+
+static void
+put_bytes (const void *p, size_t len)
+{
+  if (wlen + len > wsize)
+    {
+      wsize = (wlen + len) * 2;
+      wbuf = xrealloc (wbuf, wsize);
+    }
+  memcpy (wbuf + wlen, p, len);
+  wlen += len;
+}
+
+static void
+put_num (uintmax_t n)
+{
+  put_bytes (&n, sizeof (n));
+}
+
+static void
+put_str (const char *s)
+{
+  if (s == 0)
+    put_num (NULL_STRING);
+  else
+    {
+      size_t len = strlen (s);
+      put_num (len);
+      put_bytes (s, len + 1);
+    }
+}
+
+/* Store what we know about the makefile NAME: whether it exists and, if
+   so, which file it is and when it was last changed.  */
+
+static void
+put_makefile_stat (const char *name)
+{
+  struct stat st;
+  int r;
+
+  put_str (name);
+  EINTRLOOP (r, stat (name, &st));
+  if (r != 0)
+    {
+      put_num (0);
+      return;
+    }
+  put_num (1);
+  put_num (st.st_dev);
+  put_num (st.st_ino);
+  put_num (st.st_size);
+  put_num (FILE_TIMESTAMP_STAT_MODTIME (name, st));
+}
+
+static void
+put_strings (char **list, uintmax_t n)
+{
+  uintmax_t i;
+
+  put_num (n);
+  for (i = 0; i < n; ++i)
+    put_str (list[i]);
+}
+
+static void
+put_key (int argc, char **argv, char **envp)
+{
+  const char **mf;
+  struct dep *d;
+  uintmax_t n;
+
+  put_str (version_string);
+  put_str (starting_directory);
+  put_strings (argv, argc);
+  for (n = 0; envp[n] != 0; ++n)
+    ;
+  put_strings (envp, n);
+
+  for (n = 0, d = read_makefiles; d != 0; d = d->next)
+    ++n;
+  for (mf = default_makefiles; *mf != 0; ++mf)
+    ++n;
+  put_num (n);
+  for (d = read_makefiles; d != 0; d = d->next)
+    put_makefile_stat (dep_name (d));
+  for (mf = default_makefiles; *mf != 0; ++mf)
+    put_makefile_stat (*mf);
+}
+
+static void
+put_variable (const struct variable *v)
+{
+  put_str (v->name);
+  put_str (v->value);
+  put_str (v->fileinfo.filenm);
+  put_num (v->fileinfo.lineno);
+  put_num ((v->recursive ? SV_RECURSIVE : 0)
+           | (v->append ? SV_APPEND : 0)
+           | (v->conditional ? SV_CONDITIONAL : 0)
+           | (v->per_target ? SV_PER_TARGET : 0)
+           | (v->special ? SV_SPECIAL : 0)
+           | (v->exportable ? SV_EXPORTABLE : 0)
+           | (v->private_var ? SV_PRIVATE : 0));
+  put_num (v->flavor);
+  put_num (v->origin);
+  put_num (v->export);
+}
+
+static void
+put_variable_set (struct variable_set *set)
+{
+  struct variable **vp = (struct variable **) set->table.ht_vec;
+  struct variable **end = vp + set->table.ht_size;
+
+  put_num (set->table.ht_fill);
+  for (; vp < end; ++vp)
+    if (! HASH_VACANT (*vp))
+      put_variable (*vp);
+}
+
+/* Rules often share one 'struct commands' between all their targets.
+   Remember which ones have been written so each is only stored once and
+   the sharing survives a reload.  */
+
+struct commands_ref
+  {
+    const struct commands *cmds;
+    unsigned long idx;
+  };
+
+static struct hash_table commands_refs;
+static unsigned long commands_count;
+
+static unsigned long
+commands_ref_hash_1 (const void *key)
+{
+  return (unsigned long) ((const struct commands_ref *) key)->cmds >> 3;
+}
+
+static unsigned long
+commands_ref_hash_2 (const void *key)
+{
+  return (unsigned long) ((const struct commands_ref *) key)->cmds >> 7;
+}
+
+static int
+commands_ref_hash_cmp (const void *x, const void *y)
+{
+  const struct commands *cx = ((const struct commands_ref *) x)->cmds;
+  const struct commands *cy = ((const struct commands_ref *) y)->cmds;
+  return cx == cy ? 0 : cx < cy ? -1 : 1;
+}
+
+static void
+put_commands (const struct commands *cmds)
+{
+  struct commands_ref key;
+  struct commands_ref **slot;
+  struct commands_ref *ref;
+
+  if (cmds == 0)
+    {
+      put_num (0);
+      return;
+    }
+
+  key.cmds = cmds;
+  slot = (struct commands_ref **) hash_find_slot (&commands_refs, &key);
+  if (! HASH_VACANT (*slot))
+    {
+      put_num ((*slot)->idx);
+      return;
+    }
+
+  ref = xmalloc (sizeof (struct commands_ref));
+  ref->cmds = cmds;
+  ref->idx = ++commands_count;
+  hash_insert_at (&commands_refs, ref, slot);
+
+  put_num (ref->idx);
+  put_str (cmds->fileinfo.filenm);
+  put_num (cmds->fileinfo.lineno);
+  put_str (cmds->commands);
+  put_num ((unsigned char) cmds->recipe_prefix);
+}
+
+static void
+put_deps (const struct dep *deps)
+{
+  const struct dep *d;
+  uintmax_t n;
+
+  for (n = 0, d = deps; d != 0; d = d->next)
+    ++n;
+  put_num (n);
+
+  for (d = deps; d != 0; d = d->next)
+    {
+      put_str (dep_name (d));
+      put_str (d->stem);
+      put_num ((d->name == 0 ? SD_HAS_FILE : 0)
+               | (d->ignore_mtime ? SD_IGNORE_MTIME : 0)
+               | (d->staticpattern ? SD_STATICPATTERN : 0)
+               | (d->need_2nd_expansion ? SD_NEED_2ND_EXPANSION : 0)
+               | (d->dontcare ? SD_DONTCARE : 0)
+               | ((uintmax_t) d->changed << SD_CHANGED_SHIFT));
+    }
+}
+
+static void
+put_file (const struct file *f)
+{
+  put_str (f->name);
+  put_str (f->floc.filenm);
+  put_num (f->floc.lineno);
+  put_num (f->nlines);
+  put_str (f->description);
+  put_str (f->stem);
+  put_num ((f->is_target ? SF_IS_TARGET : 0)
+           | (f->builtin ? SF_BUILTIN : 0)
+           | (f->precious ? SF_PRECIOUS : 0)
+           | (f->phony ? SF_PHONY : 0)
+           | (f->intermediate ? SF_INTERMEDIATE : 0)
+           | (f->secondary ? SF_SECONDARY : 0)
+           | (f->dontcare ? SF_DONTCARE : 0)
+           | (f->low_resolution_time ? SF_LOW_RESOLUTION_TIME : 0)
+           | (f->double_colon ? SF_DOUBLE_COLON : 0));
+  put_commands (f->cmds);
+  put_deps (f->deps);
+
+  put_num (f->variables != 0);
+  if (f->variables != 0)
+    put_variable_set (f->variables->set);
+}
+
+static void
+put_files (void)
+{
+  struct file **fp = (struct file **) files.ht_vec;
+  struct file **end = fp + files.ht_size;
+
+  put_num (files.ht_fill);
+  for (; fp < end; ++fp)
+    if (! HASH_VACANT (*fp))
+      {
+        const struct file *f;
+        uintmax_t n;
+
+        /* Double-colon rules chain further entries for the same name
+           through 'prev'.  */
+        for (n = 0, f = *fp; f != 0; f = f->prev)
+          ++n;
+        put_num (n);
+        for (f = *fp; f != 0; f = f->prev)
+          put_file (f);
+      }
+}
+
+static void
+put_pattern_rules (void)
+{
+  const struct rule *r;
+  uintmax_t n;
+
+  for (n = 0, r = pattern_rules; r != 0; r = r->next)
+    ++n;
+  put_num (n);
+
+  for (r = pattern_rules; r != 0; r = r->next)
+    {
+      unsigned int i;
+
+      put_num (r->num);
+      for (i = 0; i < r->num; ++i)
+        {
+          put_str (r->targets[i]);
+          /* Where the '%' is; the target may contain escaped ones too.  */
+          put_num (r->suffixes[i] - r->targets[i] - 1);
+        }
+      put_num (r->terminal);
+      put_deps (r->deps);
+      put_commands (r->cmds);
+    }
+}
+
+static void
+put_pattern_vars (void)
+{
+  const struct pattern_var *p;
+  uintmax_t n;
+
+  for (n = 0, p = pattern_vars; p != 0; p = p->next)
+    ++n;
+  put_num (n);
+
+  for (p = pattern_vars; p != 0; p = p->next)
+    {
+      put_str (p->target);
+      put_num (p->suffix - p->target - 1);
+      put_variable (&p->variable);
+    }
+}
+
+static uintmax_t vpath_count;
+
+static void
+count_vpath (const char *pattern UNUSED, const char **searchpath UNUSED)
+{
+  ++vpath_count;
+}
+
+static void
+put_vpath (const char *pattern, const char **searchpath)
+{
+  uintmax_t n;
+
+  put_str (pattern);
+  for (n = 0; searchpath[n] != 0; ++n)
+    ;
+  put_strings ((char **) searchpath, n);
+}
+
+static void
+put_read_makefiles (void)
+{
+  const struct dep *d;
+  uintmax_t n;
+
+  for (n = 0, d = read_makefiles; d != 0; d = d->next)
+    ++n;
+  put_num (n);
+
+  for (d = read_makefiles; d != 0; d = d->next)
+    {
+      put_str (dep_name (d));
+      put_num (d->changed);
+      put_num (d->dontcare);
+    }
+}
+
+void
+snapshot_save (const char *fname, int argc, char **argv, char **envp)
+{
+  struct variable *v;
+  char *tmpname;
+  FILE *fp;
+  int ok;
+
+  /* Functions defined by loaded objects would be missing on reload.  */
+  v = lookup_variable (STRING_SIZE_TUPLE (".LOADED"));
+  if (v != 0 && *v->value != '\0')
+    {
+      DB (DB_BASIC, (_("Not writing makefile snapshot '%s': objects were loaded\n"),
+                     fname));
+      return;
+    }
+
+  DB (DB_BASIC, (_("Writing makefile snapshot '%s'...\n"), fname));
+
+  wlen = 0;
+  put_bytes (SNAPSHOT_MAGIC, CSTRLEN (SNAPSHOT_MAGIC));
+  put_key (argc, argv, envp);
+
+  put_num (posix_pedantic);
+  put_num (second_expansion);
+  put_num (one_shell);
+  put_num (export_all_variables);
+
+  hash_init (&commands_refs, 1024, commands_ref_hash_1, commands_ref_hash_2,
+             commands_ref_hash_cmp);
+  commands_count = 0;
+
+  put_variable_set (current_variable_set_list->set);
+  put_pattern_vars ();
+  put_files ();
+  put_pattern_rules ();
+
+  vpath_count = 0;
+  map_vpath_lists (count_vpath);
+  put_num (vpath_count);
+  map_vpath_lists (put_vpath);
+
+  put_read_makefiles ();
+  put_bytes (SNAPSHOT_TRAILER, CSTRLEN (SNAPSHOT_TRAILER));
+
+  hash_free (&commands_refs, 1);
+
+  /* Write a temporary file and rename it into place, so that a concurrent
+     or interrupted make never sees half a snapshot.  */
+  tmpname = xmalloc (strlen (fname) + 32);
+  sprintf (tmpname, "%s.%ld.tmp", fname, (long) getpid ());
+
+  ENULLLOOP (fp, fopen (tmpname, "wb"));
+  ok = fp != 0;
+  if (ok)
+    {
+      ok = fwrite (wbuf, 1, wlen, fp) == wlen;
+      ok = (fclose (fp) == 0) && ok;
+      ok = ok && rename (tmpname, fname) == 0;
+      if (!ok)
+        {
+          int e = errno;
+          unlink (tmpname);
+          errno = e;
+        }
+    }
+  if (!ok)
+    OSS (error, NILF, _("warning: cannot write makefile snapshot '%s': %s"),
+         fname, strerror (errno));
+
+  free (tmpname);
+}
+
+
+/* Reading a snapshot.  The key is checked before anything is touched; once
+   it matches, the rest of the file is trusted to be what we wrote.  */
+
+static const char *rcur;
+static const char *rend;
+static int rbad;
+
+static uintmax_t
+get_num (void)
+{
+  uintmax_t n;
+
+  if (rbad || (size_t) (rend - rcur) < sizeof (n))
+    {
+      rbad = 1;
+      return 0;
+    }
+  memcpy (&n, rcur, sizeof (n));
+  rcur += sizeof (n);
+  return n;
+}
+
+static const char *
+get_str (void)
+{
+  uintmax_t len = get_num ();
+  const char *s;
+
+  if (rbad || len == NULL_STRING)
+    return 0;
+  if ((uintmax_t) (rend - rcur) <= len || rcur[len] != '\0')
+    {
+      rbad = 1;
+      return 0;
+    }
+  s = rcur;
+  rcur += len + 1;
+  return s;
+}
+
+/* Like get_str, but the string must be there.  Returns "" on error.  */
+
+static const char *
+get_name (void)
+{
+  const char *s = get_str ();
+
+  if (s == 0)
+    {
+      rbad = 1;
+      return "";
+    }
+  return s;
+}
+
+static const char *
+get_cached_str (void)
+{
+  const char *s = get_str ();
+  return s == 0 ? 0 : strcache_add (s);
+}
+
+static int
+check_strings (char **list, uintmax_t n)
+{
+  uintmax_t i;
+
+  if (get_num () != n)
+    return 0;
+  for (i = 0; i < n; ++i)
+    {
+      const char *s = get_str ();
+      if (s == 0 || !streq (s, list[i]))
+        return 0;
+    }
+  return 1;
+}
+
+/* Return NULL if the key at RCUR matches this run, or why it doesn't.  */
+
+static const char *
+check_key (int argc, char **argv, char **envp)
+{
+  const char *s;
+  uintmax_t n;
+
+  s = get_str ();
+  if (s == 0 || !streq (s, version_string))
+    return _("written by a different version of make");
+  s = get_str ();
+  if (s == 0 || starting_directory == 0 || !streq (s, starting_directory))
+    return _("working directory changed");
+  if (!check_strings (argv, argc))
+    return _("command line changed");
+  for (n = 0; envp[n] != 0; ++n)
+    ;
+  if (!check_strings (envp, n))
+    return _("environment changed");
+
+  n = get_num ();
+  while (n-- > 0 && !rbad)
+    {
+      const char *name = get_name ();
+      struct stat st;
+      int r;
+
+      EINTRLOOP (r, stat (name, &st));
+      if (get_num () != (r == 0))
+        return _("a makefile was created or removed");
+      if (r == 0
+          && (get_num () != (uintmax_t) st.st_dev
+              || get_num () != (uintmax_t) st.st_ino
+              || get_num () != (uintmax_t) st.st_size
+              || get_num () != FILE_TIMESTAMP_STAT_MODTIME (name, st)))
+        return _("a makefile changed");
+    }
+
+  return rbad ? _("file is corrupt") : 0;
+}
+
+static void
+get_variable_flags (struct variable *v)
+{
+  uintmax_t flags = get_num ();
+
+  v->recursive = (flags & SV_RECURSIVE) != 0;
+  v->append = (flags & SV_APPEND) != 0;
+  v->conditional = (flags & SV_CONDITIONAL) != 0;
+  v->per_target = (flags & SV_PER_TARGET) != 0;
+  v->special = (flags & SV_SPECIAL) != 0;
+  v->exportable = (flags & SV_EXPORTABLE) != 0;
+  v->private_var = (flags & SV_PRIVATE) != 0;
+  v->flavor = get_num ();
+  v->origin = get_num ();
+  v->export = get_num ();
+}
+
+/* Read one variable into SET, replacing any existing definition whatever
+   its origin.  */
+
+static struct variable *
+get_variable (struct variable_set *set)
+{
+  const char *name = get_name ();
+  const char *value = get_name ();
+  gmk_floc floc;
+  struct variable *v;
+
+  floc.filenm = get_cached_str ();
+  floc.lineno = get_num ();
+
+  v = lookup_variable_in_set (name, strlen (name), set);
+  if (v == 0)
+    v = define_variable_in_set (name, strlen (name), value, o_file, 0, set,
+                                &floc);
+  else
+    {
+      forget_expansion (v);
+      free (v->value);
+      v->value = xstrdup (value);
+      v->fileinfo = floc;
+    }
+  get_variable_flags (v);
+  return v;
+}
+
+static int
+variable_ptr_cmp (const void *x, const void *y)
+{
+  const struct variable *vx = *(struct variable *const *) x;
+  const struct variable *vy = *(struct variable *const *) y;
+  return vx == vy ? 0 : vx < vy ? -1 : 1;
+}
+
+/* Load the global variable set.  Variables that exist now but not in the
+   snapshot were undefined by the makefiles, so undefine them again.  */
+
+static void
+get_global_variables (void)
+{
+  struct variable_set *set = current_variable_set_list->set;
+  uintmax_t n = get_num ();
+  struct variable **loaded;
+  struct variable **vp;
+  struct variable **dump;
+  uintmax_t i;
+
+  if (rbad)
+    return;
+
+  loaded = xmalloc ((n ? n : 1) * sizeof (struct variable *));
+  for (i = 0; i < n && !rbad; ++i)
+    loaded[i] = get_variable (set);
+  if (rbad)
+    n = i;
+  qsort (loaded, n, sizeof (struct variable *), variable_ptr_cmp);
+
+  dump = (struct variable **) hash_dump (&set->table, 0, 0);
+  for (vp = dump; *vp != 0; ++vp)
+    if (bsearch (vp, loaded, n, sizeof (struct variable *),
+                 variable_ptr_cmp) == 0)
+      undefine_variable_in_set ((*vp)->name, (*vp)->length, o_automatic,
+                                set);
+
+  free (dump);
+  free (loaded);
+}
+
+static struct commands **commands_vec;
+static unsigned long commands_vec_size;
+
+static struct commands *
+get_commands (void)
+{
+  uintmax_t idx = get_num ();
+  struct commands *cmds;
+
+  if (idx == 0 || rbad)
+    return 0;
+  if (idx <= commands_count)
+    return commands_vec[idx - 1];
+  if (idx != commands_count + 1)
+    {
+      rbad = 1;
+      return 0;
+    }
+
+  cmds = xcalloc (sizeof (struct commands));
+  cmds->fileinfo.filenm = get_cached_str ();
+  cmds->fileinfo.lineno = get_num ();
+  cmds->commands = xstrdup (get_name ());
+  cmds->recipe_prefix = (char) get_num ();
+
+  if (commands_count == commands_vec_size)
+    {
+      commands_vec_size = commands_vec_size ? commands_vec_size * 2 : 64;
+      commands_vec = xrealloc (commands_vec,
+                               commands_vec_size * sizeof (struct commands *));
+    }
+  commands_vec[commands_count++] = cmds;
+  return cmds;
+}
+
+static struct dep *
+get_deps (void)
+{
+  struct dep *deps = 0;
+  struct dep **dp = &deps;
+  uintmax_t n = get_num ();
+
+  while (n-- > 0 && !rbad)
+    {
+      const char *name = get_name ();
+      const char *stem = get_cached_str ();
+      uintmax_t flags = get_num ();
+      struct dep *d = alloc_dep ();
+
+      if (flags & SD_HAS_FILE)
+        {
+          d->file = lookup_file (name);
+          if (d->file == 0)
+            d->file = enter_file (strcache_add (name));
+        }
+      else if (flags & SD_NEED_2ND_EXPANSION)
+        /* These are freed once they've been expanded.  */
+        d->name = xstrdup (name);
+      else
+        d->name = strcache_add (name);
+
+      d->stem = stem;
+      d->ignore_mtime = (flags & SD_IGNORE_MTIME) != 0;
+      d->staticpattern = (flags & SD_STATICPATTERN) != 0;
+      d->need_2nd_expansion = (flags & SD_NEED_2ND_EXPANSION) != 0;
+      d->dontcare = (flags & SD_DONTCARE) != 0;
+      d->changed = flags >> SD_CHANGED_SHIFT;
+
+      *dp = d;
+      dp = &d->next;
+    }
+
+  return deps;
+}
+
+/* Load one entry for a file.  FIRST is the first entry already loaded for
+   the same name if this is a further double-colon entry, else NULL.  */
+
+static struct file *
+get_file (struct file *first)
+{
+  const char *name = get_name ();
+  struct file *f;
+  uintmax_t flags;
+  const char *s;
+
+  if (rbad)
+    return 0;
+
+  if (first != 0)
+    /* FIRST is a double-colon entry, so this makes a new one.  */
+    f = enter_file (first->name);
+  else
+    {
+      f = lookup_file (name);
+      if (f == 0)
+        f = enter_file (strcache_add (name));
+    }
+
+  f->floc.filenm = get_cached_str ();
+  f->floc.lineno = get_num ();
+  f->nlines = get_num ();
+  s = get_str ();
+  f->description = s ? xstrdup (s) : 0;
+  f->stem = get_cached_str ();
+
+  flags = get_num ();
+  f->is_target = (flags & SF_IS_TARGET) != 0;
+  f->builtin = (flags & SF_BUILTIN) != 0;
+  f->precious = (flags & SF_PRECIOUS) != 0;
+  f->phony = (flags & SF_PHONY) != 0;
+  f->intermediate = (flags & SF_INTERMEDIATE) != 0;
+  f->secondary = (flags & SF_SECONDARY) != 0;
+  f->dontcare = (flags & SF_DONTCARE) != 0;
+  f->low_resolution_time = (flags & SF_LOW_RESOLUTION_TIME) != 0;
+  if (first == 0 && (flags & SF_DOUBLE_COLON))
+    f->double_colon = f;
+
+  f->cmds = get_commands ();
+
+  /* Files that existed before the makefiles were read, like .SUFFIXES,
+     may already have prerequisites: the snapshot has the final list.  */
+  free_dep_chain (f->deps);
+  f->deps = get_deps ();
+
+  if (get_num ())
+    {
+      uintmax_t n = get_num ();
+
+      initialize_file_variables (f, 1);
+      while (n-- > 0 && !rbad)
+        get_variable (f->variables->set);
+    }
+
+  return f;
+}
+
+static void
+get_files (void)
+{
+  uintmax_t n = get_num ();
+
+  while (n-- > 0 && !rbad)
+    {
+      uintmax_t entries = get_num ();
+      struct file *first = entries ? get_file (0) : 0;
+
+      while (--entries > 0 && !rbad)
+        get_file (first);
+    }
+}
+
+static void
+get_pattern_rules (void)
+{
+  uintmax_t n = get_num ();
+
+  while (n-- > 0 && !rbad)
+    {
+      unsigned int num = get_num ();
+      const char **targets;
+      const char **percents;
+      unsigned int i;
+      int terminal;
+      struct dep *deps;
+
+      if (num == 0)
+        {
+          rbad = 1;
+          break;
+        }
+
+      targets = xmalloc (num * sizeof (const char *));
+      percents = xmalloc (num * sizeof (const char *));
+      for (i = 0; i < num; ++i)
+        {
+          uintmax_t off;
+
+          targets[i] = strcache_add (get_name ());
+          off = get_num ();
+          if (off >= strlen (targets[i]))
+            {
+              rbad = 1;
+              off = 0;
+            }
+          percents[i] = targets[i] + off;
+        }
+      terminal = get_num ();
+      deps = get_deps ();
+
+      create_pattern_rule (targets, percents, num, terminal, deps,
+                           get_commands (), 1);
+    }
+}
+
+static void
+get_pattern_vars (void)
+{
+  uintmax_t n = get_num ();
+
+  while (n-- > 0 && !rbad)
+    {
+      const char *target = strcache_add (get_name ());
+      uintmax_t off = get_num ();
+      struct pattern_var *p;
+      struct variable *v;
+
+      if (off >= strlen (target))
+        {
+          rbad = 1;
+          break;
+        }
+
+      p = create_pattern_var (target, target + off);
+      v = &p->variable;
+      memset (v, '\0', sizeof (struct variable));
+      v->name = xstrdup (get_name ());
+      v->length = strlen (v->name);
+      v->value = xstrdup (get_name ());
+      v->fileinfo.filenm = get_cached_str ();
+      v->fileinfo.lineno = get_num ();
+      get_variable_flags (v);
+    }
+}
+
+static void
+get_vpaths (void)
+{
+  uintmax_t n = get_num ();
+  char **patterns;
+  char **dirpaths;
+  uintmax_t i;
+
+  if (rbad)
+    return;
+
+  patterns = xmalloc ((n ? n : 1) * sizeof (char *));
+  dirpaths = xmalloc ((n ? n : 1) * sizeof (char *));
+
+  for (i = 0; i < n && !rbad; ++i)
+    {
+      uintmax_t ndirs;
+      char *p;
+
+      patterns[i] = xstrdup (get_name ());
+
+      /* Join the directories back into a search path.  */
+      ndirs = get_num ();
+      p = dirpaths[i] = xstrdup ("");
+      while (ndirs-- > 0 && !rbad)
+        {
+          const char *dir = get_name ();
+          unsigned int len = p - dirpaths[i];
+
+          dirpaths[i] = xrealloc (dirpaths[i], len + strlen (dir) + 2);
+          p = dirpaths[i] + len;
+          if (len > 0)
+            *(p++) = PATH_SEPARATOR_CHAR;
+          strcpy (p, dir);
+          p += strlen (dir);
+        }
+    }
+  if (rbad)
+    n = i;
+
+  /* construct_vpath_list pushes each new list on the front, and they were
+     saved front first, so put them back in reverse.  */
+  for (i = n; i-- > 0; )
+    {
+      construct_vpath_list (patterns[i], dirpaths[i]);
+      free (patterns[i]);
+      free (dirpaths[i]);
+    }
+
+  free (patterns);
+  free (dirpaths);
+}
+
+static void
+get_read_makefiles (void)
+{
+  uintmax_t n = get_num ();
+  struct dep **deps;
+  uintmax_t i;
+
+  if (rbad)
+    return;
+
+  deps = xmalloc ((n ? n : 1) * sizeof (struct dep *));
+  for (i = 0; i < n && !rbad; ++i)
+    {
+      const char *name = get_name ();
+      struct dep *d = alloc_dep ();
+
+      d->file = lookup_file (name);
+      if (d->file == 0)
+        d->file = enter_file (strcache_add (name));
+      d->changed = get_num ();
+      d->dontcare = get_num ();
+      deps[i] = d;
+    }
+  if (rbad)
+    n = i;
+
+  read_makefiles = 0;
+  for (i = n; i-- > 0; )
+    {
+      deps[i]->next = read_makefiles;
+      read_makefiles = deps[i];
+    }
+
+  free (deps);
+}
+
+int
+snapshot_load (const char *fname, int argc, char **argv, char **envp)
+{
+  const char *why;
+  char *buf;
+  size_t size;
+  struct stat st;
+  int fd;
+  int r;
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  int mapped = 0;
+#endif
+
+  EINTRLOOP (fd, open (fname, O_RDONLY));
+  if (fd < 0)
+    {
+      DB (DB_BASIC, (_("No makefile snapshot '%s'\n"), fname));
+      return 0;
+    }
+
+  EINTRLOOP (r, fstat (fd, &st));
+  if (r != 0 || st.st_size <= 0)
+    {
+      close (fd);
+      return 0;
+    }
+  size = st.st_size;
+
+  /* Map the snapshot if we can; the key is usually all we look at when it
+     turns out to be stale.  */
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  buf = mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (buf != MAP_FAILED)
+    mapped = 1;
+  else
+#endif
+    {
+      char *p;
+      size_t left;
+
+      p = buf = xmalloc (size);
+      for (left = size; left > 0; )
+        {
+          ssize_t cc;
+          EINTRLOOP (cc, read (fd, p, left));
+          if (cc <= 0)
+            break;
+          p += cc;
+          left -= cc;
+        }
+      if (left > 0)
+        size -= left;
+    }
+  close (fd);
+
+  rcur = buf;
+  rend = buf + size;
+  rbad = 0;
+
+  if (size < CSTRLEN (SNAPSHOT_MAGIC) + CSTRLEN (SNAPSHOT_TRAILER)
+      || memcmp (buf, SNAPSHOT_MAGIC, CSTRLEN (SNAPSHOT_MAGIC)) != 0
+      || memcmp (rend - CSTRLEN (SNAPSHOT_TRAILER), SNAPSHOT_TRAILER,
+                 CSTRLEN (SNAPSHOT_TRAILER)) != 0)
+    why = _("not a snapshot");
+  else
+    {
+      rcur += CSTRLEN (SNAPSHOT_MAGIC);
+      rend -= CSTRLEN (SNAPSHOT_TRAILER);
+      why = check_key (argc, argv, envp);
+    }
+
+  if (why == 0 && (pattern_rules != 0 || pattern_vars != 0))
+    why = _("rules were defined before reading makefiles");
+
+  if (why != 0)
+    DB (DB_BASIC, (_("Makefile snapshot '%s' is out of date: %s\n"),
+                   fname, why));
+  else
+    {
+      DB (DB_BASIC, (_("Reading makefiles from snapshot '%s'...\n"), fname));
+
+      posix_pedantic = get_num ();
+      second_expansion = get_num ();
+      one_shell = get_num ();
+      export_all_variables = get_num ();
+
+      commands_count = 0;
+      get_global_variables ();
+      get_pattern_vars ();
+      get_files ();
+      get_pattern_rules ();
+      get_vpaths ();
+      get_read_makefiles ();
+
+      free (commands_vec);
+      commands_vec = 0;
+      commands_vec_size = 0;
+
+      /* We've changed the data base, so there is no going back.  */
+      if (rbad || rcur != rend)
+        OS (fatal, NILF, _("makefile snapshot '%s' is corrupt"), fname);
+    }
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  if (mapped)
+    munmap (buf, st.st_size);
+  else
+#endif
+    free (buf);
+
+  return why == 0;
+}
@@ -0,0 +1,45 @@
+/* Saving and restoring the parsed makefile data base for GNU Make.
+Copyright (C) 2014 Free Software Foundation, Inc.
+This file is part of GNU Make.
+
+GNU Make is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+GNU Make is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/** \file snapshot.h
+ *
+ *  \brief Header for the --snapshot makefile data base cache.
+ */
+
+#ifndef REMAKE_SNAPSHOT_H
+#define REMAKE_SNAPSHOT_H
+
+/*! Name of the snapshot file given with --snapshot, or NULL.  */
+extern char *snapshot_file;
+
+/*! Restore the state that reading the makefiles produced from the
+    snapshot in FNAME.  The snapshot is only used if it was written by a
+    run with the same ARGV, ENVP and working directory, and none of the
+    makefiles it was built from has changed since.
+
+    @return 1 if the snapshot was loaded, in which case the makefiles must
+    not be read again, or 0 if they have to be read as usual.
+*/
+extern int snapshot_load (const char *fname, int argc, char **argv,
+                          char **envp);
+
+/*! Write the state produced by reading the makefiles into FNAME, keyed on
+    ARGV, ENVP, the working directory and the makefiles that were read.
+    Failing to write the snapshot is not an error.  */
+extern void snapshot_save (const char *fname, int argc, char **argv,
+                           char **envp);
+
+#endif /*REMAKE_SNAPSHOT_H*/
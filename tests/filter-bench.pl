@@ -0,0 +1,103 @@
+#!/usr/bin/env perl
+# -*-perl-*-
+
+# Measure how fast make filters long word lists with many patterns.
+#
+# Usage: filter-bench.pl [-files N] [-patterns N] [-runs N] MAKE...
+#
+# Generates a makefile with a list of N source file names and a few dozen
+# patterns like the ones used to pick out tests, benchmarks and generated
+# files, some of them literal names, and expands $(filter) and
+# $(filter-out) of the two, with and without the literal names.  Each MAKE
+# is then run on it N times, and the best CPU time (user plus system) is
+# reported.  Give the make you built and the one you are comparing it with
+# to get a before/after figure; their runs are interleaved so that they see
+# the same load.
+
+use strict;
+use warnings;
+use File::Temp qw(tempdir);
+
+my $files = 100000;
+my $patterns = 48;
+my $runs = 3;
+
+while (@ARGV && $ARGV[0] =~ /^-/) {
+  my $opt = shift @ARGV;
+  if ($opt eq '-files') {
+    $files = shift @ARGV;
+  } elsif ($opt eq '-patterns') {
+    $patterns = shift @ARGV;
+  } elsif ($opt eq '-runs') {
+    $runs = shift @ARGV;
+  } else {
+    die "filter-bench.pl: unknown option '$opt'\n";
+  }
+}
+@ARGV or die "Usage: filter-bench.pl [-files N] [-patterns N] [-runs N] MAKE...\n";
+
+my $dir = tempdir('filter-bench-XXXXXX', TMPDIR => 1, CLEANUP => 1);
+my $mk = "$dir/filter.mk";
+
+my @kinds = qw(_test.c _bench.c _fuzz.c _mock.c .pb.c _gen.c _win.c _mac.c);
+my @suffixes = ('.c', '.cc', '.h', @kinds);
+
+# Suffix patterns, directory prefixes, patterns with both, and names.
+my @pats;
+for my $i (0 .. $patterns - 1) {
+  my $k = $i % 4;
+  if ($k == 0) {
+    push @pats, '%' . $kinds[($i / 4) % @kinds] . ($i >= 4 * @kinds ? "x$i" : '');
+  } elsif ($k == 1) {
+    push @pats, sprintf("src/dir%03d/%%", $i * 7 % 500);
+  } elsif ($k == 2) {
+    push @pats, sprintf("src/dir%03d/%%%s", $i * 11 % 500, $kinds[$i % @kinds]);
+  } else {
+    my $n = $i * 997 % $files;
+    push @pats, sprintf("src/dir%03d/file%06d%s", $n % 500, $n,
+                        $suffixes[$n * 7 % @suffixes]);
+  }
+}
+
+open(my $fh, '>', $mk) or die "filter-bench.pl: $mk: $!\n";
+print $fh "SRCS :=";
+for my $n (0 .. $files - 1) {
+  printf $fh " \\\n src/dir%03d/file%06d%s", $n % 500, $n,
+    $suffixes[$n * 7 % @suffixes];
+}
+print $fh "\n";
+print $fh "PATS := @pats\n";
+print $fh "LITS := ", join(' ', grep { !/%/ } @pats), "\n";
+print $fh <<'EOF';
+KEEP := $(filter-out $(PATS),$(SRCS))
+SOME := $(filter $(PATS),$(SRCS))
+NAMED := $(filter-out $(LITS),$(SRCS))
+.PHONY: nothing
+nothing: ; @echo $(words $(KEEP)) $(words $(SOME)) $(words $(NAMED))
+EOF
+close($fh) or die "filter-bench.pl: $mk: $!\n";
+
+printf "%s: %d files, %d patterns\n", $mk, $files, scalar @pats;
+
+my %best;
+my %out;
+for (1 .. $runs) {
+  foreach my $make (@ARGV) {
+    my (undef, undef, $cuser, $csys) = times;
+    my $out = `$make -s -r -f $mk nothing`;
+    $? == 0 or die "filter-bench.pl: $make failed\n";
+    my (undef, undef, $cuser2, $csys2) = times;
+    my $elapsed = ($cuser2 - $cuser) + ($csys2 - $csys);
+    $best{$make} = $elapsed
+      if !defined $best{$make} || $elapsed < $best{$make};
+    $out{$make} = $out;
+  }
+}
+
+foreach my $make (@ARGV) {
+  chomp $out{$make};
+  printf "%-40s %8.3f s   kept/matched/named %s\n", $make, $best{$make},
+    $out{$make};
+}
+
+exit 0;
@@ -0,0 +1,82 @@
+#!/usr/bin/env perl
+# -*-perl-*-
+
+# Measure how fast make reads a large makefile.
+#
+# Usage: parse-bench.pl [-size MB] [-runs N] MAKE...
+#
+# Generates a makefile of about MB megabytes that looks like the output of
+# a dependency generator: a few variables and pattern rules followed by long
+# prerequisite lists, some of them folded with backslash/newline.  Each MAKE
+# is then run on it N times with nothing to do, and the best CPU time (user
+# plus system) is reported in MB/s.  Give the make you built and the one you
+# are comparing it with to get a before/after figure; their runs are
+# interleaved so that they see the same load.
+
+use strict;
+use warnings;
+use File::Temp qw(tempdir);
+
+my $size_mb = 50;
+my $runs = 3;
+
+while (@ARGV && $ARGV[0] =~ /^-/) {
+  my $opt = shift @ARGV;
+  if ($opt eq '-size') {
+    $size_mb = shift @ARGV;
+  } elsif ($opt eq '-runs') {
+    $runs = shift @ARGV;
+  } else {
+    die "parse-bench.pl: unknown option '$opt'\n";
+  }
+}
+@ARGV or die "Usage: parse-bench.pl [-size MB] [-runs N] MAKE...\n";
+
+my $dir = tempdir('parse-bench-XXXXXX', TMPDIR => 1, CLEANUP => 1);
+my $mk = "$dir/big.mk";
+
+open(my $fh, '>', $mk) or die "parse-bench.pl: $mk: $!\n";
+print $fh <<'EOF';
+.PHONY: nothing
+nothing: ; @:
+CFLAGS = -O2 -g
+OBJDIR := obj
+$(OBJDIR)/%.o: src/%.c ; $(CC) $(CFLAGS) -c -o $@ $<
+EOF
+
+my $n = 0;
+while (tell($fh) < $size_mb * 1024 * 1024) {
+  my $dep = sprintf("obj/module%06d.o: src/module%06d.c", $n, $n);
+  for my $i (1 .. 20) {
+    my $hdr = sprintf(" include/sub%02d/header%04d.h", $i, ($n * 7 + $i) % 5000);
+    # Generated dependency files fold every few headers.
+    $dep .= ($i % 4 == 0) ? " \\\n $hdr" : $hdr;
+  }
+  print $fh "$dep\n";
+  printf $fh "module%06d_FLAGS := -DMODULE=%d\n", $n, $n;
+  ++$n;
+}
+my $bytes = tell($fh);
+close($fh) or die "parse-bench.pl: $mk: $!\n";
+
+printf "%s: %.1f MB, %d rules\n", $mk, $bytes / (1024 * 1024), $n;
+
+my %best;
+for (1 .. $runs) {
+  foreach my $make (@ARGV) {
+    my (undef, undef, $cuser, $csys) = times;
+    system($make, '-s', '-r', '-f', $mk, 'nothing') == 0
+      or die "parse-bench.pl: $make failed\n";
+    my (undef, undef, $cuser2, $csys2) = times;
+    my $elapsed = ($cuser2 - $cuser) + ($csys2 - $csys);
+    $best{$make} = $elapsed
+      if !defined $best{$make} || $elapsed < $best{$make};
+  }
+}
+
+foreach my $make (@ARGV) {
+  printf "%-40s %8.3f s %8.1f MB/s\n", $make, $best{$make},
+    $bytes / (1024 * 1024) / $best{$make};
+}
+
+exit 0;
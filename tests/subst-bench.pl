@@ -0,0 +1,94 @@
+#!/usr/bin/env perl
+# -*-perl-*-
+
+# Measure how fast make substitutes in long word lists.
+#
+# Usage: subst-bench.pl [-size MB] [-runs N] MAKE...
+#
+# Generates a makefile that builds a list of about MB megabytes of source
+# file names, and expands each of the substitutions below on it ten times.
+# Each MAKE is run N times for each of them, and the best CPU time (user
+# plus system) is reported, along with the time to build the list alone.
+# Give the make you built and the one you are comparing it with to get a
+# before/after figure; their runs are interleaved so that they see the same
+# load.
+
+use strict;
+use warnings;
+use File::Temp qw(tempdir);
+
+my $size_mb = 10;
+my $runs = 3;
+
+while (@ARGV && $ARGV[0] =~ /^-/) {
+  my $opt = shift @ARGV;
+  if ($opt eq '-size') {
+    $size_mb = shift @ARGV;
+  } elsif ($opt eq '-runs') {
+    $runs = shift @ARGV;
+  } else {
+    die "subst-bench.pl: unknown option '$opt'\n";
+  }
+}
+@ARGV or die "Usage: subst-bench.pl [-size MB] [-runs N] MAKE...\n";
+
+my @cases = (
+  [ 'list only', '' ],
+  [ 'suffix reference', '$(SRCS:.c=.o)' ],
+  [ 'patsubst with prefix', '$(patsubst src/%.c,obj/%.o,$(SRCS))' ],
+  [ 'reference into dir', '$(SRCS:%.c=obj/%.o)' ],
+  [ 'subst', '$(subst .c,.o,$(SRCS))' ],
+  [ 'subst one char', '$(subst /,\\,$(SRCS))' ],
+  [ 'subst no match', '$(subst .cpp,.o,$(SRCS))' ],
+);
+
+my $dir = tempdir('subst-bench-XXXXXX', TMPDIR => 1, CLEANUP => 1);
+my $mk = "$dir/subst.mk";
+
+# Double a list of 256 names until it is big enough.
+my $names = join(' ', map { sprintf("src/mod%02d/file%04d.%s", $_ % 37, $_,
+                                    $_ % 5 ? 'c' : 'h') } 0 .. 255);
+my $bytes = length($names) + 1;
+my $n = 0;
+open(my $fh, '>', $mk) or die "subst-bench.pl: $mk: $!\n";
+print $fh "L0 := $names\n";
+while ($bytes < $size_mb * 1024 * 1024) {
+  ++$n;
+  print $fh "L$n := \$(L", $n - 1, ") \$(L", $n - 1, ")\n";
+  $bytes *= 2;
+}
+print $fh "SRCS := \$(L$n)\n";
+for my $i (0 .. $#cases) {
+  print $fh "CASE$i = $cases[$i][1]\n";
+}
+print $fh <<'EOF';
+.PHONY: nothing
+nothing: ; @echo $(foreach i,1 2 3 4 5 6 7 8 9 10,$(if $(CASE$(CASE)),,))
+EOF
+close($fh) or die "subst-bench.pl: $mk: $!\n";
+
+printf "%s: %.1f MB list\n", $mk, $bytes / (1024 * 1024);
+
+my %best;
+for (1 .. $runs) {
+  for my $i (0 .. $#cases) {
+    foreach my $make (@ARGV) {
+      my (undef, undef, $cuser, $csys) = times;
+      system("$make -s -r -f $mk CASE=$i nothing >/dev/null") == 0
+        or die "subst-bench.pl: $make failed\n";
+      my (undef, undef, $cuser2, $csys2) = times;
+      my $elapsed = ($cuser2 - $cuser) + ($csys2 - $csys);
+      $best{$make}[$i] = $elapsed
+        if !defined $best{$make}[$i] || $elapsed < $best{$make}[$i];
+    }
+  }
+}
+
+for my $i (0 .. $#cases) {
+  printf "%-22s %s\n", $cases[$i][0], $cases[$i][1];
+  foreach my $make (@ARGV) {
+    printf "    %-40s %8.3f s\n", $make, $best{$make}[$i];
+  }
+}
+
+exit 0;
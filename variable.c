@@ -28,15 +28,80 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "pathstuff.h"
 #endif
 #include "hash.h"
+#include "debug.h"
 
 /* Chain of all pattern-specific variables.  */
 
-static struct pattern_var *pattern_vars;
+struct pattern_var *pattern_vars;
 
 /* Pointer to the last struct in the pack of a specific size, from 1 to 255.*/
 
 static struct pattern_var *last_pattern_vars[256];
 
+/* Index of the pattern-specific variables, so that a target is compared
+   only with the patterns it can match.  The suffix nodes form a trie of
+   the text after the %, read backwards from its end.  Each has a trie of
+   the text before the %, read forwards, whose nodes hold the variables
+   with that text around the %.  */
+
+struct pattern_node
+  {
+    struct pattern_node *child;     /* First node one character longer.  */
+    struct pattern_node *sibling;   /* Next node with the same parent.  */
+    struct pattern_node *prefixes;  /* Root of the trie of prefixes.  */
+    struct pattern_var *vars;       /* Variables ending at this prefix.  */
+    char c;
+  };
+
+static struct pattern_node pattern_suffixes;
+
+static unsigned int pattern_var_count;
+
+/* Return the child of NODE for character C.  If there is none, return
+   NULL, or add one if CREATE is nonzero.  */
+
+static struct pattern_node *
+pattern_node_child (struct pattern_node *node, char c, int create)
+{
+  struct pattern_node *n;
+
+  for (n = node->child; n != 0; n = n->sibling)
+    if (n->c == c)
+      return n;
+
+  if (!create)
+    return 0;
+
+  n = xcalloc (sizeof (struct pattern_node));
+  n->c = c;
+  n->sibling = node->child;
+  node->child = n;
+  return n;
+}
+
+/* Enter P into the index of pattern-specific variables.  */
+
+static void
+index_pattern_var (struct pattern_var *p)
+{
+  struct pattern_node *node = &pattern_suffixes;
+  const char *s = p->suffix + strlen (p->suffix);
+  const char *t;
+
+  while (s > p->suffix)
+    node = pattern_node_child (node, *--s, 1);
+
+  if (node->prefixes == 0)
+    node->prefixes = xcalloc (sizeof (struct pattern_node));
+  node = node->prefixes;
+
+  for (t = p->target; t < p->suffix - 1; ++t)
+    node = pattern_node_child (node, *t, 1);
+
+  p->same = node->vars;
+  node->vars = p;
+}
+
 /*!
   Return a string describing origin.
  */
@@ -123,6 +188,13 @@ create_pattern_var (const char *target, const char *suffix)
   p->target = target;
   p->len = len;
   p->suffix = suffix + 1;
+  p->variable.expanded = 0;
+  p->variable.frozen = 0;
+  p->variable.unfreezable = 0;
+  p->variable.freeze_tried = 0;
+  p->variable.expansion = 0;
+  p->serial = pattern_var_count++;
+  index_pattern_var (p);
 
   if (len < 256)
     last_pattern_vars[len] = p;
@@ -130,52 +202,92 @@ create_pattern_var (const char *target, const char *suffix)
   return p;
 }
 
-/* Look up a target in the pattern-specific variable list.  */
+/* Order pattern-specific variables as they appear in PATTERN_VARS.  */
 
-static struct pattern_var *
-lookup_pattern_var (struct pattern_var *start, const char *target)
+static int
+pattern_var_cmp (const void *a, const void *b)
 {
-  struct pattern_var *p;
-  unsigned int targlen = strlen (target);
+  const struct pattern_var *p = *(struct pattern_var *const *) a;
+  const struct pattern_var *q = *(struct pattern_var *const *) b;
 
-  for (p = start ? start->next : pattern_vars; p != 0; p = p->next)
-    {
-      const char *stem;
-      unsigned int stemlen;
+  if (p->len != q->len)
+    return p->len < q->len ? -1 : 1;
+  return p->serial < q->serial ? -1 : p->serial > q->serial;
+}
 
-      if (p->len > targlen)
-        /* It can't possibly match.  */
-        continue;
+/* Look up the pattern-specific variables that match TARGET.  Return them
+   in the order they appear in PATTERN_VARS, that is shortest pattern first
+   and those of the same length in the order they were defined, in a
+   vector of *COUNT elements that the caller must free.  Return NULL if
+   none match.  */
 
-      /* From the lengths of the filename and the pattern parts,
-         find the stem: the part of the filename that matches the %.  */
-      stem = target + (p->suffix - p->target - 1);
-      stemlen = targlen - p->len + 1;
+static struct pattern_var **
+lookup_pattern_vars (const char *target, unsigned int *count)
+{
+  struct pattern_var **matches = 0;
+  unsigned int size = 0;
+  unsigned int n = 0;
+  unsigned int pos = strlen (target);
+  struct pattern_node *node = &pattern_suffixes;
+
+  /* Walk back from the end of TARGET through the texts after the %, and
+     for each one that TARGET ends with, forward from the start through
+     the texts before it.  */
+  while (1)
+    {
+      struct pattern_node *pn = node->prefixes;
+      unsigned int i = 0;
 
-      /* Compare the text in the pattern before the stem, if any.  */
-      if (stem > target && !strneq (p->target, target, stem - target))
-        continue;
+      /* Leave at least one character for the stem.  */
+      while (pn != 0 && i < pos)
+        {
+          struct pattern_var *p;
+
+          for (p = pn->vars; p != 0; p = p->same)
+            {
+              if (n == size)
+                {
+                  size = size ? size * 2 : 8;
+                  matches = xrealloc (matches, size * sizeof (*matches));
+                }
+              matches[n++] = p;
+            }
+          pn = pattern_node_child (pn, target[i++], 0);
+        }
 
-      /* Compare the text in the pattern after the stem, if any.
-         We could test simply using streq, but this way we compare the
-         first two characters immediately.  This saves time in the very
-         common case where the first character matches because it is a
-         period.  */
-      if (*p->suffix == stem[stemlen]
-          && (*p->suffix == '\0' || streq (&p->suffix[1], &stem[stemlen+1])))
+      if (pos == 0)
+        break;
+      node = pattern_node_child (node, target[--pos], 0);
+      if (node == 0)
         break;
     }
 
-  return p;
+  if (n > 1)
+    qsort (matches, n, sizeof (*matches), pattern_var_cmp);
+
+  *count = n;
+  return matches;
 }
 
 /* Hash table of all global variable definitions.  */
 
+/* Return the hash of the variable name of LENGTH at NAME.  Each variable
+   keeps it, and the names in compiled expansions come with it, so a
+   lookup from either doesn't have to work it out again.  */
+
+unsigned long
+variable_name_hash (const char *name, unsigned int length)
+{
+  unsigned long hash = 0;
+  STRING_N_HASH_1 (name, length, hash);
+  return hash;
+}
+
 static unsigned long
 variable_hash_1 (const void *keyv)
 {
   struct variable const *key = (struct variable const *) keyv;
-  return_STRING_N_HASH_1 (key->name, key->length);
+  return key->hash;
 }
 
 static unsigned long
@@ -185,12 +297,20 @@ variable_hash_2 (const void *keyv)
   return_STRING_N_HASH_2 (key->name, key->length);
 }
 
+/* Names are interned, so the same name is usually at the same address;
+   different hashes are different names.  */
+
 static int
 variable_hash_cmp (const void *xv, const void *yv)
 {
   struct variable const *x = (struct variable const *) xv;
   struct variable const *y = (struct variable const *) yv;
-  int result = x->length - y->length;
+  int result;
+  if (x->name == y->name && x->length == y->length)
+    return 0;
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  result = x->length - y->length;
   if (result)
     return result;
   return_STRING_N_COMPARE (x->name, y->name, x->length);
@@ -199,18 +319,70 @@ variable_hash_cmp (const void *xv, const void *yv)
 #ifndef VARIABLE_BUCKETS
 #define VARIABLE_BUCKETS                523
 #endif
+/* Most targets have little more than their automatic variables.  */
 #ifndef PERFILE_VARIABLE_BUCKETS
-#define PERFILE_VARIABLE_BUCKETS        23
+#define PERFILE_VARIABLE_BUCKETS        13
 #endif
 #ifndef SMALL_SCOPE_VARIABLE_BUCKETS
 #define SMALL_SCOPE_VARIABLE_BUCKETS    13
 #endif
 
+/* Sets of parents to look through before the global ones that make a view
+   of them worth it.  */
+#ifndef VARIABLE_VIEW_DEPTH
+#define VARIABLE_VIEW_DEPTH             2
+#endif
+
 static struct variable_set global_variable_set;
 static struct variable_set_list global_setlist
-  = { 0, &global_variable_set, 0 };
+  = { 0, &global_variable_set, 0, 0 };
 struct variable_set_list *current_variable_set_list = &global_setlist;
+
+/* Bumped whenever a global variable is defined, changed or undefined, so
+   that anything computed from their values can tell if it is still good.  */
+unsigned long variable_generation = 0;
+
+/* Bumped whenever a variable is added to or removed from a set that a
+   variable view was made of, or the sets such a view was made of change,
+   so that the view can tell it is out of date.  */
+unsigned long variable_view_generation = 0;
+
+/* While this is set, lookup_variable notes each global variable it finds, and
+   each name it finds nothing for, in it.  */
+struct variable_deps *variable_deps = 0;
 
+/* The names of the global variables, for .VARIABLES, as they were last
+   worked out, their length and the room for them.  Global variables defined
+   since then are noted in NEW_VARIABLES and added the next time .VARIABLES
+   is looked up; undefining one makes the names stale, to be worked out
+   again.  .VARIABLES is given a copy of them only when they change.  */
+
+static char *variable_names = 0;
+static unsigned long variable_names_length = 0;
+static unsigned long variable_names_size;
+static int variable_names_stale;
+static int variable_names_changed;
+static struct variable **new_variables;
+static unsigned int new_variables_count = 0;
+static unsigned int new_variables_size = 0;
+
+/* Note that V was added to the global variables.  */
+
+static void
+note_new_variable (struct variable *v)
+{
+  if (variable_names == 0 || variable_names_stale)
+    return;
+
+  if (new_variables_count == new_variables_size)
+    {
+      new_variables_size = new_variables_size ? new_variables_size * 2 : 64;
+      new_variables = xrealloc (new_variables,
+                                new_variables_size * sizeof (*new_variables));
+    }
+  new_variables[new_variables_count++] = v;
+}
+
 /* Implement variables.  */
 
 void
@@ -239,9 +411,12 @@ define_variable_in_set (const char *name, unsigned int length,
 
   if (set == NULL)
     set = &global_variable_set;
+  if (set == &global_variable_set)
+    ++variable_generation;
 
   var_key.name = (char *) name;
   var_key.length = length;
+  var_key.hash = variable_name_hash (name, length);
   var_slot = (struct variable **) hash_find_slot (&set->table, &var_key);
 
   if (env_overrides && origin == o_env)
@@ -260,6 +435,7 @@ define_variable_in_set (const char *name, unsigned int length,
          than this one, don't redefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          forget_expansion (v);
           free (v->value);
           v->value = xstrdup (value);
           if (flocp != 0)
@@ -274,10 +450,16 @@ define_variable_in_set (const char *name, unsigned int length,
 
   /* Create a new variable definition and add it to the hash table.  */
 
+  if (set->viewed)
+    ++variable_view_generation;
+
   v = xmalloc (sizeof (struct variable));
-  v->name = xstrndup (name, length);
+  v->name = (char *) strcache_add_len (name, length);
   v->length = length;
+  v->hash = var_key.hash;
   hash_insert_at (&set->table, v, var_slot);
+  if (set == &global_variable_set)
+    note_new_variable (v);
   v->value = xstrdup (value);
   if (flocp != 0)
     v->fileinfo = *flocp;
@@ -292,6 +474,11 @@ define_variable_in_set (const char *name, unsigned int length,
   v->append = 0;
   v->private_var = 0;
   v->export = v_default;
+  v->expanded = 0;
+  v->frozen = 0;
+  v->unfreezable = 0;
+  v->freeze_tried = 0;
+  v->expansion = 0;
 
   v->exportable = 1;
   if (*name != '_' && (*name < 'A' || *name > 'Z')
@@ -317,17 +504,27 @@ define_variable_in_set (const char *name, unsigned int length,
    variable (makefile, command line or environment). */
 
 static void
-free_variable_name_and_value (const void *item)
+free_variable_value (const void *item)
 {
   struct variable *v = (struct variable *) item;
-  free (v->name);
+  forget_expansion (v);
   free (v->value);
 }
 
 void
 free_variable_set (struct variable_set_list *list)
 {
-  hash_map (&list->set->table, free_variable_name_and_value);
+  if (list->set->viewed)
+    ++variable_view_generation;
+  free_variable_view (list);
+  if (list->set->users > 1)
+    {
+      /* Others still use the set.  */
+      --list->set->users;
+      free (list);
+      return;
+    }
+  hash_map (&list->set->table, free_variable_value);
   hash_free (&list->set->table, 1);
   free (list->set);
   free (list);
@@ -344,9 +541,12 @@ undefine_variable_in_set (const char *name, unsigned int length,
 
   if (set == NULL)
     set = &global_variable_set;
+  if (set == &global_variable_set)
+    ++variable_generation;
 
   var_key.name = (char *) name;
   var_key.length = length;
+  var_key.hash = variable_name_hash (name, length);
   var_slot = (struct variable **) hash_find_slot (&set->table, &var_key);
 
   if (env_overrides && origin == o_env)
@@ -364,12 +564,97 @@ undefine_variable_in_set (const char *name, unsigned int length,
          undefine it.  */
       if ((int) origin >= (int) v->origin)
         {
+          if (set->viewed)
+            ++variable_view_generation;
+          if (set == &global_variable_set)
+            variable_names_stale = 1;
           hash_delete_at (&set->table, var_slot);
-          free_variable_name_and_value (v);
+          free_variable_value (v);
         }
     }
 }
 
+#define EXPANSION_INCREMENT(_l)  ((((_l) / 500) + 1) * 500)
+
+/* Make VARIABLE_NAMES the names of all the global variables.  */
+
+static void
+build_variable_names (void)
+{
+  unsigned long max = EXPANSION_INCREMENT (variable_names_length);
+  unsigned long len;
+  char *p;
+  struct variable **vp = (struct variable **) global_variable_set.table.ht_vec;
+  struct variable **end = &vp[global_variable_set.table.ht_size];
+
+  /* Make sure we have at least MAX bytes in the allocated buffer.  */
+  variable_names = xrealloc (variable_names, max);
+
+  /* Walk through the hash of variables, constructing a list of names.  */
+  p = variable_names;
+  len = 0;
+  for (; vp < end; ++vp)
+    if (!HASH_VACANT (*vp))
+      {
+        struct variable *v = *vp;
+        int l = v->length;
+
+        len += l + 1;
+        if (len > max)
+          {
+            unsigned long off = p - variable_names;
+
+            max += EXPANSION_INCREMENT (l + 1);
+            variable_names = xrealloc (variable_names, max);
+            p = &variable_names[off];
+          }
+
+        memcpy (p, v->name, l);
+        p += l;
+        *(p++) = ' ';
+      }
+  *(p-1) = '\0';
+
+  variable_names_length = p - 1 - variable_names;
+  variable_names_size = max;
+  variable_names_stale = 0;
+  variable_names_changed = 1;
+  new_variables_count = 0;
+}
+
+/* Add the names of the global variables defined since VARIABLE_NAMES was
+   worked out to it.  */
+
+static void
+add_variable_names (void)
+{
+  unsigned long len = variable_names_length;
+  unsigned int i;
+
+  for (i = 0; i < new_variables_count; ++i)
+    len += new_variables[i]->length + 1;
+
+  if (len + 1 > variable_names_size)
+    {
+      variable_names_size = EXPANSION_INCREMENT (len + 1);
+      variable_names = xrealloc (variable_names, variable_names_size);
+    }
+
+  len = variable_names_length;
+  for (i = 0; i < new_variables_count; ++i)
+    {
+      const struct variable *v = new_variables[i];
+      variable_names[len++] = ' ';
+      memcpy (&variable_names[len], v->name, v->length);
+      len += v->length;
+    }
+  variable_names[len] = '\0';
+
+  variable_names_length = len;
+  variable_names_changed = 1;
+  new_variables_count = 0;
+}
+
 /* If the variable passed in is "special", handle its special nature.
    Currently there are two such variables, both used for introspection:
    .VARIABLES expands to a list of all the variables defined in this instance
@@ -378,14 +663,9 @@ undefine_variable_in_set (const char *name, unsigned int length,
    instance of make.
    Returns the variable reference passed in.  */
 
-#define EXPANSION_INCREMENT(_l)  ((((_l) / 500) + 1) * 500)
-
 static struct variable *
 lookup_special_var (struct variable *var)
 {
-  static unsigned long last_var_count = 0;
-
-
   /* This one actually turns out to be very hard, due to the way the parser
      records targets.  The way it works is that target information is collected
      internally until make knows the target is completely specified.  It unitl
@@ -411,54 +691,281 @@ lookup_special_var (struct variable *var)
   else
   */
 
-  if (streq (var->name, ".VARIABLES")
-      && global_variable_set.table.ht_fill != last_var_count)
+  if (streq (var->name, ".VARIABLES"))
     {
-      unsigned long max = EXPANSION_INCREMENT (strlen (var->value));
-      unsigned long len;
-      char *p;
-      struct variable **vp = (struct variable **) global_variable_set.table.ht_vec;
-      struct variable **end = &vp[global_variable_set.table.ht_size];
+      if (variable_names == 0 || variable_names_stale)
+        build_variable_names ();
+      else if (new_variables_count != 0)
+        add_variable_names ();
 
-      /* Make sure we have at least MAX bytes in the allocated buffer.  */
-      var->value = xrealloc (var->value, max);
+      /* Give the variable a copy only when the names have changed.  */
+      if (variable_names_changed)
+        {
+          var->value = xrealloc (var->value, variable_names_length + 1);
+          memcpy (var->value, variable_names, variable_names_length + 1);
+          variable_names_changed = 0;
+        }
+    }
 
-      /* Walk through the hash of variables, constructing a list of names.  */
-      p = var->value;
-      len = 0;
-      for (; vp < end; ++vp)
-        if (!HASH_VACANT (*vp))
-          {
-            struct variable *v = *vp;
-            int l = v->length;
+  return var;
+}
 
-            len += l + 1;
-            if (len > max)
-              {
-                unsigned long off = p - var->value;
+
+/* Note in variable_deps that the variable NAME of LENGTH was V, which is 0
+   if there was none.  Values this long are not worth keeping a copy of.  */
 
-                max += EXPANSION_INCREMENT (l + 1);
-                var->value = xrealloc (var->value, max);
-                p = &var->value[off];
-              }
+#define VARIABLE_DEP_VALUE_MAX 65536
 
-            memcpy (p, v->name, l);
-            p += l;
-            *(p++) = ' ';
-          }
-      *(p-1) = '\0';
+static void
+note_variable_dep (const char *name, unsigned int length,
+                   const struct variable *v)
+{
+  struct variable_deps *deps = variable_deps;
+  struct variable_dep *d;
+  unsigned int i;
+
+  for (i = 0; i < deps->count; ++i)
+    if (deps->deps[i].length == length
+        && strneq (deps->deps[i].name, name, length))
+      return;
+
+  if (deps->count == VARIABLE_DEPS_MAX
+      || (v != 0 && strlen (v->value) > VARIABLE_DEP_VALUE_MAX))
+    {
+      deps->overflow = 1;
+      return;
+    }
+
+  d = &deps->deps[deps->count++];
+  d->name = xstrndup (name, length);
+  d->length = length;
+  d->value = v ? xstrdup (v->value) : 0;
+  d->recursive = v ? v->recursive : 0;
+  d->origin = v ? v->origin : o_invalid;
+}
+
+/* Note that a variable was found in SETLIST, which is not the global set.  */
+
+static void
+note_local_variable (const struct variable_set_list *setlist)
+{
+  const struct variable_set_list *s;
+
+  for (s = variable_deps->context; s != 0; s = s->next)
+    if (s == setlist)
+      {
+        variable_deps->local = 1;
+        break;
+      }
+}
+
+/* Return nonzero if the COUNT global variables in DEPS are still what they
+   were when noted.  */
+
+int
+variable_deps_unchanged (const struct variable_dep *deps, unsigned int count)
+{
+  struct variable_deps *saved = variable_deps;
+  struct variable_set_list *setlist = current_variable_set_list;
+  const struct variable_dep *end = deps + count;
+  int unchanged = 1;
 
-      /* Remember how many variables are in our current count.  Since we never
-         remove variables from the list, this is a reliable way to know whether
-         the list is up to date or needs to be recomputed.  */
+  variable_deps = 0;
+  current_variable_set_list = &global_setlist;
 
-      last_var_count = global_variable_set.table.ht_fill;
+  for (; deps < end; ++deps)
+    {
+      const struct variable *v = lookup_variable (deps->name, deps->length);
+
+      if (v == 0 ? deps->value != 0
+          : (deps->value == 0 || v->recursive != deps->recursive
+             || v->origin != deps->origin || !streq (v->value, deps->value)))
+        {
+          unchanged = 0;
+          break;
+        }
     }
 
-  return var;
+  current_variable_set_list = setlist;
+  variable_deps = saved;
+  return unchanged;
+}
+
+void
+free_variable_deps (struct variable_dep *deps, unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; ++i)
+    {
+      free (deps[i].name);
+      free (deps[i].value);
+    }
+}
+
+/* Add the variables noted in FROM, which were looked up on behalf of
+   whatever INTO is noting them for, to INTO.  */
+
+void
+merge_variable_deps (struct variable_deps *into,
+                     const struct variable_deps *from)
+{
+  unsigned int i, j;
+
+  into->overflow |= from->overflow;
+  into->local |= from->local;
+
+  for (i = 0; i < from->count; ++i)
+    {
+      const struct variable_dep *d = &from->deps[i];
+
+      for (j = 0; j < into->count; ++j)
+        if (into->deps[j].length == d->length
+            && strneq (into->deps[j].name, d->name, d->length))
+          break;
+      if (j < into->count)
+        continue;
+
+      if (into->count == VARIABLE_DEPS_MAX)
+        {
+          into->overflow = 1;
+          break;
+        }
+
+      into->deps[into->count] = *d;
+      into->deps[into->count].name = xstrdup (d->name);
+      if (d->value)
+        into->deps[into->count].value = xstrdup (d->value);
+      ++into->count;
+    }
+}
+
+/* With --freeze-variables, once the makefiles have been read, a recursive
+   variable whose expansion calls no function with side effects and refers
+   only to global variables that are not automatic, special, or set for some
+   target or pattern, keeps the value it expanded to.  Any change to a global
+   variable after that, as by $(eval), or a new target-specific variable,
+   thaws them all.  */
+
+int freezing_variables = 0;
+unsigned long frozen_generation;
+unsigned int frozen_variables = 0;
+
+/* The names of target- and pattern-specific variables.  */
+
+static struct variable_set overridden_variables;
+
+static void
+note_overridden_variable (const struct variable *v)
+{
+  define_variable_in_set (v->name, v->length, "", o_automatic, 0,
+                          &overridden_variables, NILF);
+}
+
+static void
+note_file_variables (const void *item, void *arg UNUSED)
+{
+  const struct file *f = item;
+  struct variable **vp, **end;
+
+  if (f->variables == 0 || f->variables->set == &global_variable_set)
+    return;
+
+  vp = (struct variable **) f->variables->set->table.ht_vec;
+  end = vp + f->variables->set->table.ht_size;
+  for (; vp < end; ++vp)
+    if (!HASH_VACANT (*vp))
+      note_overridden_variable (*vp);
+}
+
+/* Start freezing variables.  */
+
+void
+freeze_variables (void)
+{
+  struct pattern_var *p;
+
+  hash_init (&overridden_variables.table, SMALL_SCOPE_VARIABLE_BUCKETS,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+  map_files (note_file_variables, 0);
+  for (p = pattern_vars; p != 0; p = p->next)
+    note_overridden_variable (&p->variable);
+
+  freezing_variables = 1;
+  frozen_generation = variable_generation;
+}
+
+/* Stop using frozen values, because something they may depend on has
+   changed.  */
+
+void
+thaw_variables (void)
+{
+  if (freezing_variables)
+    DB (DB_BASIC, (_("Thawing %u frozen variables.\n"), frozen_variables));
+  freezing_variables = 0;
+}
+
+/* Return nonzero if the global variable V, whose expansion looked up the
+   variables in DEPS and called a function with side effects if IMPURE is
+   nonzero, can keep its value.  If it can't, note whether it is worth
+   trying again.  */
+
+int
+may_freeze_variable (struct variable *v, const struct variable_deps *deps,
+                     int impure)
+{
+  unsigned int i;
+
+  if (!variables_frozen ())
+    return 0;
+
+  if (impure || deps->local || v->special || v->origin == o_automatic
+      || lookup_variable_in_set (v->name, v->length,
+                                 &global_variable_set) != v)
+    {
+      v->unfreezable = 1;
+      return 0;
+    }
+
+  /* If it refers to too many variables, try again once: by then some of
+     those may have been frozen.  */
+  if (deps->overflow)
+    {
+      if (v->freeze_tried)
+        v->unfreezable = 1;
+      v->freeze_tried = 1;
+      return 0;
+    }
+
+  for (i = 0; i < deps->count; ++i)
+    {
+      const struct variable_dep *d = &deps->deps[i];
+      const struct variable *gv;
+
+      if (lookup_variable_in_set (d->name, d->length, &overridden_variables))
+        break;
+
+      /* A name with no global value may be given one by an automatic or
+         target-specific variable, the arguments of $(call) or the loop
+         variable of $(foreach), none of which are global.  */
+      if (d->value == 0)
+        break;
+
+      gv = lookup_variable_in_set (d->name, d->length, &global_variable_set);
+      if (gv == 0 || gv->special || gv->origin == o_automatic)
+        break;
+    }
+
+  if (i < deps->count)
+    {
+      v->unfreezable = 1;
+      return 0;
+    }
+
+  return 1;
 }
 
-
 /* Lookup a variable whose name is a string starting at NAME
    and with LENGTH chars.  NAME need not be null-terminated.
    Returns address of the 'struct variable' containing all info
@@ -466,6 +973,16 @@ lookup_special_var (struct variable *var)
 
 struct variable *
 lookup_variable (const char *name, unsigned int length)
+{
+  return lookup_hashed_variable (name, length,
+                                 variable_name_hash (name, length));
+}
+
+/* Likewise, for a name whose variable_name_hash is HASH.  */
+
+struct variable *
+lookup_hashed_variable (const char *name, unsigned int length,
+                        unsigned long hash)
 {
   const struct variable_set_list *setlist;
   struct variable var_key;
@@ -473,20 +990,50 @@ lookup_variable (const char *name, unsigned int length)
 
   var_key.name = (char *) name;
   var_key.length = length;
+  var_key.hash = hash;
 
-  for (setlist = current_variable_set_list;
-       setlist != 0; setlist = setlist->next)
+  setlist = current_variable_set_list;
+  while (setlist != 0)
     {
       const struct variable_set *set = setlist->set;
+      const struct variable_view *view = setlist->view;
       struct variable *v;
 
+      /* Once in the sets of a parent, use its view of them if it is still
+         good.  */
+      if (view != 0 && is_parent && !variable_deps
+          && view->generation == variable_view_generation)
+        {
+          v = (struct variable *) hash_find_item ((struct hash_table *) &view->table, &var_key);
+          if (v)
+            return v->special ? lookup_special_var (v) : v;
+
+          setlist = view->rest;
+          continue;
+        }
+
       v = (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
       if (v && (!is_parent || !v->private_var))
-        return v->special ? lookup_special_var (v) : v;
+        {
+          if (v->special)
+            v = lookup_special_var (v);
+          if (variable_deps)
+            {
+              if (set == &global_variable_set)
+                note_variable_dep (name, length, v);
+              else if (variable_deps->context)
+                note_local_variable (setlist);
+            }
+          return v;
+        }
 
       is_parent |= setlist->next_is_parent;
+      setlist = setlist->next;
     }
 
+  if (variable_deps)
+    note_variable_dep (name, length, 0);
+
 #ifdef VMS
   /* since we don't read envp[] on startup, try to get the
      variable via getenv() here.  */
@@ -543,26 +1090,225 @@ lookup_variable (const char *name, unsigned int length)
   }
 #endif /* VMS */
 
-  return 0;
+  return 0;
+}
+
+/* Lookup a variable whose name is a string starting at NAME
+   and with LENGTH chars in set SET.  NAME need not be null-terminated.
+   Returns address of the 'struct variable' containing all info
+   on the variable, or nil if no such variable is defined.  */
+
+struct variable *
+lookup_variable_in_set (const char *name, unsigned int length,
+                        const struct variable_set *set)
+{
+  struct variable var_key;
+
+  var_key.name = (char *) name;
+  var_key.length = length;
+  var_key.hash = variable_name_hash (name, length);
+
+  return (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
+}
+
+/* Sets of pattern-specific variables that targets share, each with the
+   vector of the COUNT pattern variables it was made from.  */
+
+struct pattern_set
+  {
+    struct pattern_var **vars;
+    unsigned int count;
+    struct variable_set *set;
+  };
+
+static struct hash_table pattern_sets;
+
+/* How many targets were given a shared set of pattern-specific variables
+   instead of a set of their own.  */
+static unsigned long pattern_sets_reused = 0;
+
+static unsigned long
+pattern_set_hash_1 (const void *keyv)
+{
+  struct pattern_set const *key = (struct pattern_set const *) keyv;
+  unsigned long hash = key->count;
+  unsigned int i;
+  for (i = 0; i < key->count; ++i)
+    hash = hash * 31 + key->vars[i]->serial;
+  return hash;
+}
+
+static unsigned long
+pattern_set_hash_2 (const void *keyv)
+{
+  struct pattern_set const *key = (struct pattern_set const *) keyv;
+  unsigned long hash = key->count;
+  unsigned int i;
+  for (i = 0; i < key->count; ++i)
+    hash = hash * 17 + key->vars[i]->serial;
+  return hash;
+}
+
+static int
+pattern_set_hash_cmp (const void *xv, const void *yv)
+{
+  struct pattern_set const *x = (struct pattern_set const *) xv;
+  struct pattern_set const *y = (struct pattern_set const *) yv;
+  int result = x->count - y->count;
+  if (result)
+    return result;
+  return memcmp (x->vars, y->vars, x->count * sizeof (*x->vars));
+}
+
+/* Return a set list holding the COUNT pattern-specific variables at
+   MATCHES, for a target they all match.  Unless one of them has to be
+   expanded or looked up in the context it is defined in, the set depends
+   on nothing but the variables, so targets they match alike share it.  */
+
+static struct variable_set_list *
+pattern_variable_set (struct pattern_var **matches, unsigned int count)
+{
+  struct variable_set_list *global = current_variable_set_list;
+  struct variable_set_list *setlist;
+  struct pattern_set key;
+  struct pattern_set **slot = 0;
+  int simple = 0;
+  int append = 0;
+  unsigned int i;
+
+  for (i = 0; i < count; ++i)
+    switch (matches[i]->variable.flavor)
+      {
+      case f_simple:
+        simple = 1;
+        break;
+      case f_append:
+        append = 1;
+        break;
+      case f_recursive:
+        break;
+      default:
+        /* A conditional or shell assignment.  */
+        simple = append = 1;
+        break;
+      }
+
+  /* Appending to a simple value expands what is appended.  */
+  if (!(simple && append))
+    {
+      if (pattern_sets.ht_vec == 0)
+        hash_init (&pattern_sets, SMALL_SCOPE_VARIABLE_BUCKETS,
+                   pattern_set_hash_1, pattern_set_hash_2,
+                   pattern_set_hash_cmp);
+
+      key.vars = matches;
+      key.count = count;
+      slot = (struct pattern_set **) hash_find_slot (&pattern_sets, &key);
+      if (!HASH_VACANT (*slot))
+        {
+          setlist = xmalloc (sizeof (struct variable_set_list));
+          setlist->set = (*slot)->set;
+          setlist->next = 0;
+          setlist->next_is_parent = 0;
+          setlist->view = 0;
+          ++setlist->set->users;
+          ++pattern_sets_reused;
+          return setlist;
+        }
+    }
+
+  /* Set up a new variable set to accumulate all the pattern variables that
+     match this target.  */
+
+  setlist = create_new_variable_set ();
+  current_variable_set_list = setlist;
+
+  for (i = 0; i < count; ++i)
+    {
+      /* Insert each one into the set.  */
+
+      struct pattern_var *p = matches[i];
+      struct variable *v;
+
+      if (p->variable.flavor == f_simple)
+        {
+          v = define_variable_loc (
+            p->variable.name, strlen (p->variable.name),
+            p->variable.value, p->variable.origin,
+            0, &p->variable.fileinfo);
+
+          v->flavor = f_simple;
+        }
+      else
+        {
+          v = do_variable_definition (
+            &p->variable.fileinfo, p->variable.name,
+            p->variable.value, p->variable.origin,
+            p->variable.flavor, 1);
+        }
+
+      /* Also mark it as a per-target and copy export status. */
+      v->per_target = p->variable.per_target;
+      v->export = p->variable.export;
+      v->private_var = p->variable.private_var;
+    }
+
+  current_variable_set_list = global;
+
+  if (slot != 0)
+    {
+      struct pattern_set *ps = xmalloc (sizeof (struct pattern_set));
+      ps->vars = xmalloc (count * sizeof (*matches));
+      memcpy (ps->vars, matches, count * sizeof (*matches));
+      ps->count = count;
+      ps->set = setlist->set;
+      ++ps->set->users;
+      hash_insert_at (&pattern_sets, ps, slot);
+    }
+
+  return setlist;
 }
-
-/* Lookup a variable whose name is a string starting at NAME
-   and with LENGTH chars in set SET.  NAME need not be null-terminated.
-   Returns address of the 'struct variable' containing all info
-   on the variable, or nil if no such variable is defined.  */
 
-struct variable *
-lookup_variable_in_set (const char *name, unsigned int length,
-                        const struct variable_set *set)
+/* If the set in SETLIST is shared, give SETLIST a copy of its own that can
+   be changed.  */
+
+static void
+own_variable_set (struct variable_set_list *setlist)
 {
-  struct variable var_key;
+  struct variable_set *from = setlist->set;
+  struct variable_set *set;
+  struct variable **vp;
+  struct variable **end;
 
-  var_key.name = (char *) name;
-  var_key.length = length;
+  if (from->users <= 1)
+    return;
 
-  return (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
+  set = xmalloc (sizeof (struct variable_set));
+  hash_init (&set->table, from->table.ht_size,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+  set->viewed = 0;
+  set->users = 1;
+
+  vp = (struct variable **) from->table.ht_vec;
+  end = vp + from->table.ht_size;
+  for ( ; vp < end; ++vp)
+    if (! HASH_VACANT (*vp))
+      {
+        struct variable *v = xmalloc (sizeof (struct variable));
+        *v = **vp;
+        v->value = xstrdup (v->value);
+        v->expansion = 0;
+        v->expanded = 0;
+        v->expanding = 0;
+        hash_insert (&set->table, v);
+      }
+
+  --from->users;
+  setlist->set = set;
+  free_variable_view (setlist);
+  ++variable_view_generation;
 }
-
+
 /* Initialize FILE's variable set list.  If FILE already has a variable set
    list, the topmost variable set is left intact, but the the rest of the
    chain is replaced with FILE->parent's setlist.  If FILE is a double-colon
@@ -576,6 +1322,7 @@ void
 initialize_file_variables (struct file *file, int reading)
 {
   struct variable_set_list *l = file->variables;
+  const struct variable_set_list *next;
 
   if (l == 0)
     {
@@ -584,8 +1331,13 @@ initialize_file_variables (struct file *file, int reading)
       l->set = xmalloc (sizeof (struct variable_set));
       hash_init (&l->set->table, PERFILE_VARIABLE_BUCKETS,
                  variable_hash_1, variable_hash_2, variable_hash_cmp);
+      l->set->viewed = 0;
+      l->set->users = 1;
+      l->next = 0;
+      l->view = 0;
       file->variables = l;
     }
+  next = l->next;
 
   /* If this is a double-colon, then our "parent" is the "root" target for
      this double-colon rule.  Since that rule has the same name, parent,
@@ -596,6 +1348,8 @@ initialize_file_variables (struct file *file, int reading)
       initialize_file_variables (file->double_colon, reading);
       l->next = file->double_colon->variables;
       l->next_is_parent = 0;
+      if (l->next != next && l->set->viewed)
+        ++variable_view_generation;
       return;
     }
 
@@ -613,50 +1367,13 @@ initialize_file_variables (struct file *file, int reading)
 
   if (!reading && !file->pat_searched)
     {
-      struct pattern_var *p;
+      unsigned int count;
+      struct pattern_var **matches = lookup_pattern_vars (file->name, &count);
 
-      p = lookup_pattern_var (0, file->name);
-      if (p != 0)
+      if (matches != 0)
         {
-          struct variable_set_list *global = current_variable_set_list;
-
-          /* We found at least one.  Set up a new variable set to accumulate
-             all the pattern variables that match this target.  */
-
-          file->pat_variables = create_new_variable_set ();
-          current_variable_set_list = file->pat_variables;
-
-          do
-            {
-              /* We found one, so insert it into the set.  */
-
-              struct variable *v;
-
-              if (p->variable.flavor == f_simple)
-                {
-                  v = define_variable_loc (
-                    p->variable.name, strlen (p->variable.name),
-                    p->variable.value, p->variable.origin,
-                    0, &p->variable.fileinfo);
-
-                  v->flavor = f_simple;
-                }
-              else
-                {
-                  v = do_variable_definition (
-                    &p->variable.fileinfo, p->variable.name,
-                    p->variable.value, p->variable.origin,
-                    p->variable.flavor, 1);
-                }
-
-              /* Also mark it as a per-target and copy export status. */
-              v->per_target = p->variable.per_target;
-              v->export = p->variable.export;
-              v->private_var = p->variable.private_var;
-            }
-          while ((p = lookup_pattern_var (p, file->name)) != 0);
-
-          current_variable_set_list = global;
+          file->pat_variables = pattern_variable_set (matches, count);
+          free (matches);
         }
       file->pat_searched = 1;
     }
@@ -670,8 +1387,94 @@ initialize_file_variables (struct file *file, int reading)
       l->next = file->pat_variables;
       l->next_is_parent = 0;
     }
+
+  if (l->next != next && l->set->viewed)
+    ++variable_view_generation;
 }
 
+/* Make sure the sets of the parents of the target whose variables are
+   SETLIST have a view of what they show of their variables and those of
+   the sets that follow, up to the global ones, so that lookup_variable can
+   find them with one probe.  The view is shared by all the targets with
+   the same parent and kept until something it was made of changes.  It is
+   only worth it if there are several sets to look through.  */
+
+void
+make_variable_view (struct variable_set_list *setlist)
+{
+  struct variable_set_list *parent;
+  const struct variable_set_list *s;
+  struct variable_view *view;
+  unsigned int depth = 0;
+  unsigned long count = 0;
+
+  /* Skip the sets of the target itself.  */
+  for (parent = setlist; parent != 0 && parent != &global_setlist;
+       parent = parent->next)
+    if (parent->next_is_parent)
+      {
+        parent = parent->next;
+        break;
+      }
+  if (parent == 0 || parent == &global_setlist)
+    return;
+
+  view = parent->view;
+  if (view != 0 && view->generation == variable_view_generation)
+    return;
+  free_variable_view (parent);
+
+  for (s = parent; s != 0 && s != &global_setlist; s = s->next)
+    {
+      ++depth;
+      count += s->set->table.ht_fill;
+    }
+  if (s == 0 || depth < VARIABLE_VIEW_DEPTH)
+    return;
+
+  /* Keep the table sparse, so that a probe rarely needs a second hash.  */
+  view = xmalloc (sizeof (struct variable_view));
+  hash_init (&view->table, count * 2,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+
+  /* Seen from a target, none of the private variables of its parents are
+     visible.  */
+  for (s = parent; s != &global_setlist; s = s->next)
+    {
+      struct variable **vp = (struct variable **) s->set->table.ht_vec;
+      struct variable **end = vp + s->set->table.ht_size;
+
+      s->set->viewed = 1;
+      for (; vp < end; ++vp)
+        if (!HASH_VACANT (*vp) && !(*vp)->private_var)
+          {
+            struct variable **slot
+              = (struct variable **) hash_find_slot (&view->table, *vp);
+
+            /* An earlier set hides this one.  */
+            if (HASH_VACANT (*slot))
+              hash_insert_at (&view->table, *vp, slot);
+          }
+    }
+
+  view->generation = variable_view_generation;
+  view->rest = s;
+  parent->view = view;
+}
+
+/* Drop the view of SETLIST, if it has one.  */
+
+void
+free_variable_view (struct variable_set_list *setlist)
+{
+  if (setlist->view == 0)
+    return;
+
+  hash_free (&setlist->view->table, 0);
+  free (setlist->view);
+  setlist->view = 0;
+}
+
 /* Pop the top set off the current variable set list,
    and free all its storage.  */
 
@@ -684,12 +1487,15 @@ create_new_variable_set (void)
   set = xmalloc (sizeof (struct variable_set));
   hash_init (&set->table, SMALL_SCOPE_VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
+  set->viewed = 0;
+  set->users = 1;
 
   setlist = (struct variable_set_list *)
     xmalloc (sizeof (struct variable_set_list));
   setlist->set = set;
   setlist->next = current_variable_set_list;
   setlist->next_is_parent = 0;
+  setlist->view = 0;
 
   return setlist;
 }
@@ -748,8 +1554,11 @@ pop_variable_scope (void)
     }
 
   /* Free the one we no longer need.  */
+  if (set->viewed)
+    ++variable_view_generation;
+  free_variable_view (setlist);
   free (setlist);
-  hash_map (&set->table, free_variable_name_and_value);
+  hash_map (&set->table, free_variable_value);
   hash_free (&set->table, 1);
   free (set);
 }
@@ -763,6 +1572,9 @@ merge_variable_sets (struct variable_set *to_set,
   struct variable **from_var_slot = (struct variable **) from_set->table.ht_vec;
   struct variable **from_var_end = from_var_slot + from_set->table.ht_size;
 
+  if (to_set->viewed || from_set->viewed)
+    ++variable_view_generation;
+
   for ( ; from_var_slot < from_var_end; from_var_slot++)
     if (! HASH_VACANT (*from_var_slot))
       {
@@ -793,6 +1605,8 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
   if (!setlist1)
     return;
 
+  ++variable_view_generation;
+
   /* This loop relies on the fact that all setlists terminate with the global
      setlist (before NULL).  If that's not true, arguably we SHOULD die.  */
   if (to)
@@ -801,6 +1615,8 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
         struct variable_set_list *from = setlist1;
         setlist1 = setlist1->next;
 
+        own_variable_set (to);
+        own_variable_set (from);
         merge_variable_sets (to->set, from->set);
 
         last0 = to;
@@ -878,6 +1694,7 @@ define_automatic_variables (void)
           || shell->origin == o_env_override))
         {
           /* overwrite whatever we got from the environment */
+          forget_expansion (shell);
           free (shell->value);
           shell->value = xstrdup (default_shell);
           shell->origin = o_default;
@@ -925,6 +1742,7 @@ define_automatic_variables (void)
   /* Don't let SHELL come from the environment.  */
   if (*v->value == '\0' || v->origin == o_env || v->origin == o_env_override)
     {
+      forget_expansion (v);
       free (v->value);
       v->origin = o_file;
       v->value = xstrdup (default_shell);
@@ -982,6 +1800,309 @@ define_automatic_variables (void)
 
 int export_all_variables;
 
+/* Return the variable to put in the environment of a job for V, or 0 if V
+   is not exported.  */
+
+static struct variable *
+exported_variable (struct variable *v)
+{
+  extern struct variable shell_var;
+
+  /* If this is a per-target variable and it hasn't been touched already
+     then look up the global version and take its export value.  */
+  if (v->per_target && v->export == v_default)
+    {
+      struct variable *gv;
+
+      gv = lookup_variable_in_set (v->name, strlen (v->name),
+                                   &global_variable_set);
+      if (gv)
+        v->export = gv->export;
+    }
+
+  switch (v->export)
+    {
+    case v_default:
+      if (v->origin == o_default || v->origin == o_automatic)
+        /* Only export default variables by explicit request.  */
+        return 0;
+
+      /* The variable doesn't have a name that can be exported.  */
+      if (! v->exportable)
+        return 0;
+
+      if (! export_all_variables
+          && v->origin != o_command
+          && v->origin != o_env && v->origin != o_env_override)
+        return 0;
+      break;
+
+    case v_export:
+      break;
+
+    case v_noexport:
+      /* If this is the SHELL variable and it's not exported, then add the
+         value from our original environment, if the original environment
+         defined a value for SHELL.  */
+      if (streq (v->name, "SHELL") && shell_var.value)
+        return &shell_var;
+      return 0;
+
+    case v_ifset:
+      if (v->origin == o_default)
+        return 0;
+      break;
+    }
+
+  return v;
+}
+
+/* Return the NAME=value string to put in the environment of a job for V,
+   expanded for FILE.  */
+
+static char *
+environment_string (struct variable *v, struct file *file)
+{
+  /* If V is recursively expanded and didn't come from the environment,
+     expand its value.  If it came from the environment, it should go back
+     into the environment unchanged.  */
+  if (v->recursive
+      && v->origin != o_env && v->origin != o_env_override)
+    {
+      char *value = recursively_expand_for_file (v, file);
+      char *result;
+#ifdef WINDOWS32
+      if (strcmp (v->name, "Path") == 0 ||
+          strcmp (v->name, "PATH") == 0)
+        convert_Path_to_windows32 (value, ';');
+#endif
+      result = xstrdup (concat (3, v->name, "=", value));
+      free (value);
+      return result;
+    }
+
+#ifdef WINDOWS32
+  if (strcmp (v->name, "Path") == 0 ||
+      strcmp (v->name, "PATH") == 0)
+    convert_Path_to_windows32 (v->value, ';');
+#endif
+  return xstrdup (concat (3, v->name, "=", v->value));
+}
+
+/* The part of the environment of jobs that comes from the global
+   variables, worked out once and used again until a global variable or
+   function changes.  */
+
+struct global_env_value
+  {
+    struct variable *v;         /* Variable exported.  */
+    char *string;               /* NAME=value, or 0 if it must be worked out
+                                   for each job.  */
+    int learning;               /* Nonzero if STRING may be taken from what
+                                   the next job works out.  */
+    unsigned long hidden;       /* Job it is hidden from.  */
+    unsigned long stale;        /* Job it must be worked out again for.  */
+  };
+
+/* A name that appears in the global environment, or that a value in it
+   looked up.  */
+
+struct global_env_name
+  {
+    const char *name;
+    unsigned int length;
+    int value;                  /* Index of the value exported under this
+                                   name, or -1.  */
+    unsigned int *users;        /* Indexes of the values that looked it up.  */
+    unsigned int count;
+  };
+
+static struct global_env_value *global_env;
+static unsigned int global_env_count;
+static struct hash_table global_env_names;
+static int global_env_valid = 0;
+static unsigned long global_env_generation;
+static unsigned long global_env_functions;
+static int global_env_export_all;
+static unsigned long global_env_jobs;
+
+/* How many values in the environments of jobs were taken from the global
+   one, and how many had to be worked out for the job.  */
+unsigned long environment_values_reused = 0;
+unsigned long environment_values_expanded = 0;
+
+static unsigned long
+global_env_name_hash_1 (const void *keyv)
+{
+  struct global_env_name const *key = (struct global_env_name const *) keyv;
+  return_STRING_N_HASH_1 (key->name, key->length);
+}
+
+static unsigned long
+global_env_name_hash_2 (const void *keyv)
+{
+  struct global_env_name const *key = (struct global_env_name const *) keyv;
+  return_STRING_N_HASH_2 (key->name, key->length);
+}
+
+static int
+global_env_name_hash_cmp (const void *xv, const void *yv)
+{
+  struct global_env_name const *x = (struct global_env_name const *) xv;
+  struct global_env_name const *y = (struct global_env_name const *) yv;
+  int result = x->length - y->length;
+  if (result)
+    return result;
+  return_STRING_N_COMPARE (x->name, y->name, x->length);
+}
+
+static void
+free_global_env_name (const void *item)
+{
+  struct global_env_name *n = (struct global_env_name *) item;
+  free ((char *) n->name);
+  free (n->users);
+  free (n);
+}
+
+/* Return the entry for the name of LENGTH at NAME in GLOBAL_ENV_NAMES.  */
+
+static struct global_env_name *
+global_env_name (const char *name, unsigned int length)
+{
+  struct global_env_name key;
+  struct global_env_name **slot;
+  struct global_env_name *n;
+
+  key.name = name;
+  key.length = length;
+  slot = (struct global_env_name **) hash_find_slot (&global_env_names, &key);
+  if (!HASH_VACANT (*slot))
+    return *slot;
+
+  n = xmalloc (sizeof (struct global_env_name));
+  n->name = xstrndup (name, length);
+  n->length = length;
+  n->value = -1;
+  n->users = 0;
+  n->count = 0;
+  hash_insert_at (&global_env_names, n, slot);
+  return n;
+}
+
+/* Start again on the part of the environment of jobs that comes from the
+   global variables.  Values that need no expansion are put in it now.
+   Recursive values are not expanded here, as that could run functions
+   outside any target: they are taken from the first job that works them
+   out (see learn_global_environment).  */
+
+static void
+cache_global_environment (void)
+{
+  struct variable **v_slot;
+  struct variable **v_end;
+  unsigned int i;
+
+  if (global_env_valid)
+    {
+      for (i = 0; i < global_env_count; ++i)
+        free (global_env[i].string);
+      hash_map (&global_env_names, free_global_env_name);
+      hash_free (&global_env_names, 0);
+    }
+
+  global_env_valid = 1;
+  global_env_generation = variable_generation;
+  global_env_functions = function_table_changes;
+  global_env_export_all = export_all_variables;
+  global_env_count = 0;
+  global_env = xrealloc (global_env, (global_variable_set.table.ht_fill + 1)
+                                     * sizeof (struct global_env_value));
+  hash_init (&global_env_names, VARIABLE_BUCKETS, global_env_name_hash_1,
+             global_env_name_hash_2, global_env_name_hash_cmp);
+
+  v_slot = (struct variable **) global_variable_set.table.ht_vec;
+  v_end = v_slot + global_variable_set.table.ht_size;
+  for ( ; v_slot < v_end; v_slot++)
+    if (! HASH_VACANT (*v_slot))
+      {
+        struct variable *v = exported_variable (*v_slot);
+        struct global_env_value *e;
+        struct global_env_name *n;
+
+        if (v == 0 || streq (v->name, MAKELEVEL_NAME))
+          continue;
+
+        i = global_env_count++;
+        e = &global_env[i];
+        e->v = v;
+        e->hidden = e->stale = 0;
+        n = global_env_name (v->name, v->length);
+        n->value = i;
+
+        if (v->recursive
+            && v->origin != o_env && v->origin != o_env_override)
+          {
+            e->string = 0;
+            e->learning = 1;
+          }
+        else
+          {
+            e->string = environment_string (v, 0);
+            e->learning = 0;
+          }
+      }
+}
+
+/* Work out the global value at index I for the job whose variables are
+   SETLIST, expanded for FILE, noting the variables it looks up.  If it
+   called no function with side effects and found none of them in the
+   sets of the job, keep it for other jobs, and note the names so that
+   the jobs of targets that have any of them work it out again.  If it
+   called such a function, or looked up too many variables, it is worked
+   out for every job, as before.  */
+
+static char *
+learn_global_environment (unsigned int i, struct variable_set_list *setlist,
+                          struct file *file)
+{
+  struct global_env_value *e = &global_env[i];
+  struct variable_deps *outer = variable_deps;
+  struct variable_deps deps;
+  unsigned long calls = impure_function_calls;
+  unsigned int j;
+  char *string;
+
+  deps.count = 0;
+  deps.overflow = 0;
+  deps.local = 0;
+  deps.context = setlist;
+  variable_deps = &deps;
+  string = environment_string (e->v, file);
+  variable_deps = outer;
+
+  if (deps.overflow || calls != impure_function_calls)
+    e->learning = 0;
+  else if (!deps.local)
+    {
+      e->string = xstrdup (string);
+      e->learning = 0;
+      for (j = 0; j < deps.count; ++j)
+        {
+          struct global_env_name *n;
+
+          n = global_env_name (deps.deps[j].name, deps.deps[j].length);
+          n->users = xrealloc (n->users, (n->count + 1) * sizeof (*n->users));
+          n->users[n->count++] = i;
+        }
+    }
+
+  if (outer)
+    merge_variable_deps (outer, &deps);
+  free_variable_deps (deps.deps, deps.count);
+  return string;
+}
+
 /* Create a new environment for FILE's commands.
    If FILE is nil, this is for the 'shell' function.
    The child's MAKELEVEL variable is incremented.  */
@@ -994,7 +2115,8 @@ target_environment (struct file *file)
   struct hash_table table;
   struct variable **v_slot;
   struct variable **v_end;
-  struct variable makelevel_key;
+  unsigned long job;
+  unsigned int i;
   char **result_0;
   char **result;
 
@@ -1003,14 +2125,26 @@ target_environment (struct file *file)
   else
     set_list = file->variables;
 
-  hash_init (&table, VARIABLE_BUCKETS,
+  if (!global_env_valid
+      || global_env_generation != variable_generation
+      || global_env_functions != function_table_changes
+      || global_env_export_all != export_all_variables)
+    cache_global_environment ();
+  job = ++global_env_jobs;
+
+  hash_init (&table, PERFILE_VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
 
-  /* Run through all the variable sets in the list,
-     accumulating variables in TABLE.  */
+  /* Run through the variable sets in the list other than the global one,
+     accumulating the variables to export in TABLE, and noting which
+     global values they hide or may change.  */
   for (s = set_list; s != 0; s = s->next)
     {
       struct variable_set *set = s->set;
+
+      if (set == &global_variable_set)
+        continue;
+
       v_slot = (struct variable **) set->table.ht_vec;
       v_end = v_slot + set->table.ht_size;
       for ( ; v_slot < v_end; v_slot++)
@@ -1018,104 +2152,66 @@ target_environment (struct file *file)
           {
             struct variable **new_slot;
             struct variable *v = *v_slot;
+            struct global_env_name key;
+            struct global_env_name *n;
 
-            /* If this is a per-target variable and it hasn't been touched
-               already then look up the global version and take its export
-               value.  */
-            if (v->per_target && v->export == v_default)
-              {
-                struct variable *gv;
-
-                gv = lookup_variable_in_set (v->name, strlen (v->name),
-                                             &global_variable_set);
-                if (gv)
-                  v->export = gv->export;
-              }
-
-            switch (v->export)
-              {
-              case v_default:
-                if (v->origin == o_default || v->origin == o_automatic)
-                  /* Only export default variables by explicit request.  */
-                  continue;
-
-                /* The variable doesn't have a name that can be exported.  */
-                if (! v->exportable)
-                  continue;
-
-                if (! export_all_variables
-                    && v->origin != o_command
-                    && v->origin != o_env && v->origin != o_env_override)
-                  continue;
-                break;
-
-              case v_export:
-                break;
-
-              case v_noexport:
-                {
-                  /* If this is the SHELL variable and it's not exported,
-                     then add the value from our original environment, if
-                     the original environment defined a value for SHELL.  */
-                  extern struct variable shell_var;
-                  if (streq (v->name, "SHELL") && shell_var.value)
-                    {
-                      v = &shell_var;
-                      break;
-                    }
-                  continue;
-                }
+            key.name = v->name;
+            key.length = v->length;
+            n = hash_find_item (&global_env_names, &key);
+            if (n != 0)
+              for (i = 0; i < n->count; ++i)
+                global_env[n->users[i]].stale = job;
 
-              case v_ifset:
-                if (v->origin == o_default)
-                  continue;
-                break;
-              }
+            v = exported_variable (v);
+            if (v == 0)
+              continue;
 
             new_slot = (struct variable **) hash_find_slot (&table, v);
             if (HASH_VACANT (*new_slot))
-              hash_insert_at (&table, v, new_slot);
+              {
+                hash_insert_at (&table, v, new_slot);
+                if (n != 0 && n->value >= 0)
+                  global_env[n->value].hidden = job;
+              }
           }
     }
 
-  makelevel_key.name = xstrdup (MAKELEVEL_NAME);
-  makelevel_key.length = MAKELEVEL_LENGTH;
-  hash_delete (&table, &makelevel_key);
+  {
+    struct variable makelevel_key;
+    makelevel_key.name = (char *) MAKELEVEL_NAME;
+    makelevel_key.length = MAKELEVEL_LENGTH;
+    makelevel_key.hash = variable_name_hash (MAKELEVEL_NAME, MAKELEVEL_LENGTH);
+    hash_delete (&table, &makelevel_key);
+  }
 
-  result = result_0 = xmalloc ((table.ht_fill + 2) * sizeof (char *));
+  result = result_0 = xmalloc ((table.ht_fill + global_env_count + 2)
+                               * sizeof (char *));
 
   v_slot = (struct variable **) table.ht_vec;
   v_end = v_slot + table.ht_size;
   for ( ; v_slot < v_end; v_slot++)
     if (! HASH_VACANT (*v_slot))
-      {
-        struct variable *v = *v_slot;
+      *result++ = environment_string (*v_slot, file);
 
-        /* If V is recursively expanded and didn't come from the environment,
-           expand its value.  If it came from the environment, it should
-           go back into the environment unchanged.  */
-        if (v->recursive
-            && v->origin != o_env && v->origin != o_env_override)
-          {
-            char *value = recursively_expand_for_file (v, file);
-#ifdef WINDOWS32
-            if (strcmp (v->name, "Path") == 0 ||
-                strcmp (v->name, "PATH") == 0)
-              convert_Path_to_windows32 (value, ';');
-#endif
-            *result++ = xstrdup (concat (3, v->name, "=", value));
-            free (value);
-          }
-        else
-          {
-#ifdef WINDOWS32
-            if (strcmp (v->name, "Path") == 0 ||
-                strcmp (v->name, "PATH") == 0)
-              convert_Path_to_windows32 (v->value, ';');
-#endif
-            *result++ = xstrdup (concat (3, v->name, "=", v->value));
-          }
-      }
+  for (i = 0; i < global_env_count; ++i)
+    {
+      struct global_env_value *e = &global_env[i];
+
+      if (e->hidden == job)
+        continue;
+      if (e->string != 0 && e->stale != job)
+        {
+          *result++ = xstrdup (e->string);
+          ++environment_values_reused;
+        }
+      else
+        {
+          *result++ = (e->learning
+                       ? learn_global_environment (i, set_list, file)
+                       : environment_string (e->v, file));
+          ++environment_values_expanded;
+        }
+    }
 
   *result = xmalloc (100);
   sprintf (*result, "%s=%u", MAKELEVEL_NAME, makelevel + 1);
@@ -1125,7 +2221,7 @@ target_environment (struct file *file)
 
   return result_0;
 }
-
+
 static struct variable *
 set_special_var (struct variable *var)
 {
@@ -1662,6 +2758,8 @@ print_variable (const void *item, void *arg)
   fputs (origin, stdout);
   if (v->private_var)
     fputs (" private", stdout);
+  if (v->frozen && variables_frozen ())
+    fputs (_(" frozen"), stdout);
   if (v->fileinfo.filenm)
     printf (_(" (from '%s', line %lu)"),
             v->fileinfo.filenm, v->fileinfo.lineno);
@@ -1781,6 +2879,98 @@ print_variable_set (struct variable_set *set, const char *prefix, int pauto)
   putc ('\n', stdout);
 }
 
+/* What the variable sets of targets take, for print_target_variable_sets.  */
+
+struct variable_set_usage
+  {
+    unsigned long sets;                 /* Sets of targets' own variables.  */
+    unsigned long variables;            /* Variables in them.  */
+    unsigned long pattern_sets;         /* Sets of pattern variables.  */
+    unsigned long pattern_variables;    /* Variables in them.  */
+    unsigned long pattern_targets;      /* Targets with such a set.  */
+    unsigned long bytes;                /* Memory taken by all of them.  */
+  };
+
+/* Add the memory taken by SET and its variables to USAGE, and the number
+   of its variables to *COUNT.  */
+
+static void
+variable_set_usage (const struct variable_set *set,
+                    struct variable_set_usage *usage, unsigned long *count)
+{
+  struct variable **vp = (struct variable **) set->table.ht_vec;
+  struct variable **end = vp + set->table.ht_size;
+
+  usage->bytes += (sizeof (struct variable_set)
+                   + set->table.ht_size * sizeof (*vp));
+  for ( ; vp < end; ++vp)
+    if (! HASH_VACANT (*vp))
+      {
+        usage->bytes += sizeof (struct variable) + strlen ((*vp)->value) + 1;
+        ++*count;
+      }
+}
+
+static void
+tally_target_variable_sets (const void *item, void *arg)
+{
+  const struct file *f = item;
+  struct variable_set_usage *usage = arg;
+
+  if (f->variables != 0)
+    {
+      ++usage->sets;
+      usage->bytes += sizeof (struct variable_set_list);
+      variable_set_usage (f->variables->set, usage, &usage->variables);
+    }
+
+  if (f->pat_variables != 0)
+    {
+      ++usage->pattern_targets;
+      usage->bytes += sizeof (struct variable_set_list);
+      /* Shared sets are counted once, from PATTERN_SETS.  */
+      if (f->pat_variables->set->users <= 1)
+        {
+          ++usage->pattern_sets;
+          variable_set_usage (f->pat_variables->set, usage,
+                              &usage->pattern_variables);
+        }
+    }
+}
+
+/* Print how many variable sets targets have and the memory they take.  */
+
+static void
+print_target_variable_sets (void)
+{
+  struct variable_set_usage usage;
+  struct pattern_set **pp = (struct pattern_set **) pattern_sets.ht_vec;
+  struct pattern_set **end = pp + pattern_sets.ht_size;
+
+  memset (&usage, '\0', sizeof (usage));
+  map_files (tally_target_variable_sets, &usage);
+
+  for ( ; pp < end; ++pp)
+    if (! HASH_VACANT (*pp))
+      {
+        ++usage.pattern_sets;
+        usage.bytes += sizeof (struct pattern_set)
+          + (*pp)->count * sizeof (*(*pp)->vars);
+        variable_set_usage ((*pp)->set, &usage, &usage.pattern_variables);
+      }
+
+  puts (_("\n\n# Target-specific Variable Sets\n"));
+  printf (_("# %lu sets of target-specific variables,"
+            " holding %lu variables.\n"),
+          usage.sets, usage.variables);
+  printf (_("# %lu sets of pattern-specific variables, holding %lu variables,"
+            " for %lu targets (%lu of them reusing one made for another).\n"),
+          usage.pattern_sets, usage.pattern_variables, usage.pattern_targets,
+          pattern_sets_reused);
+  printf (_("# %lu bytes taken by these sets and their variables.\n"),
+          usage.bytes);
+}
+
 /* Print the data base of variables.  */
 
 void
@@ -1808,6 +2998,8 @@ print_variable_data_base (void)
     else
       printf (_("\n# %u pattern-specific variable values"), rules);
   }
+
+  print_target_variable_sets ();
 }
 
 
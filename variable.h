@@ -54,10 +54,11 @@ enum variable_flavor
 
 struct variable
   {
-    char *name;                 /* Variable name.  */
+    char *name;                 /* Variable name, in the strcache.  */
     char *value;                /* Variable value.  */
     gmk_floc fileinfo;          /* Where the variable was defined.  */
     int length;                 /* strlen (name) */
+    unsigned long hash;         /* variable_name_hash (name, length) */
     unsigned int recursive:1;   /* Gets recursively re-evaluated.  */
     unsigned int append:1;      /* Nonzero if an appending target-specific
                                    variable.  */
@@ -83,6 +84,13 @@ struct variable
         v_ifset,                /* Export it if it has a non-default value.  */
         v_default               /* Decide in target_environment.  */
       } export ENUM_BITFIELD (2);
+    unsigned int expanded:1;    /* Nonzero once the value has been expanded
+                                   without being compiled.  */
+    unsigned int frozen:1;      /* Nonzero if EXPANSION holds the value as
+                                   expanded once for all.  */
+    unsigned int unfreezable:1; /* Nonzero if that can't be done.  */
+    unsigned int freeze_tried:1; /* Nonzero if it was tried already.  */
+    struct expansion *expansion; /* The value compiled, or 0.  */
   };
 
 /* Structure that represents a variable set.  */
@@ -90,6 +98,8 @@ struct variable
 struct variable_set
   {
     struct hash_table table;    /* Hash table of variables.  */
+    int viewed;                 /* True if a variable view was made of it.  */
+    unsigned int users;         /* Set lists it is in, if more than one.  */
   };
 
 /* Structure that represents a list of variable sets.  */
@@ -99,6 +109,18 @@ struct variable_set_list
     struct variable_set_list *next;     /* Link in the chain.  */
     struct variable_set *set;           /* Variable set.  */
     int next_is_parent;                 /* True if next is a parent target.  */
+    struct variable_view *view;         /* Flattened view of the chain.  */
+  };
+
+/* The variables the sets of a parent target show to the targets it is a
+   parent of, before the global ones, entered in one hash table so that
+   each lookup takes one probe there.  */
+
+struct variable_view
+  {
+    struct hash_table table;            /* Variables, not owned.  */
+    unsigned long generation;           /* variable_view_generation when made.  */
+    const struct variable_set_list *rest; /* Sets left to look in.  */
   };
 
 /* Structure used for pattern-specific variables.  */
@@ -106,18 +128,61 @@ struct variable_set_list
 struct pattern_var
   {
     struct pattern_var *next;
+    struct pattern_var *same;   /* Next with the same text around the %.  */
     const char *suffix;
     const char *target;
     unsigned int len;
+    unsigned int serial;        /* Order of definition.  */
     struct variable variable;
   };
 
+/* A global variable, as it was when something was worked out from it.  */
+
+struct variable_dep
+  {
+    char *name;                 /* Variable name.  */
+    char *value;                /* Its value, or 0 if it was not defined.  */
+    unsigned int length;        /* strlen (name) */
+    unsigned int recursive:1;   /* Whether it was recursive.  */
+    enum variable_origin
+      origin ENUM_BITFIELD (4); /* Where it came from.  */
+  };
+
+#define VARIABLE_DEPS_MAX 16
+
+/* The global variables looked up while variable_deps points here.  */
+
+struct variable_deps
+  {
+    unsigned int count;
+    unsigned int overflow:1;    /* Nonzero if some could not be noted.  */
+    unsigned int local:1;       /* Nonzero if a variable was found in a set
+                                   of CONTEXT other than the global one.  */
+    const struct variable_set_list *context;
+    struct variable_dep deps[VARIABLE_DEPS_MAX];
+  };
+
 extern char *variable_buffer;
 extern struct variable_set_list *current_variable_set_list;
 extern struct variable *default_goal_var;
+extern unsigned long variable_generation;
+extern unsigned long variable_view_generation;
+extern struct variable_deps *variable_deps;
+extern unsigned long impure_function_calls;
+extern unsigned long function_table_changes;
+extern int freezing_variables;
+extern unsigned long frozen_generation;
+extern unsigned int frozen_variables;
+extern unsigned long environment_values_reused;
+extern unsigned long environment_values_expanded;
+
+/* Nonzero if values frozen by --freeze-variables can still be used.  */
+#define variables_frozen() \
+  (freezing_variables && frozen_generation == variable_generation)
 
 /* expand.c */
 char *variable_buffer_output (char *ptr, const char *string, unsigned int length);
+char *variable_buffer_reserve (char *ptr, unsigned int length);
 char *variable_expand (const char *line);
 char *variable_expand_for_file (const char *line, struct file *file);
 char *allocated_variable_expand_for_file (const char *line, struct file *file);
@@ -127,8 +192,16 @@ char *expand_argument (const char *str, const char *end);
 char *variable_expand_string (char *line, const char *string, long length);
 void install_variable_buffer (char **bufp, unsigned int *lenp);
 void restore_variable_buffer (char *buf, unsigned int len);
+struct expansion *compile_expansion (const char *string, unsigned int length);
+char *allocated_expansion (struct expansion *exp);
+char *stacked_expansion (struct expansion *exp);
+unsigned int stacked_values (void);
+void release_stacked_values (unsigned int count);
+void release_expansion (struct expansion *exp);
+void forget_expansion (struct variable *v);
 
 /* function.c */
+struct function_call;
 int handle_function (char **op, const char **stringp);
 int pattern_matches (const char *pattern, const char *percent, const char *str);
 char *subst_expand (char *o, const char *text, const char *subst,
@@ -139,6 +212,9 @@ char *patsubst_expand_pat (char *o, const char *text, const char *pattern,
                            const char *replace_percent);
 char *patsubst_expand (char *o, const char *text, char *pattern, char *replace);
 char *func_shell_base (char *o, char **argv, int trim_newlines);
+int compile_function_call (const char **stringp, struct function_call **callp);
+char *expand_function_call (char *o, const struct function_call *call);
+void free_function_call (struct function_call *call);
 
 
 /* expand.c */
@@ -154,6 +230,15 @@ struct variable_set_list *create_new_variable_set (void);
 const char *origin2str(variable_origin_t origin);
 
 void free_variable_set (struct variable_set_list *);
+int variable_deps_unchanged (const struct variable_dep *deps,
+                             unsigned int count);
+void free_variable_deps (struct variable_dep *deps, unsigned int count);
+void merge_variable_deps (struct variable_deps *into,
+                          const struct variable_deps *from);
+void freeze_variables (void);
+void thaw_variables (void);
+int may_freeze_variable (struct variable *v, const struct variable_deps *deps,
+                         int impure);
 
 /*! Create a new variable set, push it on the current setlist,
   and assign current_variable_set_list to it.
@@ -180,6 +265,8 @@ void define_automatic_variables (void);
    If we're READing a makefile, don't do the pattern variable search now,
    since the pattern variable might not have been defined yet.  */
 void initialize_file_variables (struct file *file, int reading);
+void make_variable_view (struct variable_set_list *setlist);
+void free_variable_view (struct variable_set_list *setlist);
 
 /*! Print all the local variables of P_TARGET.  Lines output have "# "
     prepended. If you want hash table statistics too, set b_hash_stats
@@ -220,7 +307,10 @@ void hash_init_function_table (void);
 void define_new_function(const gmk_floc *flocp, const char *name,
                          unsigned int min, unsigned int max, unsigned int flags,
                          gmk_func_ptr func);
+unsigned long variable_name_hash (const char *name, unsigned int length);
 struct variable *lookup_variable (const char *name, unsigned int length);
+struct variable *lookup_hashed_variable (const char *name, unsigned int length,
+                                         unsigned long hash);
 struct variable *lookup_variable_in_set (const char *name, unsigned int length,
                                          const struct variable_set *set);
 
@@ -282,6 +372,9 @@ char **target_environment (struct file *file);
 struct pattern_var *create_pattern_var (const char *target,
                                         const char *suffix);
 
+/* Chain of all pattern-specific variables, shortest pattern first.  */
+extern struct pattern_var *pattern_vars;
+
 extern int export_all_variables;
 
 #define MAKELEVEL_NAME "MAKELEVEL"
@@ -300,6 +300,18 @@ construct_vpath_list (char *pattern, char *dirpath)
     free ((void *)vpath);
 }
 
+/* Call FN with the pattern and the null-terminated list of directories of
+   each selective VPATH search path, most recently defined first.  */
+
+void
+map_vpath_lists (void (*fn) (const char *pattern, const char **searchpath))
+{
+  struct vpath *v;
+
+  for (v = vpaths; v != 0; v = v->next)
+    (*fn) (v->pattern, v->searchpath);
+}
+
 /* Search the GPATH list for a pathname string that matches the one passed
    in.  If it is found, return 1.  Otherwise we return 0.  */
 